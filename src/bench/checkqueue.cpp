@@ -3,6 +3,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "bench.h"
+#include "crypto/sha256.h"
 #include "util.h"
 #include "validation.h"
 #include "checkqueue.h"
@@ -99,5 +100,110 @@ static void CCheckQueueSpeedPrevectorJob(benchmark::State& state)
     tg.interrupt_all();
     tg.join_all();
 }
+
+// A check that hashes a little data
+struct HashJob {
+    unsigned char data[64];
+    HashJob() { memset(data, 0, sizeof(data)); }
+    bool operator()()
+    {
+        unsigned char hash[CSHA256::OUTPUT_SIZE];
+        CSHA256().Write(data, sizeof(data)).Finalize(hash);
+        return hash[0] != 1 || hash[1] != 2 || hash[2] != 3 || hash[3] != 4;
+    }
+    void swap(HashJob& x) { std::swap(data, x.data); }
+};
+
+// Checks that hash a little data each, with a fixed number of worker threads
+// besides the master, to see how the queue scales
+static void CCheckQueueScaling(benchmark::State& state, int nThreads)
+{
+    CCheckQueue<HashJob> queue {QUEUE_BATCH_SIZE};
+    boost::thread_group tg;
+    for (auto x = 0; x < nThreads; ++x) {
+       tg.create_thread([&]{queue.Thread();});
+    }
+    while (state.KeepRunning()) {
+        CCheckQueueControl<HashJob> control(&queue);
+        for (size_t i = 0; i < BATCHES; i++) {
+            std::vector<HashJob> vChecks(BATCH_SIZE);
+            for (size_t x = 0; x < BATCH_SIZE; ++x)
+                vChecks[x].data[0] = x;
+            control.Add(vChecks);
+        }
+        control.Wait();
+    }
+    tg.interrupt_all();
+    tg.join_all();
+}
+
+static const size_t PIPELINE_BLOCKS = 10;
+static const size_t PIPELINE_SERIAL_HASHES = 2000;
+
+// Connects PIPELINE_BLOCKS blocks, each one serial work standing in for
+// reading the block and updating the coins, plus BATCHES * BATCH_SIZE script
+// checks. With fSpeculative, the checks of the next block run on a second
+// queue during the serial work of the current one, like -speculativeverify,
+// and the worker threads are split between both queues as init does.
+static void CCheckQueuePipeline(benchmark::State& state, bool fSpeculative)
+{
+    CCheckQueue<HashJob> queue {QUEUE_BATCH_SIZE};
+    CCheckQueue<HashJob> speculativeQueue {QUEUE_BATCH_SIZE};
+    int nThreads = std::max(MIN_CORES, GetNumCores()) - 1;
+    int nSpeculativeThreads = fSpeculative ? nThreads / 2 : 0;
+    boost::thread_group tg;
+    for (auto x = 0; x < nThreads - nSpeculativeThreads; ++x) {
+       tg.create_thread([&]{queue.Thread();});
+    }
+    for (auto x = 0; x < nSpeculativeThreads; ++x) {
+       tg.create_thread([&]{speculativeQueue.Thread();});
+    }
+    while (state.KeepRunning()) {
+        for (size_t nBlock = 0; nBlock < PIPELINE_BLOCKS; nBlock++) {
+            // The checks of this block were queued while connecting the previous one
+            bool fChecked = fSpeculative && nBlock > 0 && speculativeQueue.Wait();
+            if (fSpeculative && nBlock + 1 < PIPELINE_BLOCKS) {
+                for (size_t i = 0; i < BATCHES; i++) {
+                    std::vector<HashJob> vChecks(BATCH_SIZE);
+                    speculativeQueue.Add(vChecks);
+                }
+            }
+            HashJob serial;
+            for (size_t i = 0; i < PIPELINE_SERIAL_HASHES; i++)
+                serial();
+            if (!fChecked) {
+                CCheckQueueControl<HashJob> control(&queue);
+                for (size_t i = 0; i < BATCHES; i++) {
+                    std::vector<HashJob> vChecks(BATCH_SIZE);
+                    control.Add(vChecks);
+                }
+                control.Wait();
+            }
+        }
+    }
+    tg.interrupt_all();
+    tg.join_all();
+}
+
+static void CCheckQueuePipelineSerial(benchmark::State& state) { CCheckQueuePipeline(state, false); }
+static void CCheckQueuePipelineSpeculative(benchmark::State& state) { CCheckQueuePipeline(state, true); }
+
+static void CCheckQueueScaling1(benchmark::State& state) { CCheckQueueScaling(state, 1); }
+static void CCheckQueueScaling2(benchmark::State& state) { CCheckQueueScaling(state, 2); }
+static void CCheckQueueScaling4(benchmark::State& state) { CCheckQueueScaling(state, 4); }
+static void CCheckQueueScaling8(benchmark::State& state) { CCheckQueueScaling(state, 8); }
+static void CCheckQueueScaling16(benchmark::State& state) { CCheckQueueScaling(state, 16); }
+static void CCheckQueueScaling32(benchmark::State& state) { CCheckQueueScaling(state, 32); }
+static void CCheckQueueScaling64(benchmark::State& state) { CCheckQueueScaling(state, 64); }
+
 BENCHMARK(CCheckQueueSpeed);
 BENCHMARK(CCheckQueueSpeedPrevectorJob);
+BENCHMARK(CCheckQueueScaling1);
+BENCHMARK(CCheckQueueScaling2);
+BENCHMARK(CCheckQueueScaling4);
+BENCHMARK(CCheckQueueScaling8);
+BENCHMARK(CCheckQueueScaling16);
+BENCHMARK(CCheckQueueScaling32);
+BENCHMARK(CCheckQueueScaling64);
+BENCHMARK(CCheckQueuePipelineSerial);
+BENCHMARK(CCheckQueuePipelineSpeculative);
@@ -0,0 +1,76 @@
+// Copyright (c) 2026 The Bunkercoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "consensus/consensus.h"
+#include "miner.h"
+#include "policy/policy.h"
+#include "txmempool.h"
+
+#include <vector>
+
+static void AddTx(const CMutableTransaction& tx, const CAmount& nFee, CTxMemPool& pool)
+{
+    int64_t nTime = 0;
+    double dPriority = 10.0;
+    unsigned int nHeight = 1;
+    bool spendsCoinbase = false;
+    unsigned int sigOpCost = 4;
+    LockPoints lp;
+    pool.addUnchecked(tx.GetHash(), CTxMemPoolEntry(
+                                        MakeTransactionRef(tx), nFee, nTime, dPriority, nHeight,
+                                        0, spendsCoinbase, sigOpCost, lp));
+}
+
+// Select packages from a mempool of 20000 transactions in short chains and
+// fan-outs into a block that fits about half of it, the way
+// BlockAssembler::addPackageTxs does.
+static void PackageSelection(benchmark::State& state)
+{
+    CTxMemPool pool(CFeeRate(1000));
+    LOCK(pool.cs);
+
+    std::vector<COutPoint> vOutpoints;
+    for (int i = 0; i < 20000; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        // Every fourth transaction spends a confirmed output, the others an earlier transaction's
+        if (i % 4 == 0 || vOutpoints.empty()) {
+            tx.vin[0].prevout = COutPoint(uint256(), i);
+        } else {
+            size_t n = (i * 7919) % vOutpoints.size();
+            tx.vin[0].prevout = vOutpoints[n];
+            vOutpoints[n] = vOutpoints.back();
+            vOutpoints.pop_back();
+        }
+        tx.vin[0].scriptSig = CScript() << OP_1;
+        tx.vout.resize(2);
+        for (int j = 0; j < 2; j++) {
+            tx.vout[j].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+            tx.vout[j].nValue = 10 * COIN;
+            vOutpoints.push_back(COutPoint(tx.GetHash(), j));
+        }
+        AddTx(tx, 1000 + (i * 31) % 9000, pool);
+    }
+
+    const uint64_t nMaxWeight = 4000 + pool.GetTotalTxSize() * WITNESS_SCALE_FACTOR / 2;
+    std::vector<CTxMemPool::txiter> vEntries;
+    while (state.KeepRunning()) {
+        CPackageSelector selector(pool);
+        CPackageSelector::Package package;
+        uint64_t nWeight = 4000;
+        while (selector.Next(package)) {
+            if (nWeight + WITNESS_SCALE_FACTOR * package.nSizeWithAncestors >= nMaxWeight) {
+                selector.Failed();
+                continue;
+            }
+            selector.GetPackageEntries(vEntries);
+            for (size_t i = 0; i < vEntries.size(); i++)
+                nWeight += vEntries[i]->GetTxWeight();
+            selector.Added(vEntries);
+        }
+    }
+}
+
+BENCHMARK(PackageSelection);
@@ -0,0 +1,55 @@
+// Copyright (c) 2026 The Bunkercoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "bunkercoin-fees.h"
+#include "policy/policy.h"
+#include "txmempool.h"
+#include "version.h"
+
+// A transaction paying to a few outputs, one of them dust
+static CMutableTransaction RelayFeeTx()
+{
+    CMutableTransaction tx;
+    tx.vin.resize(2);
+    for (int i = 0; i < 2; i++) {
+        tx.vin[i].prevout = COutPoint(uint256(), i);
+        tx.vin[i].scriptSig = CScript() << std::vector<unsigned char>(72, 0x42) << std::vector<unsigned char>(33, 0x02);
+    }
+    tx.vout.resize(4);
+    for (int i = 0; i < 4; i++) {
+        tx.vout[i].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, i) << OP_EQUALVERIFY << OP_CHECKSIG;
+        tx.vout[i].nValue = i == 0 ? nDustLimit / 2 : 10 * COIN;
+    }
+    return tx;
+}
+
+// Minimum relay fee from the transaction itself, while nothing is prioritised
+static void MinRelayFeeTx(benchmark::State& state)
+{
+    const CTransaction tx(RelayFeeTx());
+    const unsigned int nBytes = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+    CAmount nFee = 0;
+    while (state.KeepRunning()) {
+        for (int i = 0; i < 1000; i++)
+            nFee += GetDogecoinMinRelayFee(tx, nBytes, false);
+    }
+    assert(nFee > 0);
+}
+
+// Minimum relay fee from a mempool entry, the way AcceptToMemoryPool gets it
+static void MinRelayFeeEntry(benchmark::State& state)
+{
+    LockPoints lp;
+    const CTxMemPoolEntry entry(MakeTransactionRef(RelayFeeTx()), 0, 0, 0.0, 1, 0, false, 4, lp);
+    CAmount nFee = 0;
+    while (state.KeepRunning()) {
+        for (int i = 0; i < 1000; i++)
+            nFee += GetDogecoinMinRelayFee(entry, 0.0, 0, false);
+    }
+    assert(nFee > 0);
+}
+
+BENCHMARK(MinRelayFeeTx);
+BENCHMARK(MinRelayFeeEntry);
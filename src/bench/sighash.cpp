@@ -0,0 +1,49 @@
+// Copyright (c) 2026 The Bunkercoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "primitives/transaction.h"
+#include "script/interpreter.h"
+#include "script/script.h"
+
+// A consolidation of 500 pay-to-pubkey-hash outputs into one
+static CMutableTransaction ConsolidationTx()
+{
+    CMutableTransaction tx;
+    tx.vin.resize(500);
+    for (unsigned int i = 0; i < tx.vin.size(); i++) {
+        tx.vin[i].prevout = COutPoint(uint256(), i);
+        tx.vin[i].scriptSig = CScript() << std::vector<unsigned char>(72, 0x42) << std::vector<unsigned char>(33, 0x02);
+    }
+    tx.vout.resize(1);
+    tx.vout[0].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 0) << OP_EQUALVERIFY << OP_CHECKSIG;
+    tx.vout[0].nValue = 500 * COIN;
+    return tx;
+}
+
+// Legacy SIGHASH_ALL hashes of every input, serializing the transaction each time
+static void SignatureHashLegacy(benchmark::State& state)
+{
+    const CTransaction tx(ConsolidationTx());
+    const CScript scriptCode = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 1) << OP_EQUALVERIFY << OP_CHECKSIG;
+    while (state.KeepRunning()) {
+        for (unsigned int i = 0; i < tx.vin.size(); i++)
+            SignatureHash(scriptCode, tx, i, SIGHASH_ALL, 0, SIGVERSION_BASE);
+    }
+}
+
+// The same from midstates, including the precomputation
+static void SignatureHashLegacyCached(benchmark::State& state)
+{
+    const CTransaction tx(ConsolidationTx());
+    const CScript scriptCode = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 1) << OP_EQUALVERIFY << OP_CHECKSIG;
+    while (state.KeepRunning()) {
+        PrecomputedTransactionData txdata(tx);
+        for (unsigned int i = 0; i < tx.vin.size(); i++)
+            SignatureHash(scriptCode, tx, i, SIGHASH_ALL, 0, SIGVERSION_BASE, &txdata);
+    }
+}
+
+BENCHMARK(SignatureHashLegacy);
+BENCHMARK(SignatureHashLegacyCached);
@@ -0,0 +1,145 @@
+// Copyright (c) 2026 The Bunkercoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockreader.h"
+
+#include "util.h"
+#include "utiltime.h"
+#include "validation.h"
+#include "version.h"
+
+CBlockReader::CBlockReader(std::function<void()> notifyDoneIn) :
+    notifyDone(notifyDoneIn), fRequestShutdown(false)
+{
+}
+
+CBlockReader::~CBlockReader()
+{
+    Stop();
+}
+
+void CBlockReader::Start(int nThreads)
+{
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        fRequestShutdown = false;
+    }
+    for (int i = 0; i < nThreads; i++)
+        vThreads.emplace_back(&TraceThread<std::function<void()> >, "blkread", std::function<void()>(std::bind(&CBlockReader::ThreadRead, this)));
+}
+
+void CBlockReader::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        fRequestShutdown = true;
+    }
+    cond.notify_all();
+    for (std::thread& thread : vThreads)
+        thread.join();
+    vThreads.clear();
+}
+
+bool CBlockReader::Request(NodeId node, const uint256& hash, const CDiskBlockPos& pos, const Consensus::Params& consensusParams)
+{
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        ReadKey key(node, hash);
+        if (mapReads.count(key))
+            return true;
+        if (mapReads.size() >= MAX_BLOCK_READS_QUEUED)
+            return false;
+        Read& read = mapReads[key];
+        read.pos = pos;
+        read.pconsensusParams = &consensusParams;
+        read.fDone = false;
+        queue.push_back(key);
+        stats.nQueued++;
+    }
+    cond.notify_one();
+    return true;
+}
+
+CBlockReader::Status CBlockReader::Take(NodeId node, const uint256& hash, std::shared_ptr<const CBlock>& pblock)
+{
+    std::lock_guard<std::mutex> lock(cs);
+    auto it = mapReads.find(ReadKey(node, hash));
+    if (it == mapReads.end())
+        return NOT_REQUESTED;
+    if (!it->second.fDone)
+        return PENDING;
+    pblock = std::move(it->second.pblock);
+    mapReads.erase(it);
+    return DONE;
+}
+
+void CBlockReader::Forget(NodeId node)
+{
+    std::lock_guard<std::mutex> lock(cs);
+    auto it = mapReads.lower_bound(ReadKey(node, uint256()));
+    while (it != mapReads.end() && it->first.first == node) {
+        if (!it->second.fDone)
+            stats.nQueued--;
+        it = mapReads.erase(it);
+    }
+    // Queued keys of this node are skipped by the readers once they no longer map to a read
+}
+
+CBlockReaderStats CBlockReader::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(cs);
+    return stats;
+}
+
+void CBlockReader::ThreadRead()
+{
+    while (true) {
+        ReadKey key;
+        CDiskBlockPos pos;
+        const Consensus::Params* pconsensusParams;
+        {
+            std::unique_lock<std::mutex> lock(cs);
+            while (true) {
+                if (fRequestShutdown)
+                    return;
+                if (queue.empty()) {
+                    cond.wait(lock);
+                    continue;
+                }
+                key = queue.front();
+                queue.pop_front();
+                auto it = mapReads.find(key);
+                if (it != mapReads.end() && !it->second.fDone) {
+                    pos = it->second.pos;
+                    pconsensusParams = it->second.pconsensusParams;
+                    break;
+                }
+            }
+        }
+
+        int64_t nStart = GetTimeMicros();
+        std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+        bool fRead = ReadBlockFromDisk(*pblock, pos, *pconsensusParams, false) && pblock->GetHash() == key.second;
+        int64_t nReadMicros = GetTimeMicros() - nStart;
+        size_t nBytes = fRead ? ::GetSerializeSize(*pblock, SER_NETWORK, PROTOCOL_VERSION) : 0;
+
+        {
+            std::lock_guard<std::mutex> lock(cs);
+            auto it = mapReads.find(key);
+            if (it != mapReads.end() && !it->second.fDone) {
+                it->second.fDone = true;
+                // A failed read is reported as a null block; the caller falls back to reading synchronously
+                if (fRead)
+                    it->second.pblock = std::move(pblock);
+                stats.nQueued--;
+            }
+            if (fRead) {
+                stats.nBlocksRead++;
+                stats.nBytesRead += nBytes;
+            }
+            stats.nReadMicros += nReadMicros;
+        }
+        notifyDone();
+    }
+}
@@ -0,0 +1,101 @@
+// Copyright (c) 2026 The Bunkercoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKREADER_H
+#define BITCOIN_BLOCKREADER_H
+
+#include "chain.h"
+#include "consensus/params.h"
+#include "net.h"
+#include "primitives/block.h"
+#include "uint256.h"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/** Maximum number of block reads queued or held for all peers together */
+static const size_t MAX_BLOCK_READS_QUEUED = 32;
+
+/** Disk read statistics of a CBlockReader */
+struct CBlockReaderStats
+{
+    uint64_t nBlocksRead;
+    uint64_t nBytesRead;
+    //! Time spent in ReadBlockFromDisk, in microseconds
+    int64_t nReadMicros;
+    //! Reads queued or in progress
+    size_t nQueued;
+
+    CBlockReaderStats() : nBlocksRead(0), nBytesRead(0), nReadMicros(0), nQueued(0) {}
+};
+
+/**
+ * Pool of threads reading blocks from disk ahead of the message handler,
+ * so that serving historical blocks to one peer does not stall processing
+ * for all other peers.
+ *
+ * Reads are keyed by (peer, block hash). The message handler requests reads
+ * for blocks a peer has asked for, and later takes the finished block when
+ * the corresponding getdata entry is processed. notifyDone is called after
+ * every finished read so the message handler can be woken up.
+ */
+class CBlockReader
+{
+public:
+    enum Status {
+        NOT_REQUESTED,
+        PENDING,
+        DONE,
+    };
+
+    CBlockReader(std::function<void()> notifyDoneIn);
+    ~CBlockReader();
+
+    void Start(int nThreads);
+    void Stop();
+
+    /** Queue a read unless one is already queued or finished. Returns false if the global limit is reached. */
+    bool Request(NodeId node, const uint256& hash, const CDiskBlockPos& pos, const Consensus::Params& consensusParams);
+
+    /**
+     * Look up a read. If it is DONE, the read is removed and pblock is set,
+     * to nullptr if the read failed.
+     */
+    Status Take(NodeId node, const uint256& hash, std::shared_ptr<const CBlock>& pblock);
+
+    /** Drop all reads for a disconnected node. */
+    void Forget(NodeId node);
+
+    CBlockReaderStats GetStats() const;
+
+private:
+    typedef std::pair<NodeId, uint256> ReadKey;
+    struct Read
+    {
+        CDiskBlockPos pos;
+        const Consensus::Params* pconsensusParams;
+        bool fDone;
+        std::shared_ptr<const CBlock> pblock;
+    };
+
+    void ThreadRead();
+
+    std::function<void()> notifyDone;
+
+    mutable std::mutex cs;
+    std::condition_variable cond;
+    bool fRequestShutdown;
+    std::map<ReadKey, Read> mapReads;
+    std::deque<ReadKey> queue;
+    CBlockReaderStats stats;
+    std::vector<std::thread> vThreads;
+};
+
+#endif // BITCOIN_BLOCKREADER_H
@@ -19,7 +19,7 @@
 
 #ifdef ENABLE_WALLET
 
-CFeeRate GetBunkercoinFeeRate(int priority)
+static CFeeRate GetBunkercoinFixedFeeRate(int priority)
 {
     switch(priority)
     {
@@ -40,6 +40,40 @@ CFeeRate GetBunkercoinFeeRate(int priority)
     return CWallet::minTxFee;
 }
 
+/** Confirmation target the fee estimator is asked about for a preset, 0 if the preset has a fixed rate */
+static int GetBunkercoinPriorityTarget(int priority)
+{
+    switch(priority)
+    {
+    case MANY_GENEROUS:
+        return 2;
+    case AMAZE:
+        return 3;
+    case WOW:
+        return 6;
+    case MORE:
+        return 12;
+    default:
+        break;
+    }
+    return 0;
+}
+
+CFeeRate GetBunkercoinFeeRate(int priority)
+{
+    CFeeRate fixedRate = GetBunkercoinFixedFeeRate(priority);
+    int nTarget = GetBunkercoinPriorityTarget(priority);
+    if (nTarget == 0)
+        return fixedRate;
+
+    // Pay what recent blocks needed for the preset's target once the estimator
+    // has enough data, but never less than the minimum or more than the top preset
+    CFeeRate estimate = mempool.estimateSmartFee(nTarget);
+    if (estimate == CFeeRate(0))
+        return fixedRate;
+    return std::min(std::max(estimate, CWallet::minTxFee), GetBunkercoinFixedFeeRate(SUCH_EXPENSIVE));
+}
+
 const std::string GetBunkercoinPriorityLabel(int priority)
 {
     switch(priority)
@@ -64,20 +98,10 @@ const std::string GetBunkercoinPriorityLabel(int priority)
 
 #endif
 
-CAmount GetDogecoinMinRelayFee(const CTransaction& tx, unsigned int nBytes, bool fAllowFree)
+static CAmount GetDogecoinMinRelayFee(unsigned int nBytes, CAmount nDustFee, bool fAllowFree)
 {
-    {
-        LOCK(mempool.cs);
-        uint256 hash = tx.GetHash();
-        double dPriorityDelta = 0;
-        CAmount nFeeDelta = 0;
-        mempool.ApplyDeltas(hash, dPriorityDelta, nFeeDelta);
-        if (dPriorityDelta > 0 || nFeeDelta > 0)
-            return 0;
-    }
-
     CAmount nMinFee = ::minRelayTxFeeRate.GetFee(nBytes);
-    nMinFee += GetDogecoinDustFee(tx.vout, nDustLimit);
+    nMinFee += nDustFee;
 
     if (fAllowFree)
     {
@@ -94,6 +118,25 @@ CAmount GetDogecoinMinRelayFee(const CTransaction& tx, unsigned int nBytes, bool
     return nMinFee;
 }
 
+CAmount GetDogecoinMinRelayFee(const CTransaction& tx, unsigned int nBytes, bool fAllowFree)
+{
+    double dPriorityDelta = 0;
+    CAmount nFeeDelta = 0;
+    mempool.ApplyDeltas(tx.GetHash(), dPriorityDelta, nFeeDelta);
+    if (dPriorityDelta > 0 || nFeeDelta > 0)
+        return 0;
+
+    return GetDogecoinMinRelayFee(nBytes, GetDogecoinDustFee(tx.vout, nDustLimit), fAllowFree);
+}
+
+CAmount GetDogecoinMinRelayFee(const CTxMemPoolEntry& entry, double dPriorityDelta, CAmount nFeeDelta, bool fAllowFree)
+{
+    if (dPriorityDelta > 0 || nFeeDelta > 0)
+        return 0;
+
+    return GetDogecoinMinRelayFee(entry.GetTxSize(), entry.GetDustFee(), fAllowFree);
+}
+
 CAmount GetDogecoinDustFee(const std::vector<CTxOut> &vout, const CAmount dustLimit) {
     CAmount nFee = 0;
 
@@ -21,11 +21,19 @@ enum FeeRatePreset
     SUCH_EXPENSIVE
 };
 
-/** Estimate fee rate needed to get into the next nBlocks */
+/**
+ * Fee rate for a preset. MINIMUM and SUCH_EXPENSIVE are fixed; the presets in
+ * between follow the fee estimator for increasingly short confirmation
+ * targets, falling back to multiples of the minimum fee while it has no answer.
+ */
 CFeeRate GetBunkercoinFeeRate(int priority);
 const std::string GetBunkercoinPriorityLabel(int priority);
 #endif // ENABLE_WALLET
+class CTxMemPoolEntry;
+
 CAmount GetDogecoinMinRelayFee(const CTransaction& tx, unsigned int nBytes, bool fAllowFree);
+/** Minimum relay fee of a transaction about to enter the mempool, from the size and dust fee cached in its entry and its prioritisation */
+CAmount GetDogecoinMinRelayFee(const CTxMemPoolEntry& entry, double dPriorityDelta, CAmount nFeeDelta, bool fAllowFree);
 CAmount GetDogecoinDustFee(const std::vector<CTxOut> &vout, const CAmount dustLimit);
 
 #endif // BITCOIN_DOGECOIN_FEES_H
@@ -6,6 +6,9 @@
 #define BITCOIN_CHECKQUEUE_H
 
 #include <algorithm>
+#include <atomic>
+#include <deque>
+#include <memory>
 #include <vector>
 
 #include <boost/foreach.hpp>
@@ -16,6 +19,9 @@
 template <typename T>
 class CCheckQueueControl;
 
+/** Number of worker queues kept by a CCheckQueue, the master's included. Further threads share them. */
+static const unsigned int MAX_CHECKQUEUE_WORKERS = 65;
+
 /** 
  * Queue for verifications that have to be performed.
   * The verifications are represented by a type T, which must provide an
@@ -25,12 +31,28 @@ class CCheckQueueControl;
   * onto the queue, where they are processed by N-1 worker threads. When
   * the master is done adding work, it temporarily joins the worker pool
   * as an N'th worker, until all jobs are done.
+  *
+  * Every worker has its own queue, with its own lock. Added verifications
+  * are spread over the queues; a worker takes from the back of its own
+  * queue and, once that is empty, steals from the front of the others.
+  * The shared mutex is only taken to go to sleep, and by the master to
+  * wake sleeping workers up.
   */
 template <typename T>
 class CCheckQueue
 {
 private:
-    //! Mutex to protect the inner state
+    struct WorkerQueue
+    {
+        boost::mutex mutex;
+        std::deque<T> checks;
+        //! Size of checks, readable without the lock to skip empty queues
+        std::atomic<size_t> nSize;
+
+        WorkerQueue() : nSize(0) {}
+    };
+
+    //! Mutex for sleeping and waking up
     boost::mutex mutex;
 
     //! Worker threads block on this when out of work
@@ -39,91 +61,121 @@ private:
     //! Master thread blocks on this when out of work
     boost::condition_variable condMaster;
 
-    //! The queue of elements to be processed.
-    //! As the order of booleans doesn't matter, it is used as a LIFO (stack)
-    std::vector<T> queue;
+    //! Queues of elements to be processed, the master's first
+    std::unique_ptr<WorkerQueue[]> queues;
 
-    //! The number of workers (including the master) that are idle.
-    int nIdle;
+    //! The number of worker threads started, not counting the master
+    std::atomic<unsigned int> nWorkers;
 
-    //! The total number of workers (including the master).
-    int nTotal;
+    //! The number of workers that are asleep or about to go to sleep
+    std::atomic<int> nIdle;
+
+    //! Whether the master is asleep or about to go to sleep
+    std::atomic<bool> fMasterIdle;
 
     //! The temporary evaluation result.
-    bool fAllOk;
+    std::atomic<bool> fAllOk;
 
     /**
      * Number of verifications that haven't completed yet.
      * This includes elements that are no longer queued, but still in the
      * worker's own batches.
      */
-    unsigned int nTodo;
+    std::atomic<unsigned int> nTodo;
 
-    //! Whether we're shutting down.
-    bool fQuit;
+    //! Number of verifications in the queues, or about to be added to them
+    std::atomic<unsigned int> nQueued;
 
     //! The maximum number of elements to be processed in one batch
     unsigned int nBatchSize;
 
+    //! Queue the next added batch starts at, only used by the master
+    unsigned int nNextQueue;
+
+    unsigned int GetQueueCount() const
+    {
+        return std::min(nWorkers.load() + 1, MAX_CHECKQUEUE_WORKERS);
+    }
+
+    /**
+     * Move a batch of elements into vChecks, preferring queue nQueue. While
+     * other workers are idle or when stealing, at most half of a queue is
+     * taken at once, so that the rest can be stolen.
+     */
+    bool Take(unsigned int nQueue, std::vector<T>& vChecks)
+    {
+        unsigned int nQueues = GetQueueCount();
+        for (unsigned int i = 0; i < nQueues; i++) {
+            WorkerQueue& q = queues[(nQueue + i) % nQueues];
+            if (q.nSize == 0)
+                continue;
+            boost::unique_lock<boost::mutex> lock(q.mutex);
+            if (q.checks.empty())
+                continue;
+            size_t nAvailable = (i == 0 && nIdle == 0) ? q.checks.size() : q.checks.size() / 2;
+            size_t nNow = std::max((size_t)1, std::min((size_t)nBatchSize, nAvailable));
+            vChecks.resize(nNow);
+            for (size_t k = 0; k < nNow; k++) {
+                // Swap jobs out of the queue instead of copying, our own from the back and stolen ones from the front
+                if (i == 0) {
+                    vChecks[k].swap(q.checks.back());
+                    q.checks.pop_back();
+                } else {
+                    vChecks[k].swap(q.checks.front());
+                    q.checks.pop_front();
+                }
+            }
+            q.nSize -= nNow;
+            nQueued -= nNow;
+            return true;
+        }
+        return false;
+    }
+
     /** Internal function that does bulk of the verification work. */
-    bool Loop(bool fMaster = false)
+    bool Loop(unsigned int nQueue, bool fMaster = false)
     {
-        boost::condition_variable& cond = fMaster ? condMaster : condWorker;
         std::vector<T> vChecks;
         vChecks.reserve(nBatchSize);
-        unsigned int nNow = 0;
-        bool fOk = true;
-        do {
-            {
+        while (true) {
+            if (!Take(nQueue, vChecks)) {
                 boost::unique_lock<boost::mutex> lock(mutex);
-                // first do the clean-up of the previous loop run (allowing us to do it in the same critsect)
-                if (nNow) {
-                    fAllOk &= fOk;
-                    nTodo -= nNow;
-                    if (nTodo == 0 && !fMaster)
-                        // We processed the last element; inform the master it can exit and return the result
-                        condMaster.notify_one();
-                } else {
-                    // first iteration
-                    nTotal++;
-                }
-                // logically, the do loop starts here
-                while (queue.empty()) {
-                    if ((fMaster || fQuit) && nTodo == 0) {
-                        nTotal--;
+                if (fMaster) {
+                    // Only the master adds work, so once nothing is queued it waits for the workers to finish
+                    fMasterIdle = true;
+                    while (nTodo != 0 && nQueued == 0)
+                        condMaster.wait(lock);
+                    fMasterIdle = false;
+                    if (nTodo == 0) {
                         bool fRet = fAllOk;
                         // reset the status for new work later
-                        if (fMaster)
-                            fAllOk = true;
-                        // return the current status
+                        fAllOk = true;
                         return fRet;
                     }
+                } else {
                     nIdle++;
-                    cond.wait(lock); // wait
+                    while (nQueued == 0)
+                        condWorker.wait(lock);
                     nIdle--;
                 }
-                // Decide how many work units to process now.
-                // * Do not try to do everything at once, but aim for increasingly smaller batches so
-                //   all workers finish approximately simultaneously.
-                // * Try to account for idle jobs which will instantly start helping.
-                // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
-                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
-                vChecks.resize(nNow);
-                for (unsigned int i = 0; i < nNow; i++) {
-                    // We want the lock on the mutex to be as short as possible, so swap jobs from the global
-                    // queue to the local batch vector instead of copying.
-                    vChecks[i].swap(queue.back());
-                    queue.pop_back();
-                }
-                // Check whether we need to do work at all
-                fOk = fAllOk;
+                continue;
             }
-            // execute work
+            // Check whether we need to do work at all
+            bool fOk = fAllOk;
             BOOST_FOREACH (T& check, vChecks)
                 if (fOk)
                     fOk = check();
+            unsigned int nNow = vChecks.size();
+            // Destroy the checks before reporting them done
             vChecks.clear();
-        } while (true);
+            if (!fOk)
+                fAllOk = false;
+            if ((nTodo -= nNow) == 0 && !fMaster && fMasterIdle) {
+                // We processed the last element; inform the master it can exit and return the result
+                boost::unique_lock<boost::mutex> lock(mutex);
+                condMaster.notify_one();
+            }
+        }
     }
 
 public:
@@ -131,33 +183,52 @@ public:
     boost::mutex ControlMutex;
 
     //! Create a new check queue
-    CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), fQuit(false), nBatchSize(nBatchSizeIn) {}
+    CCheckQueue(unsigned int nBatchSizeIn) :
+        queues(new WorkerQueue[MAX_CHECKQUEUE_WORKERS]), nWorkers(0), nIdle(0), fMasterIdle(false), fAllOk(true),
+        nTodo(0), nQueued(0), nBatchSize(nBatchSizeIn), nNextQueue(0) {}
 
     //! Worker thread
     void Thread()
     {
-        Loop();
+        unsigned int nQueue = std::min(++nWorkers, MAX_CHECKQUEUE_WORKERS - 1);
+        Loop(nQueue);
     }
 
     //! Wait until execution finishes, and return whether all evaluations were successful.
     bool Wait()
     {
-        return Loop(true);
+        return Loop(0, true);
     }
 
     //! Add a batch of checks to the queue
     void Add(std::vector<T>& vChecks)
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        BOOST_FOREACH (T& check, vChecks) {
-            queue.push_back(T());
-            check.swap(queue.back());
-        }
+        if (vChecks.empty())
+            return;
         nTodo += vChecks.size();
-        if (vChecks.size() == 1)
-            condWorker.notify_one();
-        else if (vChecks.size() > 1)
-            condWorker.notify_all();
+        nQueued += vChecks.size();
+
+        // Spread the checks over the queues in contiguous runs
+        unsigned int nQueues = GetQueueCount();
+        size_t nRun = (vChecks.size() + nQueues - 1) / nQueues;
+        unsigned int nRuns = 0;
+        for (size_t nPos = 0; nPos < vChecks.size(); nPos += nRun, nRuns++) {
+            size_t nEnd = std::min(vChecks.size(), nPos + nRun);
+            WorkerQueue& q = queues[nNextQueue++ % nQueues];
+            boost::unique_lock<boost::mutex> lock(q.mutex);
+            for (size_t i = nPos; i < nEnd; i++) {
+                q.checks.push_back(T());
+                vChecks[i].swap(q.checks.back());
+            }
+            q.nSize += nEnd - nPos;
+        }
+
+        if (nIdle > 0) {
+            // One worker per run of checks, the others stay asleep
+            boost::unique_lock<boost::mutex> lock(mutex);
+            for (unsigned int i = 0; i < nRuns; i++)
+                condWorker.notify_one();
+        }
     }
 
     ~CCheckQueue()
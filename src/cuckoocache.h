@@ -87,11 +87,12 @@ public:
      * @param s the index of the entry to bit_set.
      * @post immediately subsequent call (assuming proper external memory
      * ordering) to bit_is_set(s) == true.
+     * @returns if the bit at index s was unset before.
      *
      */
-    inline void bit_set(uint32_t s)
+    inline bool bit_set(uint32_t s)
     {
-        mem[s >> 3].fetch_or(1 << (s & 7), std::memory_order_relaxed);
+        return !((1 << (s & 7)) & mem[s >> 3].fetch_or(1 << (s & 7), std::memory_order_relaxed));
     }
 
     /**  bit_unset marks an entry as something that should not be overwritten
@@ -99,10 +100,11 @@ public:
      * @param s the index of the entry to bit_unset.
      * @post immediately subsequent call (assuming proper external memory
      * ordering) to bit_is_set(s) == false.
+     * @returns if the bit at index s was set before.
      */
-    inline void bit_unset(uint32_t s)
+    inline bool bit_unset(uint32_t s)
     {
-        mem[s >> 3].fetch_and(~(1 << (s & 7)), std::memory_order_relaxed);
+        return (1 << (s & 7)) & mem[s >> 3].fetch_and(~(1 << (s & 7)), std::memory_order_relaxed);
     }
 
     /** bit_is_set queries the table for discardability at s
@@ -176,6 +178,12 @@ private:
      */
     mutable std::vector<bool> epoch_flags;
 
+    /** live_count is the number of slots whose collection flag is unset. It
+     * is kept up to date by allow_erase and please_keep so that the number of
+     * elements can be read without scanning the table.
+     */
+    mutable std::atomic<uint32_t> live_count;
+
     /** epoch_heuristic_counter is used to determine when a epoch might be aged
      * & an expensive scan should be done.  epoch_heuristic_counter is
      * decremented on insert and reset to the new number of inserts which would
@@ -240,7 +248,8 @@ private:
      */
     inline void allow_erase(uint32_t n) const
     {
-        collection_flags.bit_set(n);
+        if (collection_flags.bit_set(n))
+            live_count.fetch_sub(1, std::memory_order_relaxed);
     }
 
     /** please_keep marks the element at index n as an entry that should be kept.
@@ -249,7 +258,8 @@ private:
      */
     inline void please_keep(uint32_t n) const
     {
-        collection_flags.bit_unset(n);
+        if (collection_flags.bit_unset(n))
+            live_count.fetch_add(1, std::memory_order_relaxed);
     }
 
     /** epoch_check handles the changing of epochs for elements stored in the
@@ -300,7 +310,7 @@ public:
      * call to setup or setup_bytes, otherwise operations may segfault.
      */
     cache() : table(), size(), collection_flags(0), epoch_flags(),
-    epoch_heuristic_counter(), epoch_size(), depth_limit(0), hash_function()
+    live_count(0), epoch_heuristic_counter(), epoch_size(), depth_limit(0), hash_function()
     {
     }
 
@@ -321,6 +331,7 @@ public:
         table.resize(size);
         collection_flags.setup(size);
         epoch_flags.resize(size);
+        live_count = 0;
         // Set to 45% as described above
         epoch_size = std::max((uint32_t)1, (45 * size) / 100);
         // Initially set to wait for a whole epoch
@@ -451,6 +462,28 @@ public:
             }
         return false;
     }
+
+    /** count returns the number of elements that are not yet allowed to be
+     * erased, i.e. the number of elements for_each would visit, in constant
+     * time.
+     */
+    inline uint32_t count() const
+    {
+        return live_count.load(std::memory_order_relaxed);
+    }
+
+    /** for_each calls f on every element that is not yet allowed to be
+     * erased, in no particular order. Used to persist the cache.
+     *
+     * @param f function taking a const Element&
+     */
+    template <typename F>
+    void for_each(F f) const
+    {
+        for (uint32_t i = 0; i < size; ++i)
+            if (!collection_flags.bit_is_set(i))
+                f(table[i]);
+    }
 };
 } // namespace CuckooCache
 
@@ -30,6 +30,7 @@
 #include "script/standard.h"
 #include "script/sigcache.h"
 #include "scheduler.h"
+#include "templateengine.h"
 #include "timedata.h"
 #include "txdb.h"
 #include "txmempool.h"
@@ -130,6 +131,21 @@ static const char* FEE_ESTIMATES_FILENAME="fee_estimates.dat";
 
 std::atomic<bool> fRequestShutdown(false);
 std::atomic<bool> fDumpMempoolLater(false);
+static std::atomic<bool> fDumpSigCacheLater(false);
+
+/** Save the mempool if it changed since the last snapshot, so that a crash loses little of it */
+static void SnapshotMempool()
+{
+    static unsigned int nTransactionsUpdatedLast = 0;
+    // Until the mempool is loaded, a snapshot would overwrite mempool.dat with a partial pool
+    if (!fDumpMempoolLater)
+        return;
+    unsigned int nTransactionsUpdated = mempool.GetTransactionsUpdated();
+    if (nTransactionsUpdated == nTransactionsUpdatedLast)
+        return;
+    DumpMempool();
+    nTransactionsUpdatedLast = nTransactionsUpdated;
+}
 
 void StartShutdown()
 {
@@ -205,7 +221,13 @@ void Shutdown()
     if (pwalletMain)
         pwalletMain->Flush(false);
 #endif
+    if (g_templateEngine) {
+        UnregisterValidationInterface(g_templateEngine.get());
+        g_templateEngine->Stop();
+        g_templateEngine.reset();
+    }
     MapPort(false);
+    StopBlockReader();
     UnregisterValidationInterface(peerLogic.get());
     peerLogic.reset();
     g_connman.reset();
@@ -214,6 +236,8 @@ void Shutdown()
     UnregisterNodeSignals(GetNodeSignals());
     if (fDumpMempoolLater)
         DumpMempool();
+    if (fDumpSigCacheLater)
+        DumpSignatureCache();
 
     if (fFeeEstimatesInitialized)
     {
@@ -346,9 +370,11 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-maxorphantx=<n>", strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS));
     strUsage += HelpMessageOpt("-maxmempool=<n>", strprintf(_("Keep the transaction memory pool below <n> megabytes (default: %u)"), DEFAULT_MAX_MEMPOOL_SIZE));
     strUsage += HelpMessageOpt("-mempoolexpiry=<n>", strprintf(_("Do not keep transactions in the mempool longer than <n> hours (default: %u)"), DEFAULT_MEMPOOL_EXPIRY));
+    strUsage += HelpMessageOpt("-mempoolsnapshotinterval=<n>", strprintf(_("Save the mempool to disk every <n> minutes if it changed, 0 to only save it at shutdown (default: %u)"), DEFAULT_MEMPOOL_SNAPSHOT_INTERVAL));
     strUsage += HelpMessageOpt("-blockreconstructionextratxn=<n>", strprintf(_("Extra transactions to keep in memory for compact block reconstructions (default: %u)"), DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN));
-    strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"),
+    strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d). Another <n>-1 threads check block headers and transactions"),
         -GetNumCores(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS));
+    strUsage += HelpMessageOpt("-persistsigcache", strprintf(_("Save the signature cache to disk at shutdown and load it on startup (default: %u)"), DEFAULT_PERSIST_SIG_CACHE));
 #ifndef WIN32
     strUsage += HelpMessageOpt("-pid=<file>", strprintf(_("Specify pid file (default: %s)"), BITCOIN_PID_FILENAME));
 #endif
@@ -357,6 +383,7 @@ std::string HelpMessage(HelpMessageMode mode)
             "(default: 0 = disable pruning blocks, 1 = allow manual pruning via RPC, >%u = automatically prune block files to stay under the specified target size in MiB)"), MIN_DISK_SPACE_FOR_BLOCK_FILES / 1024 / 1024));
     strUsage += HelpMessageOpt("-reindex-chainstate", _("Rebuild chain state from the currently indexed blocks"));
     strUsage += HelpMessageOpt("-reindex", _("Rebuild chain state and block index from the blk*.dat files on disk"));
+    strUsage += HelpMessageOpt("-speculativeverify", strprintf(_("Check the scripts of the next block while connecting a block, on half of the script verification threads (default: %u)"), DEFAULT_SPECULATIVE_VERIFY));
 #ifndef WIN32
     strUsage += HelpMessageOpt("-sysperms", _("Create new files with system default permissions, instead of umask 077 (only effective with disabled wallet functionality)"));
 #endif
@@ -404,6 +431,8 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-whitelistrelay", strprintf(_("Accept relayed transactions received from whitelisted peers even when not relaying transactions (default: %d)"), DEFAULT_WHITELISTRELAY));
     strUsage += HelpMessageOpt("-whitelistforcerelay", strprintf(_("Force relay of transactions from whitelisted peers even if they violate local relay policy (default: %d)"), DEFAULT_WHITELISTFORCERELAY));
     strUsage += HelpMessageOpt("-maxuploadtarget=<n>", strprintf(_("Tries to keep outbound traffic under the given target (in MiB per 24h), 0 = no limit (default: %d)"), DEFAULT_MAX_UPLOAD_TARGET));
+    if (showDebug)
+        strUsage += HelpMessageOpt("-blockreadthreads=<n>", strprintf("Number of threads reading requested blocks from disk ahead of serving them, 0 = read on the message handler thread (0 to %d, default: %d)", MAX_BLOCK_READ_THREADS, DEFAULT_BLOCK_READ_THREADS));
 
 #ifdef ENABLE_WALLET
     strUsage += CWallet::GetWalletHelpString(showDebug);
@@ -415,6 +444,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-zmqpubhashtx=<address>", _("Enable publish hash transaction in <address>"));
     strUsage += HelpMessageOpt("-zmqpubrawblock=<address>", _("Enable publish raw block in <address>"));
     strUsage += HelpMessageOpt("-zmqpubrawtx=<address>", _("Enable publish raw transaction in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubhashtemplateprev=<address>", _("Enable publish parent block hash of new block templates in <address>"));
 #endif
 
     strUsage += HelpMessageGroup(_("Debugging/Testing options:"));
@@ -974,6 +1004,10 @@ bool AppInitParameterInteraction()
         nScriptCheckThreads = 0;
     else if (nScriptCheckThreads > MAX_SCRIPTCHECK_THREADS)
         nScriptCheckThreads = MAX_SCRIPTCHECK_THREADS;
+    // Speculative checks only pay off if they can run next to the current block's
+    // script checks. They take half of the script check threads, so at least two
+    // of those are needed besides the thread connecting blocks.
+    fSpeculativeVerify = nScriptCheckThreads > 2 && GetBoolArg("-speculativeverify", DEFAULT_SPECULATIVE_VERIFY);
 
     // block pruning; get the amount of disk space (in MiB) to allot for block & undo files
     int64_t nPruneArg = GetArg("-prune", 0);
@@ -1203,11 +1237,21 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
     LogPrintf("Using at most %i automatic connections (%i file descriptors available)\n", nMaxConnections, nFD);
 
     InitSignatureCache();
+    InitScriptExecutionCache();
+    if (GetBoolArg("-persistsigcache", DEFAULT_PERSIST_SIG_CACHE)) {
+        LoadSignatureCache();
+        fDumpSigCacheLater = true;
+    }
 
     LogPrintf("Using %u threads for script verification\n", nScriptCheckThreads);
     if (nScriptCheckThreads) {
-        for (int i=0; i<nScriptCheckThreads-1; i++)
+        int nSpeculativeThreads = fSpeculativeVerify ? (nScriptCheckThreads - 1) / 2 : 0;
+        for (int i=0; i<nScriptCheckThreads-1-nSpeculativeThreads; i++)
             threadGroup.create_thread(&ThreadScriptCheck);
+        for (int i=0; i<nScriptCheckThreads-1; i++)
+            threadGroup.create_thread(&ThreadBlockDataCheck);
+        for (int i=0; i<nSpeculativeThreads; i++)
+            threadGroup.create_thread(&ThreadSpeculativeScriptCheck);
     }
 
     // Start the lightweight task scheduler thread
@@ -1633,6 +1677,10 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
 
     threadGroup.create_thread(boost::bind(&ThreadImport, vImportFiles));
 
+    int64_t nMempoolSnapshotInterval = GetArg("-mempoolsnapshotinterval", DEFAULT_MEMPOOL_SNAPSHOT_INTERVAL);
+    if (nMempoolSnapshotInterval > 0)
+        scheduler.scheduleEvery(&SnapshotMempool, nMempoolSnapshotInterval * 60);
+
     // Wait for genesis block to be processed
     {
         boost::unique_lock<boost::mutex> lock(cs_GenesisWait);
@@ -1671,12 +1719,17 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
     connOptions.nMaxOutboundTimeframe = nMaxOutboundTimeframe;
     connOptions.nMaxOutboundLimit = nMaxOutboundLimit;
 
+    StartBlockReader(connman, std::max(0, std::min<int>(GetArg("-blockreadthreads", DEFAULT_BLOCK_READ_THREADS), MAX_BLOCK_READ_THREADS)));
+
     if (!connman.Start(scheduler, strNodeError, connOptions))
         return InitError(strNodeError);
 
     // ********************************************************* Step 12: finished
 
-    // Dogecoin: Do we need to do any RPC mining init here?
+    // Keep a block template ready for the mining RPCs; it stays idle until first used
+    g_templateEngine.reset(new CBlockTemplateEngine(chainparams));
+    RegisterValidationInterface(g_templateEngine.get());
+    g_templateEngine->Start();
 
     SetRPCWarmupFinished();
     uiInterface.InitMessage(_("Done loading"));
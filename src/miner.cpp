@@ -27,6 +27,7 @@
 #include "validationinterface.h"
 
 #include <algorithm>
+#include <atomic>
 #include <boost/thread.hpp>
 #include <boost/tuple/tuple.hpp>
 #include <queue>
@@ -128,7 +129,7 @@ void BlockAssembler::resetBlock()
     blockFinished = false;
 }
 
-std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn, bool fMineWitnessTx)
+std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn, bool fMineWitnessTx, bool fAddTransactions)
 {
     int64_t nTimeStart = GetTimeMicros();
 
@@ -175,16 +176,20 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     // transaction (which in most cases can be a no-op).
     fIncludeWitness = IsWitnessEnabled(pindexPrev, consensus) && fMineWitnessTx;
 
-    addPriorityTxs();
     int nPackagesSelected = 0;
     int nDescendantsUpdated = 0;
-    addPackageTxs(nPackagesSelected, nDescendantsUpdated);
+    if (fAddTransactions) {
+        addPriorityTxs();
+        addPackageTxs(nPackagesSelected, nDescendantsUpdated);
+    }
 
     int64_t nTime1 = GetTimeMicros();
 
-    nLastBlockTx = nBlockTx;
-    nLastBlockSize = nBlockSize;
-    nLastBlockWeight = nBlockWeight;
+    if (fAddTransactions) {
+        nLastBlockTx = nBlockTx;
+        nLastBlockSize = nBlockSize;
+        nLastBlockWeight = nBlockWeight;
+    }
 
     // Create coinbase transaction.
     CMutableTransaction coinbaseTx;
@@ -231,19 +236,6 @@ bool BlockAssembler::isStillDependent(CTxMemPool::txiter iter)
     return false;
 }
 
-void BlockAssembler::onlyUnconfirmed(CTxMemPool::setEntries& testSet)
-{
-    for (CTxMemPool::setEntries::iterator iit = testSet.begin(); iit != testSet.end(); ) {
-        // Only test txs not already in the block
-        if (inBlock.count(*iit)) {
-            testSet.erase(iit++);
-        }
-        else {
-            iit++;
-        }
-    }
-}
-
 bool BlockAssembler::TestPackage(uint64_t packageSize, int64_t packageSigOpsCost)
 {
     // TODO: switch to weight-based accounting for packages instead of vsize-based accounting.
@@ -259,7 +251,7 @@ bool BlockAssembler::TestPackage(uint64_t packageSize, int64_t packageSigOpsCost
 // - premature witness (in case segwit transactions are added to mempool before
 //   segwit activation)
 // - serialized size (in case -blockmaxsize is in use)
-bool BlockAssembler::TestPackageTransactions(const CTxMemPool::setEntries& package)
+bool BlockAssembler::TestPackageTransactions(const std::vector<CTxMemPool::txiter>& package)
 {
     uint64_t nPotentialBlockSize = nBlockSize; // only used with fNeedSizeAccounting
     BOOST_FOREACH (const CTxMemPool::txiter it, package) {
@@ -268,7 +260,7 @@ bool BlockAssembler::TestPackageTransactions(const CTxMemPool::setEntries& packa
         if (!fIncludeWitness && it->GetTx().HasWitness())
             return false;
         if (fNeedSizeAccounting) {
-            uint64_t nTxSize = ::GetSerializeSize(it->GetTx(), SER_NETWORK, PROTOCOL_VERSION);
+            uint64_t nTxSize = it->GetTx().GetTotalSize();
             if (nPotentialBlockSize + nTxSize >= nBlockMaxSize) {
                 return false;
             }
@@ -297,7 +289,7 @@ bool BlockAssembler::TestForBlock(CTxMemPool::txiter iter)
     }
 
     if (fNeedSizeAccounting) {
-        if (nBlockSize + ::GetSerializeSize(iter->GetTx(), SER_NETWORK, PROTOCOL_VERSION) >= nBlockMaxSize) {
+        if (nBlockSize + iter->GetTx().GetTotalSize() >= nBlockMaxSize) {
             if (nBlockSize >  nBlockMaxSize - 100 || lastFewTxs > 50) {
                  blockFinished = true;
                  return false;
@@ -336,7 +328,7 @@ void BlockAssembler::AddToBlock(CTxMemPool::txiter iter)
     pblocktemplate->vTxFees.push_back(iter->GetFee());
     pblocktemplate->vTxSigOpsCost.push_back(iter->GetSigOpCost());
     if (fNeedSizeAccounting) {
-        nBlockSize += ::GetSerializeSize(iter->GetTx(), SER_NETWORK, PROTOCOL_VERSION);
+        nBlockSize += iter->GetTx().GetTotalSize();
     }
     nBlockWeight += iter->GetTxWeight();
     ++nBlockTx;
@@ -356,85 +348,254 @@ void BlockAssembler::AddToBlock(CTxMemPool::txiter iter)
     }
 }
 
-int BlockAssembler::UpdatePackagesForAdded(const CTxMemPool::setEntries& alreadyAdded,
-        indexed_modified_transaction_set &mapModifiedTx)
+// Whether package a has a higher fee rate than package b, like
+// CompareTxMemPoolEntryByAncestorFee but on modified ancestor state
+static bool BetterPackage(CAmount nFeesA, uint64_t nSizeA, CTxMemPool::txiter a, CAmount nFeesB, uint64_t nSizeB, CTxMemPool::txiter b)
 {
-    int nDescendantsUpdated = 0;
-    BOOST_FOREACH(const CTxMemPool::txiter it, alreadyAdded) {
-        CTxMemPool::setEntries descendants;
-        mempool.CalculateDescendants(it, descendants);
-        // Insert all descendants (not yet in block) into the modified set
-        BOOST_FOREACH(CTxMemPool::txiter desc, descendants) {
-            if (alreadyAdded.count(desc))
-                continue;
-            ++nDescendantsUpdated;
-            modtxiter mit = mapModifiedTx.find(desc);
-            if (mit == mapModifiedTx.end()) {
-                CTxMemPoolModifiedEntry modEntry(desc);
-                modEntry.nSizeWithAncestors -= it->GetTxSize();
-                modEntry.nModFeesWithAncestors -= it->GetModifiedFee();
-                modEntry.nSigOpCostWithAncestors -= it->GetSigOpCost();
-                mapModifiedTx.insert(modEntry);
-            } else {
-                mapModifiedTx.modify(mit, update_for_parent_inclusion(it));
+    double f1 = (double)nFeesA * nSizeB;
+    double f2 = (double)nFeesB * nSizeA;
+    if (f1 == f2) {
+        return CTxMemPool::CompareIteratorByHash()(a, b);
+    }
+    return f1 > f2;
+}
+
+// Every selector run gets its own number, so stale selection indexes left
+// in mempool entries by earlier runs are recognised without clearing them.
+static std::atomic<uint64_t> nPackageSelectorRuns(0);
+
+CPackageSelector::CPackageSelector(CTxMemPool& poolIn) :
+    pool(poolIn), nRun(++nPackageSelectorRuns), nWalk(0), fLastFromHeap(false)
+{
+    AssertLockHeld(pool.cs);
+    mi = pool.mapTx.get<ancestor_score>().begin();
+}
+
+uint32_t CPackageSelector::GetEntry(CTxMemPool::txiter it)
+{
+    if (it->nSelectionRun == nRun)
+        return it->nSelectionIdx;
+    Entry entry;
+    entry.iter = it;
+    entry.nSizeWithAncestors = 0;
+    entry.nModFeesWithAncestors = 0;
+    entry.nSigOpCostWithAncestors = 0;
+    entry.nHeapPos = NOT_IN_HEAP;
+    entry.nWalk = 0;
+    entry.fInBlock = false;
+    entry.fFailed = false;
+    vArena.push_back(entry);
+    it->nSelectionRun = nRun;
+    it->nSelectionIdx = vArena.size() - 1;
+    return it->nSelectionIdx;
+}
+
+bool CPackageSelector::IsSkipped(CTxMemPool::txiter it) const
+{
+    // Entries with modified ancestor state are only considered from the heap
+    if (it->nSelectionRun != nRun)
+        return false;
+    const Entry& entry = vArena[it->nSelectionIdx];
+    return entry.nHeapPos != NOT_IN_HEAP || entry.fInBlock || entry.fFailed;
+}
+
+bool CPackageSelector::HeapBetter(uint32_t a, uint32_t b) const
+{
+    const Entry& entryA = vArena[a];
+    const Entry& entryB = vArena[b];
+    return BetterPackage(entryA.nModFeesWithAncestors, entryA.nSizeWithAncestors, entryA.iter,
+                         entryB.nModFeesWithAncestors, entryB.nSizeWithAncestors, entryB.iter);
+}
+
+void CPackageSelector::HeapSet(uint32_t pos, uint32_t idx)
+{
+    vHeap[pos] = idx;
+    vArena[idx].nHeapPos = pos;
+}
+
+void CPackageSelector::HeapPush(uint32_t idx)
+{
+    vHeap.push_back(idx);
+    vArena[idx].nHeapPos = vHeap.size() - 1;
+    HeapUpdate(vHeap.size() - 1);
+}
+
+void CPackageSelector::HeapRemove(uint32_t pos)
+{
+    vArena[vHeap[pos]].nHeapPos = NOT_IN_HEAP;
+    uint32_t idxLast = vHeap.back();
+    vHeap.pop_back();
+    if (pos < vHeap.size()) {
+        HeapSet(pos, idxLast);
+        HeapUpdate(pos);
+    }
+}
+
+void CPackageSelector::HeapUpdate(uint32_t pos)
+{
+    uint32_t idx = vHeap[pos];
+    // Sift up
+    while (pos > 0) {
+        uint32_t parent = (pos - 1) / HEAP_ARITY;
+        if (!HeapBetter(idx, vHeap[parent]))
+            break;
+        HeapSet(pos, vHeap[parent]);
+        pos = parent;
+    }
+    // Sift down
+    while (true) {
+        uint32_t best = pos;
+        uint32_t idxBest = idx;
+        uint32_t first = pos * HEAP_ARITY + 1;
+        for (uint32_t child = first; child < first + HEAP_ARITY && child < vHeap.size(); child++) {
+            if (HeapBetter(vHeap[child], idxBest)) {
+                best = child;
+                idxBest = vHeap[child];
             }
         }
+        if (best == pos)
+            break;
+        HeapSet(pos, idxBest);
+        pos = best;
     }
-    return nDescendantsUpdated;
+    HeapSet(pos, idx);
 }
 
-// Skip entries in mapTx that are already in a block or are present
-// in mapModifiedTx (which implies that the mapTx ancestor state is
-// stale due to ancestor inclusion in the block)
-// Also skip transactions that we've already failed to add. This can happen if
-// we consider a transaction in mapModifiedTx and it fails: we can then
-// potentially consider it again while walking mapTx.  It's currently
-// guaranteed to fail again, but as a belt-and-suspenders check we put it in
-// failedTx and avoid re-evaluation, since the re-evaluation would be using
-// cached size/sigops/fee values that are not actually correct.
-bool BlockAssembler::SkipMapTxEntry(CTxMemPool::txiter it, indexed_modified_transaction_set &mapModifiedTx, CTxMemPool::setEntries &failedTx)
+bool CPackageSelector::Next(Package& package)
 {
-    assert (it != mempool.mapTx.end());
-    if (mapModifiedTx.count(it) || inBlock.count(it) || failedTx.count(it))
-        return true;
-    return false;
+    const CTxMemPool::indexed_transaction_set::index<ancestor_score>::type& index = pool.mapTx.get<ancestor_score>();
+
+    // Skip entries that are in the block, failed, or whose mapTx ancestor
+    // state is stale because ancestors were included
+    while (mi != index.end() && IsSkipped(pool.mapTx.project<0>(mi)))
+        ++mi;
+    if (mi == index.end() && vHeap.empty())
+        return false;
+
+    // Take the next entry from mapTx, unless the best modified entry is better
+    fLastFromHeap = mi == index.end();
+    if (!fLastFromHeap && !vHeap.empty()) {
+        const Entry& top = vArena[vHeap[0]];
+        fLastFromHeap = BetterPackage(top.nModFeesWithAncestors, top.nSizeWithAncestors, top.iter,
+                                      mi->GetModFeesWithAncestors(), mi->GetSizeWithAncestors(), pool.mapTx.project<0>(mi));
+    }
+    if (fLastFromHeap) {
+        const Entry& top = vArena[vHeap[0]];
+        package.iter = top.iter;
+        package.nSizeWithAncestors = top.nSizeWithAncestors;
+        package.nModFeesWithAncestors = top.nModFeesWithAncestors;
+        package.nSigOpCostWithAncestors = top.nSigOpCostWithAncestors;
+    } else {
+        package.iter = pool.mapTx.project<0>(mi);
+        package.nSizeWithAncestors = mi->GetSizeWithAncestors();
+        package.nModFeesWithAncestors = mi->GetModFeesWithAncestors();
+        package.nSigOpCostWithAncestors = mi->GetSigOpCostWithAncestors();
+        ++mi;
+    }
+    iterLast = package.iter;
+    return true;
 }
 
-void BlockAssembler::SortForBlock(const CTxMemPool::setEntries& package, CTxMemPool::txiter entry, std::vector<CTxMemPool::txiter>& sortedEntries)
+void CPackageSelector::GetPackageEntries(std::vector<CTxMemPool::txiter>& vEntries)
 {
-    // Sort package by ancestor count
+    vEntries.clear();
+    ++nWalk;
+    uint32_t idx = GetEntry(iterLast);
+    vArena[idx].nWalk = nWalk;
+    vStack.assign(1, idx);
+    while (!vStack.empty()) {
+        CTxMemPool::txiter it = vArena[vStack.back()].iter;
+        vStack.pop_back();
+        vEntries.push_back(it);
+        // Ancestors of transactions in the block are in the block already
+        BOOST_FOREACH(CTxMemPool::txiter parent, pool.GetMemPoolParents(it)) {
+            uint32_t idxParent = GetEntry(parent);
+            Entry& entry = vArena[idxParent];
+            if (entry.fInBlock || entry.nWalk == nWalk)
+                continue;
+            entry.nWalk = nWalk;
+            vStack.push_back(idxParent);
+        }
+    }
+
     // If a transaction A depends on transaction B, then A's ancestor count
     // must be greater than B's.  So this is sufficient to validly order the
     // transactions for block inclusion.
-    sortedEntries.clear();
-    sortedEntries.insert(sortedEntries.begin(), package.begin(), package.end());
-    std::sort(sortedEntries.begin(), sortedEntries.end(), CompareTxIterByAncestorCount());
+    std::sort(vEntries.begin(), vEntries.end(), CompareTxIterByAncestorCount());
+}
+
+void CPackageSelector::Failed()
+{
+    // Failed mapTx entries are already behind the walk; failed modified
+    // entries must leave the heap so the next best one can be considered
+    if (fLastFromHeap) {
+        uint32_t idx = vHeap[0];
+        assert(vArena[idx].iter == iterLast);
+        HeapRemove(0);
+        vArena[idx].fFailed = true;
+    }
+}
+
+int CPackageSelector::Added(const std::vector<CTxMemPool::txiter>& vEntries)
+{
+    BOOST_FOREACH(CTxMemPool::txiter it, vEntries) {
+        uint32_t idx = GetEntry(it);
+        vArena[idx].fInBlock = true;
+        if (vArena[idx].nHeapPos != NOT_IN_HEAP)
+            HeapRemove(vArena[idx].nHeapPos);
+    }
+
+    int nDescendantsUpdated = 0;
+    BOOST_FOREACH(CTxMemPool::txiter it, vEntries) {
+        // Walk all descendants; those not in the block lose it from their ancestor state
+        ++nWalk;
+        vStack.assign(1, GetEntry(it));
+        while (!vStack.empty()) {
+            CTxMemPool::txiter itCur = vArena[vStack.back()].iter;
+            vStack.pop_back();
+            BOOST_FOREACH(CTxMemPool::txiter child, pool.GetMemPoolChildren(itCur)) {
+                uint32_t idxChild = GetEntry(child);
+                Entry& entry = vArena[idxChild];
+                if (entry.nWalk == nWalk)
+                    continue;
+                entry.nWalk = nWalk;
+                vStack.push_back(idxChild);
+                if (entry.fInBlock)
+                    continue;
+
+                ++nDescendantsUpdated;
+                bool fInHeap = entry.nHeapPos != NOT_IN_HEAP;
+                if (!fInHeap) {
+                    entry.nSizeWithAncestors = child->GetSizeWithAncestors();
+                    entry.nModFeesWithAncestors = child->GetModFeesWithAncestors();
+                    entry.nSigOpCostWithAncestors = child->GetSigOpCostWithAncestors();
+                }
+                entry.nSizeWithAncestors -= it->GetTxSize();
+                entry.nModFeesWithAncestors -= it->GetModifiedFee();
+                entry.nSigOpCostWithAncestors -= it->GetSigOpCost();
+                if (fInHeap) {
+                    HeapUpdate(entry.nHeapPos);
+                } else {
+                    HeapPush(idxChild);
+                }
+            }
+        }
+    }
+    return nDescendantsUpdated;
 }
 
 // This transaction selection algorithm orders the mempool based
 // on feerate of a transaction including all unconfirmed ancestors.
 // Since we don't remove transactions from the mempool as we select them
-// for block inclusion, we need an alternate method of updating the feerate
-// of a transaction with its not-yet-selected ancestors as we go.
-// This is accomplished by walking the in-mempool descendants of selected
-// transactions and storing a temporary modified state in mapModifiedTxs.
-// Each time through the loop, we compare the best transaction in
-// mapModifiedTxs with the next transaction in the mempool to decide what
-// transaction package to work on next.
+// for block inclusion, CPackageSelector keeps the feerate of transactions
+// with their not-yet-selected ancestors up to date as we go.
 void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpdated)
 {
-    // mapModifiedTx will store sorted packages after they are modified
-    // because some of their txs are already in the block
-    indexed_modified_transaction_set mapModifiedTx;
-    // Keep track of entries that failed inclusion, to avoid duplicate work
-    CTxMemPool::setEntries failedTx;
-
-    // Start by adding all descendants of previously added txs to mapModifiedTx
-    // and modifying them for their already included ancestors
-    UpdatePackagesForAdded(inBlock, mapModifiedTx);
+    CPackageSelector selector(mempool);
 
-    CTxMemPool::indexed_transaction_set::index<ancestor_score>::type::iterator mi = mempool.mapTx.get<ancestor_score>().begin();
-    CTxMemPool::txiter iter;
+    // Start by modifying the descendants of previously added txs for their
+    // already included ancestors
+    selector.Added(std::vector<CTxMemPool::txiter>(inBlock.begin(), inBlock.end()));
 
     // Limit the number of attempts to add transactions to the block when it is
     // close to full; this is just a simple heuristic to finish quickly if the
@@ -442,67 +603,20 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
     const int64_t MAX_CONSECUTIVE_FAILURES = 1000;
     int64_t nConsecutiveFailed = 0;
 
-    while (mi != mempool.mapTx.get<ancestor_score>().end() || !mapModifiedTx.empty())
+    CPackageSelector::Package package;
+    std::vector<CTxMemPool::txiter> vEntries;
+    while (selector.Next(package))
     {
-        // First try to find a new transaction in mapTx to evaluate.
-        if (mi != mempool.mapTx.get<ancestor_score>().end() &&
-                SkipMapTxEntry(mempool.mapTx.project<0>(mi), mapModifiedTx, failedTx)) {
-            ++mi;
-            continue;
-        }
-
-        // Now that mi is not stale, determine which transaction to evaluate:
-        // the next entry from mapTx, or the best from mapModifiedTx?
-        bool fUsingModified = false;
-
-        modtxscoreiter modit = mapModifiedTx.get<ancestor_score>().begin();
-        if (mi == mempool.mapTx.get<ancestor_score>().end()) {
-            // We're out of entries in mapTx; use the entry from mapModifiedTx
-            iter = modit->iter;
-            fUsingModified = true;
-        } else {
-            // Try to compare the mapTx entry to the mapModifiedTx entry
-            iter = mempool.mapTx.project<0>(mi);
-            if (modit != mapModifiedTx.get<ancestor_score>().end() &&
-                    CompareModifiedEntry()(*modit, CTxMemPoolModifiedEntry(iter))) {
-                // The best entry in mapModifiedTx has higher score
-                // than the one from mapTx.
-                // Switch which transaction (package) to consider
-                iter = modit->iter;
-                fUsingModified = true;
-            } else {
-                // Either no entry in mapModifiedTx, or it's worse than mapTx.
-                // Increment mi for the next loop iteration.
-                ++mi;
-            }
-        }
-
-        // We skip mapTx entries that are inBlock, and mapModifiedTx shouldn't
-        // contain anything that is inBlock.
-        assert(!inBlock.count(iter));
-
-        uint64_t packageSize = iter->GetSizeWithAncestors();
-        CAmount packageFees = iter->GetModFeesWithAncestors();
-        int64_t packageSigOpsCost = iter->GetSigOpCostWithAncestors();
-        if (fUsingModified) {
-            packageSize = modit->nSizeWithAncestors;
-            packageFees = modit->nModFeesWithAncestors;
-            packageSigOpsCost = modit->nSigOpCostWithAncestors;
-        }
+        // The selector skips entries that are inBlock
+        assert(!inBlock.count(package.iter));
 
-        if (packageFees < blockMinFeeRate.GetFee(packageSize)) {
+        if (package.nModFeesWithAncestors < blockMinFeeRate.GetFee(package.nSizeWithAncestors)) {
             // Everything else we might consider has a lower fee rate
             return;
         }
 
-        if (!TestPackage(packageSize, packageSigOpsCost)) {
-            if (fUsingModified) {
-                // Since we always look at the best entry in mapModifiedTx,
-                // we must erase failed entries so that we can consider the
-                // next best entry on the next loop iteration
-                mapModifiedTx.get<ancestor_score>().erase(modit);
-                failedTx.insert(iter);
-            }
+        if (!TestPackage(package.nSizeWithAncestors, package.nSigOpCostWithAncestors)) {
+            selector.Failed();
 
             ++nConsecutiveFailed;
 
@@ -514,40 +628,26 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
             continue;
         }
 
-        CTxMemPool::setEntries ancestors;
-        uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
-        std::string dummy;
-        mempool.CalculateMemPoolAncestors(*iter, ancestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
-
-        onlyUnconfirmed(ancestors);
-        ancestors.insert(iter);
+        selector.GetPackageEntries(vEntries);
 
         // Test if all tx's are Final
-        if (!TestPackageTransactions(ancestors)) {
-            if (fUsingModified) {
-                mapModifiedTx.get<ancestor_score>().erase(modit);
-                failedTx.insert(iter);
-            }
+        if (!TestPackageTransactions(vEntries)) {
+            selector.Failed();
             continue;
         }
 
         // This transaction will make it in; reset the failed counter.
         nConsecutiveFailed = 0;
 
-        // Package can be added. Sort the entries in a valid order.
-        std::vector<CTxMemPool::txiter> sortedEntries;
-        SortForBlock(ancestors, iter, sortedEntries);
-
-        for (size_t i=0; i<sortedEntries.size(); ++i) {
-            AddToBlock(sortedEntries[i]);
-            // Erase from the modified set, if present
-            mapModifiedTx.erase(sortedEntries[i]);
+        // Package can be added, the entries are in a valid order.
+        for (size_t i=0; i<vEntries.size(); ++i) {
+            AddToBlock(vEntries[i]);
         }
 
         ++nPackagesSelected;
 
         // Update transactions that depend on each of these
-        nDescendantsUpdated += UpdatePackagesForAdded(ancestors, mapModifiedTx);
+        nDescendantsUpdated += selector.Added(vEntries);
     }
 }
 
@@ -565,30 +665,31 @@ void BlockAssembler::addPriorityTxs()
     bool fSizeAccounting = fNeedSizeAccounting;
     fNeedSizeAccounting = true;
 
-    // This vector will be sorted into a priority queue:
+    // The mempool keeps transactions sorted by coin age priority; this heap
+    // only holds children that become includable once their parents are added
     std::vector<TxCoinAgePriority> vecPriority;
     TxCoinAgePriorityCompare pricomparer;
     std::map<CTxMemPool::txiter, double, CTxMemPool::CompareIteratorByHash> waitPriMap;
     typedef std::map<CTxMemPool::txiter, double, CTxMemPool::CompareIteratorByHash>::iterator waitPriIter;
     double actualPriority = -1;
 
-    vecPriority.reserve(mempool.mapTx.size());
-    for (CTxMemPool::indexed_transaction_set::iterator mi = mempool.mapTx.begin();
-         mi != mempool.mapTx.end(); ++mi)
-    {
-        double dPriority = mi->GetPriority(nHeight);
-        CAmount dummy;
-        mempool.ApplyDeltas(mi->GetTx().GetHash(), dPriority, dummy);
-        vecPriority.push_back(TxCoinAgePriority(dPriority, mi));
-    }
-    std::make_heap(vecPriority.begin(), vecPriority.end(), pricomparer);
+    mempool.UpdatePriorityHeight(nHeight);
+    CTxMemPool::indexed_transaction_set::index<priority_score>::type::iterator mi = mempool.mapTx.get<priority_score>().begin();
+    CTxMemPool::indexed_transaction_set::index<priority_score>::type::iterator miEnd = mempool.mapTx.get<priority_score>().end();
 
     CTxMemPool::txiter iter;
-    while (!vecPriority.empty() && !blockFinished) { // add a tx from priority queue to fill the blockprioritysize
-        iter = vecPriority.front().second;
-        actualPriority = vecPriority.front().first;
-        std::pop_heap(vecPriority.begin(), vecPriority.end(), pricomparer);
-        vecPriority.pop_back();
+    while ((mi != miEnd || !vecPriority.empty()) && !blockFinished) { // add a tx in priority order to fill the blockprioritysize
+        if (mi == miEnd || (!vecPriority.empty() &&
+                !pricomparer(vecPriority.front(), TxCoinAgePriority(mi->GetCachedPriority(), mempool.mapTx.project<0>(mi))))) {
+            iter = vecPriority.front().second;
+            actualPriority = vecPriority.front().first;
+            std::pop_heap(vecPriority.begin(), vecPriority.end(), pricomparer);
+            vecPriority.pop_back();
+        } else {
+            iter = mempool.mapTx.project<0>(mi);
+            actualPriority = mi->GetCachedPriority();
+            ++mi;
+        }
 
         // If tx already in block, skip
         if (inBlock.count(iter)) {
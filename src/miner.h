@@ -10,9 +10,9 @@
 #include "txmempool.h"
 
 #include <stdint.h>
+#include <limits>
 #include <memory>
-#include "boost/multi_index_container.hpp"
-#include "boost/multi_index/ordered_index.hpp"
+#include <vector>
 
 class CBlockIndex;
 class CChainParams;
@@ -32,58 +32,6 @@ struct CBlockTemplate
     std::vector<unsigned char> vchCoinbaseCommitment;
 };
 
-// Container for tracking updates to ancestor feerate as we include (parent)
-// transactions in a block
-struct CTxMemPoolModifiedEntry {
-    CTxMemPoolModifiedEntry(CTxMemPool::txiter entry)
-    {
-        iter = entry;
-        nSizeWithAncestors = entry->GetSizeWithAncestors();
-        nModFeesWithAncestors = entry->GetModFeesWithAncestors();
-        nSigOpCostWithAncestors = entry->GetSigOpCostWithAncestors();
-    }
-
-    CTxMemPool::txiter iter;
-    uint64_t nSizeWithAncestors;
-    CAmount nModFeesWithAncestors;
-    int64_t nSigOpCostWithAncestors;
-};
-
-/** Comparator for CTxMemPool::txiter objects.
- *  It simply compares the internal memory address of the CTxMemPoolEntry object
- *  pointed to. This means it has no meaning, and is only useful for using them
- *  as key in other indexes.
- */
-struct CompareCTxMemPoolIter {
-    bool operator()(const CTxMemPool::txiter& a, const CTxMemPool::txiter& b) const
-    {
-        return &(*a) < &(*b);
-    }
-};
-
-struct modifiedentry_iter {
-    typedef CTxMemPool::txiter result_type;
-    result_type operator() (const CTxMemPoolModifiedEntry &entry) const
-    {
-        return entry.iter;
-    }
-};
-
-// This matches the calculation in CompareTxMemPoolEntryByAncestorFee,
-// except operating on CTxMemPoolModifiedEntry.
-// TODO: refactor to avoid duplication of this logic.
-struct CompareModifiedEntry {
-    bool operator()(const CTxMemPoolModifiedEntry &a, const CTxMemPoolModifiedEntry &b) const
-    {
-        double f1 = (double)a.nModFeesWithAncestors * b.nSizeWithAncestors;
-        double f2 = (double)b.nModFeesWithAncestors * a.nSizeWithAncestors;
-        if (f1 == f2) {
-            return CTxMemPool::CompareIteratorByHash()(a.iter, b.iter);
-        }
-        return f1 > f2;
-    }
-};
-
 // A comparator that sorts transactions based on number of ancestors.
 // This is sufficient to sort an ancestor package in an order that is valid
 // to appear in a block.
@@ -96,38 +44,82 @@ struct CompareTxIterByAncestorCount {
     }
 };
 
-typedef boost::multi_index_container<
-    CTxMemPoolModifiedEntry,
-    boost::multi_index::indexed_by<
-        boost::multi_index::ordered_unique<
-            modifiedentry_iter,
-            CompareCTxMemPoolIter
-        >,
-        // sorted by modified ancestor fee rate
-        boost::multi_index::ordered_non_unique<
-            // Reuse same tag from CTxMemPool's similar index
-            boost::multi_index::tag<ancestor_score>,
-            boost::multi_index::identity<CTxMemPoolModifiedEntry>,
-            CompareModifiedEntry
-        >
-    >
-> indexed_modified_transaction_set;
-
-typedef indexed_modified_transaction_set::nth_index<0>::type::iterator modtxiter;
-typedef indexed_modified_transaction_set::index<ancestor_score>::type::iterator modtxscoreiter;
-
-struct update_for_parent_inclusion
+/**
+ * Orders mempool transactions by the fee rate of the package formed with
+ * their ancestors that are not in the block yet, for block assembly.
+ *
+ * Walks mapTx's ancestor_score index. Transactions whose ancestor state
+ * changed because some of their ancestors were included are kept, with
+ * their modified state, in an indexed 4-ary heap. Everything the selector
+ * knows about a transaction lives in a flat arena, found through the
+ * entry's selection index, so selection does not allocate per transaction
+ * once the arena and scratch vectors have grown.
+ *
+ * mempool.cs must be held for as long as the selector is used.
+ */
+class CPackageSelector
 {
-    update_for_parent_inclusion(CTxMemPool::txiter it) : iter(it) {}
-
-    void operator() (CTxMemPoolModifiedEntry &e)
+public:
+    /** A package, identified by the transaction whose ancestors it contains */
+    struct Package
     {
-        e.nModFeesWithAncestors -= iter->GetFee();
-        e.nSizeWithAncestors -= iter->GetTxSize();
-        e.nSigOpCostWithAncestors -= iter->GetSigOpCost();
-    }
+        CTxMemPool::txiter iter;
+        uint64_t nSizeWithAncestors;
+        CAmount nModFeesWithAncestors;
+        int64_t nSigOpCostWithAncestors;
+    };
+
+    CPackageSelector(CTxMemPool& poolIn);
+
+    /** Find the best package not included or failed yet. Returns false when there is none. */
+    bool Next(Package& package);
+    /** Transactions of the last package not in the block yet, in an order valid for a block */
+    void GetPackageEntries(std::vector<CTxMemPool::txiter>& vEntries);
+    /** The last package could not be included */
+    void Failed();
+    /**
+     * The given transactions were included in the block. Updates the
+     * ancestor state of their descendants, returning the number of updates.
+     */
+    int Added(const std::vector<CTxMemPool::txiter>& vEntries);
+
+private:
+    static const uint32_t NOT_IN_HEAP = std::numeric_limits<uint32_t>::max();
+    static const uint32_t HEAP_ARITY = 4;
 
-    CTxMemPool::txiter iter;
+    struct Entry
+    {
+        CTxMemPool::txiter iter;
+        uint64_t nSizeWithAncestors;
+        CAmount nModFeesWithAncestors;
+        int64_t nSigOpCostWithAncestors;
+        //! Position in vHeap, if the ancestor state is modified
+        uint32_t nHeapPos;
+        //! Last graph walk that visited this entry
+        uint32_t nWalk;
+        bool fInBlock;
+        bool fFailed;
+    };
+
+    /** Index of it in vArena, adding it if needed. Invalidates references into vArena. */
+    uint32_t GetEntry(CTxMemPool::txiter it);
+    /** Whether the ancestor_score walk has to skip it */
+    bool IsSkipped(CTxMemPool::txiter it) const;
+    bool HeapBetter(uint32_t a, uint32_t b) const;
+    void HeapPush(uint32_t idx);
+    void HeapRemove(uint32_t pos);
+    void HeapUpdate(uint32_t pos);
+    void HeapSet(uint32_t pos, uint32_t idx);
+
+    CTxMemPool& pool;
+    uint64_t nRun;
+    uint32_t nWalk;
+    std::vector<Entry> vArena;
+    std::vector<uint32_t> vHeap;
+    std::vector<uint32_t> vStack;
+    CTxMemPool::indexed_transaction_set::index<ancestor_score>::type::iterator mi;
+    CTxMemPool::txiter iterLast;
+    bool fLastFromHeap;
 };
 
 /** Generate a new block, without valid proof-of-work */
@@ -164,8 +156,12 @@ private:
 
 public:
     BlockAssembler(const CChainParams& chainparams);
-    /** Construct a new block template with coinbase to scriptPubKeyIn */
-    std::unique_ptr<CBlockTemplate> CreateNewBlock(const CScript& scriptPubKeyIn, bool fMineWitnessTx);
+    /** Construct a new block template with coinbase to scriptPubKeyIn, and no other transactions unless fAddTransactions */
+    std::unique_ptr<CBlockTemplate> CreateNewBlock(const CScript& scriptPubKeyIn, bool fMineWitnessTx, bool fAddTransactions = true);
+
+    unsigned int GetBlockMaxWeight() const { return nBlockMaxWeight; }
+    unsigned int GetBlockMaxSize() const { return nBlockMaxSize; }
+    const CFeeRate& GetBlockMinFeeRate() const { return blockMinFeeRate; }
 
 private:
     // utility functions
@@ -189,24 +185,13 @@ private:
     bool isStillDependent(CTxMemPool::txiter iter);
 
     // helper functions for addPackageTxs()
-    /** Remove confirmed (inBlock) entries from given set */
-    void onlyUnconfirmed(CTxMemPool::setEntries& testSet);
     /** Test if a new package would "fit" in the block */
     bool TestPackage(uint64_t packageSize, int64_t packageSigOpsCost);
     /** Perform checks on each transaction in a package:
       * locktime, premature-witness, serialized size (if necessary)
       * These checks should always succeed, and they're here
       * only as an extra check in case of suboptimal node configuration */
-    bool TestPackageTransactions(const CTxMemPool::setEntries& package);
-    /** Return true if given transaction from mapTx has already been evaluated,
-      * or if the transaction's cached data in mapTx is incorrect. */
-    bool SkipMapTxEntry(CTxMemPool::txiter it, indexed_modified_transaction_set &mapModifiedTx, CTxMemPool::setEntries &failedTx);
-    /** Sort the package in an order that is valid to appear in a block */
-    void SortForBlock(const CTxMemPool::setEntries& package, CTxMemPool::txiter entry, std::vector<CTxMemPool::txiter>& sortedEntries);
-    /** Add descendants of given transactions to mapModifiedTx with ancestor
-      * state updated assuming given transactions are inBlock. Returns number
-      * of updated descendants. */
-    int UpdatePackagesForAdded(const CTxMemPool::setEntries& alreadyAdded, indexed_modified_transaction_set &mapModifiedTx);
+    bool TestPackageTransactions(const std::vector<CTxMemPool::txiter>& package);
 };
 
 /** Modify the extranonce in a block */
@@ -21,6 +21,7 @@
 #include "sync.h"
 #include "uint256.h"
 #include "threadinterrupt.h"
+#include "txrelayqueue.h"
 
 #include <atomic>
 #include <deque>
@@ -95,6 +96,9 @@ static const unsigned int DEFAULT_MISBEHAVING_BANTIME = 60 * 60 * 24;  // Defaul
 
 typedef int64_t NodeId;
 
+/** Key under which per-command statistics of unknown commands are lumped together */
+const static std::string NET_MESSAGE_COMMAND_OTHER = "*other*";
+
 struct AddedNodeInfo
 {
     std::string strAddedNode;
@@ -160,6 +164,10 @@ public:
 
     bool ForNode(NodeId id, std::function<bool(CNode* pnode)> func);
 
+    /** Queue a transaction for announcement to all peers. */
+    void RelayTransaction(const CTransaction& tx);
+    CTxRelayQueue& GetTxRelayQueue() { return txRelayQueue; }
+
     void PushMessage(CNode* pnode, CSerializedNetMsg&& msg);
 
     template<typename Callable>
@@ -372,6 +380,8 @@ private:
     mutable CCriticalSection cs_vNodes;
     std::atomic<NodeId> nLastNodeId;
 
+    CTxRelayQueue txRelayQueue;
+
     /** Services this instance offers */
     ServiceFlags nLocalServices;
 
@@ -484,6 +494,30 @@ extern CCriticalSection cs_mapLocalHost;
 extern std::map<CNetAddr, LocalServiceInfo> mapLocalHost;
 typedef std::map<std::string, uint64_t> mapMsgCmdSize; //command, total bytes
 
+/** Message handler cost of one message type */
+struct CMsgProcessStats
+{
+    uint64_t nCount;
+    uint64_t nBytes;
+    //! Time spent in ProcessMessage, in microseconds
+    int64_t nProcessMicros;
+    //! Part of nProcessMicros spent blocked on contended locks (mostly cs_main)
+    int64_t nLockWaitMicros;
+    int64_t nMaxProcessMicros;
+
+    CMsgProcessStats() : nCount(0), nBytes(0), nProcessMicros(0), nLockWaitMicros(0), nMaxProcessMicros(0) {}
+
+    void Add(uint64_t nBytesIn, int64_t nProcessMicrosIn, int64_t nLockWaitMicrosIn)
+    {
+        nCount++;
+        nBytes += nBytesIn;
+        nProcessMicros += nProcessMicrosIn;
+        nLockWaitMicros += nLockWaitMicrosIn;
+        nMaxProcessMicros = std::max(nMaxProcessMicros, nProcessMicrosIn);
+    }
+};
+typedef std::map<std::string, CMsgProcessStats> mapMsgCmdProcessStats; //command, processing stats
+
 class CNodeStats
 {
 public:
@@ -504,6 +538,7 @@ public:
     mapMsgCmdSize mapSendBytesPerMsgCmd;
     uint64_t nRecvBytes;
     mapMsgCmdSize mapRecvBytesPerMsgCmd;
+    mapMsgCmdProcessStats mapProcessStatsPerMsgCmd;
     bool fWhitelisted;
     double dPingTime;
     double dPingWait;
@@ -622,6 +657,9 @@ public:
     const uint64_t nKeyedNetGroup;
     std::atomic_bool fPauseRecv;
     std::atomic_bool fPauseSend;
+    // Message handler cost per received message type, filled in by net_processing
+    CCriticalSection cs_processStats;
+    mapMsgCmdProcessStats mapProcessStatsPerMsgCmd;
 protected:
 
     mapMsgCmdSize mapSendBytesPerMsgCmd;
@@ -641,9 +679,9 @@ public:
 
     // inventory based relay
     CRollingBloomFilter filterInventoryKnown;
-    // Set of transaction ids we still have to announce.
-    // They are sorted by the mempool before relay, so the order is not important.
-    std::set<uint256> setInventoryTxToSend;
+    // Position in the connection manager's shared transaction relay queue:
+    // sequence number of the next announcement we have not considered yet.
+    std::atomic<uint64_t> nTxRelayCursor;
     // List of block ids we still have announce.
     // There is no final sorting before sending, as they are always sent immediately
     // and in the order requested.
@@ -794,14 +832,11 @@ public:
         }
     }
 
+    // Transactions are announced through CConnman::RelayTransaction instead.
     void PushInventory(const CInv& inv)
     {
         LOCK(cs_inventory);
-        if (inv.type == MSG_TX) {
-            if (!filterInventoryKnown.contains(inv.hash)) {
-                setInventoryTxToSend.insert(inv.hash);
-            }
-        } else if (inv.type == MSG_BLOCK) {
+        if (inv.type == MSG_BLOCK) {
             vInventoryBlockToSend.push_back(inv.hash);
         }
     }
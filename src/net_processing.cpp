@@ -9,6 +9,7 @@
 #include "alert.h"
 #include "arith_uint256.h"
 #include "blockencodings.h"
+#include "blockreader.h"
 #include "chainparams.h"
 #include "consensus/validation.h"
 #include "hash.h"
@@ -63,6 +64,9 @@ static std::vector<std::pair<uint256, CTransactionRef>> vExtraTxnForCompact GUAR
 
 static const uint64_t RANDOMIZER_ID_ADDRESS_RELAY = 0x3cac0035b5866b90ULL; // SHA256("main address relay")[0:8]
 
+/** Length of the interval over which block download rates are measured, in microseconds */
+static const int64_t BLOCK_DOWNLOAD_RATE_INTERVAL = 10 * 1000000;
+
 // Internal stuff
 namespace {
     /** Number of nodes with fSyncStarted. */
@@ -106,12 +110,48 @@ namespace {
         const CBlockIndex* pindex;                               //!< Optional.
         bool fValidatedHeaders;                                  //!< Whether this block has validated headers at the time of request.
         std::unique_ptr<PartiallyDownloadedBlock> partialBlock;  //!< Optional, used for CMPCTBLOCK downloads
+        int64_t nTimeRequested;                                  //!< When the block was requested, in microseconds.
     };
     std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator> > mapBlocksInFlight;
 
     /** Stack of nodes which we have set to announce using compact blocks */
     std::list<NodeId> lNodesAnnouncingHeaderAndIDs;
 
+    /**
+     * Stretch of the header chain fetched from a peer other than the headers
+     * sync peer, starting at a checkpoint above our best header. Headers are
+     * checked for proof of work when they arrive and buffered until the
+     * anchor is in mapBlockIndex, at which point they are connected in order.
+     * Protected by cs_main.
+     */
+    struct HeadersSegment {
+        uint256 hashAnchor;
+        int nAnchorHeight;
+        //! Next checkpoint, or null to fetch up to nStopHeight.
+        uint256 hashStop;
+        int nStopHeight;
+        NodeId nodeFetching;
+        int64_t nRequestTime;
+        //! Buffered headers messages along with the peer that sent them.
+        std::vector<std::pair<NodeId, std::vector<CBlockHeader>>> vBatches;
+        int nHeaders;
+        bool fComplete;
+
+        uint256 GetTipHash() const { return vBatches.empty() ? hashAnchor : vBatches.back().second.back().GetHash(); }
+    };
+    /** Segments being fetched or waiting to be connected, by anchor height. */
+    std::map<int, HeadersSegment> mapHeadersSegments;
+
+    /** Block download progress since startup. Protected by cs_main. */
+    CBlockDownloadStats blockDownloadStats;
+    /** Start and counts of the current block download rate measurement interval. Protected by cs_main. */
+    int64_t nRateIntervalStart = 0;
+    uint64_t nRateIntervalBlocks = 0;
+    uint64_t nRateIntervalBytes = 0;
+
+    /** Moving average of the size of downloaded blocks, 0 until a block was downloaded. Protected by cs_main. */
+    int64_t nAvgBlockSize = 0;
+
     /** Number of preferable block download peers. */
     int nPreferredDownload = 0;
 
@@ -123,6 +163,13 @@ namespace {
     MapRelay mapRelay;
     /** Expiration-time ordered list of (expire time, relay map entry) pairs, protected by cs_main). */
     std::deque<std::pair<int64_t, MapRelay::iterator>> vRelayExpiration;
+
+    /** Reads requested blocks from disk ahead of sending them, if enabled. */
+    std::unique_ptr<CBlockReader> blockReader;
+
+    /** Message handler cost per message type, over all peers since startup. */
+    CCriticalSection cs_msgProcessStats;
+    mapMsgCmdProcessStats mapMsgProcessStats;
 } // anon namespace
 
 //////////////////////////////////////////////////////////////////////////////
@@ -171,6 +218,8 @@ struct CNodeState {
     bool fSyncStarted;
     //! When to potentially disconnect peer for stalling headers download
     int64_t nHeadersSyncTimeout;
+    //! Whether this peer failed to answer a headers segment request in time.
+    bool fHeadersSegmentStalled;
     //! Since when we're stalling block download progress (in microseconds), or 0.
     int64_t nStallingSince;
     std::list<QueuedBlock> vBlocksInFlight;
@@ -178,6 +227,16 @@ struct CNodeState {
     int64_t nDownloadingSince;
     int nBlocksInFlight;
     int nBlocksInFlightValidHeaders;
+    //! How many blocks may be in flight from this peer, sized by its measured throughput.
+    int nBlocksInTransitLimit;
+    //! Moving averages of this peer's block download throughput (bytes per second)
+    //! and of the time from requesting a block to receiving it (microseconds), 0 until measured.
+    int64_t nDownloadRate;
+    int64_t nBlockLatency;
+    //! The last BLOCK_STALLING_LATENCY_SAMPLES times from requesting a block to receiving it.
+    std::deque<int64_t> vBlockLatencySamples;
+    //! When the last requested block from this peer arrived, in microseconds.
+    int64_t nLastBlockReceived;
     //! Whether we consider this a preferred download peer.
     bool fPreferredDownload;
     //! Whether this peer wants invs or headers (when possible) for block announcements.
@@ -211,10 +270,15 @@ struct CNodeState {
         nUnconnectingHeaders = 0;
         fSyncStarted = false;
         nHeadersSyncTimeout = 0;
+        fHeadersSegmentStalled = false;
         nStallingSince = 0;
         nDownloadingSince = 0;
         nBlocksInFlight = 0;
         nBlocksInFlightValidHeaders = 0;
+        nBlocksInTransitLimit = MAX_BLOCKS_IN_TRANSIT_PER_PEER;
+        nDownloadRate = 0;
+        nBlockLatency = 0;
+        nLastBlockReceived = 0;
         fPreferredDownload = false;
         fPreferHeaders = false;
         fPreferHeaderAndIDs = false;
@@ -274,6 +338,8 @@ void InitializeNode(CNode *pnode, CConnman& connman) {
         LOCK(cs_main);
         mapNodeState.emplace_hint(mapNodeState.end(), std::piecewise_construct, std::forward_as_tuple(nodeid), std::forward_as_tuple(addr, std::move(addrName)));
     }
+    // Only announce transactions queued from now on
+    pnode->nTxRelayCursor = connman.GetTxRelayQueue().GetNextSequence();
     if(!pnode->fInbound)
         PushNodeVersion(pnode, connman, GetTime());
 }
@@ -285,6 +351,13 @@ void FinalizeNode(NodeId nodeid, bool& fUpdateConnectionTime) {
 
     if (state->fSyncStarted)
         nSyncStarted--;
+    if (state->nStallingSince)
+        blockDownloadStats.nStallMicros += GetTimeMicros() - state->nStallingSince;
+
+    for (auto& entry : mapHeadersSegments) {
+        if (entry.second.nodeFetching == nodeid)
+            entry.second.nodeFetching = -1;
+    }
 
     if (state->nMisbehavior == 0 && state->fCurrentlyConnected) {
         fUpdateConnectionTime = true;
@@ -294,6 +367,8 @@ void FinalizeNode(NodeId nodeid, bool& fUpdateConnectionTime) {
         mapBlocksInFlight.erase(entry.hash);
     }
     EraseOrphansFor(nodeid);
+    if (blockReader)
+        blockReader->Forget(nodeid);
     nPreferredDownload -= state->fPreferredDownload;
     nPeersWithValidatedDownloads -= (state->nBlocksInFlightValidHeaders != 0);
     assert(nPeersWithValidatedDownloads >= 0);
@@ -305,6 +380,7 @@ void FinalizeNode(NodeId nodeid, bool& fUpdateConnectionTime) {
         assert(mapBlocksInFlight.empty());
         assert(nPreferredDownload == 0);
         assert(nPeersWithValidatedDownloads == 0);
+        mapHeadersSegments.clear();
     }
 }
 
@@ -326,6 +402,8 @@ bool MarkBlockAsReceived(const uint256& hash) {
         }
         state->vBlocksInFlight.erase(itInFlight->second.second);
         state->nBlocksInFlight--;
+        if (state->nStallingSince)
+            blockDownloadStats.nStallMicros += GetTimeMicros() - state->nStallingSince;
         state->nStallingSince = 0;
         mapBlocksInFlight.erase(itInFlight);
         return true;
@@ -351,7 +429,7 @@ bool MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const Consensus::Pa
     MarkBlockAsReceived(hash);
 
     std::list<QueuedBlock>::iterator it = state->vBlocksInFlight.insert(state->vBlocksInFlight.end(),
-            {hash, pindex, pindex != NULL, std::unique_ptr<PartiallyDownloadedBlock>(pit ? new PartiallyDownloadedBlock(&mempool) : NULL)});
+            {hash, pindex, pindex != NULL, std::unique_ptr<PartiallyDownloadedBlock>(pit ? new PartiallyDownloadedBlock(&mempool) : NULL), GetTimeMicros()});
     state->nBlocksInFlight++;
     state->nBlocksInFlightValidHeaders += it->fValidatedHeaders;
     if (state->nBlocksInFlight == 1) {
@@ -367,6 +445,48 @@ bool MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const Consensus::Pa
     return true;
 }
 
+// Requires cs_main.
+// Updates the download measurements with a block the peer was asked for, before it is marked as received.
+void RecordBlockDownload(NodeId nodeid, const uint256& hash, uint64_t nBytes) {
+    std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(hash);
+    if (itInFlight == mapBlocksInFlight.end() || itInFlight->second.first != nodeid)
+        return;
+    CNodeState *state = State(nodeid);
+    const QueuedBlock& queuedBlock = *itInFlight->second.second;
+    int64_t nNow = GetTimeMicros();
+
+    // Requests are pipelined, so throughput is measured from when the previous block arrived
+    int64_t nLatency = nNow - queuedBlock.nTimeRequested;
+    state->nBlockLatency = state->nBlockLatency ? (state->nBlockLatency * 7 + nLatency) / 8 : nLatency;
+    state->vBlockLatencySamples.push_back(nLatency);
+    if (state->vBlockLatencySamples.size() > BLOCK_STALLING_LATENCY_SAMPLES)
+        state->vBlockLatencySamples.pop_front();
+    int64_t nInterval = nNow - std::max(state->nLastBlockReceived, queuedBlock.nTimeRequested);
+    if (nInterval > 0) {
+        int64_t nRate = nBytes * 1000000 / nInterval;
+        state->nDownloadRate = state->nDownloadRate ? (state->nDownloadRate * 7 + nRate) / 8 : nRate;
+    }
+    state->nLastBlockReceived = nNow;
+    nAvgBlockSize = nAvgBlockSize ? (nAvgBlockSize * 63 + (int64_t)nBytes) / 64 : nBytes;
+
+    if (blockDownloadStats.nTimeFirstBlock == 0) {
+        blockDownloadStats.nTimeFirstBlock = nNow;
+        nRateIntervalStart = nNow;
+    }
+    blockDownloadStats.nBlocksReceived++;
+    blockDownloadStats.nBytesReceived += nBytes;
+    nRateIntervalBlocks++;
+    nRateIntervalBytes += nBytes;
+    if (nNow - nRateIntervalStart >= BLOCK_DOWNLOAD_RATE_INTERVAL) {
+        double dSeconds = (nNow - nRateIntervalStart) / 1000000.0;
+        blockDownloadStats.dBlocksPerSec = nRateIntervalBlocks / dSeconds;
+        blockDownloadStats.dBytesPerSec = nRateIntervalBytes / dSeconds;
+        nRateIntervalStart = nNow;
+        nRateIntervalBlocks = 0;
+        nRateIntervalBytes = 0;
+    }
+}
+
 /** Check whether the last unknown block a peer advertised is not yet known. */
 void ProcessBlockAvailability(NodeId nodeid) {
     CNodeState *state = State(nodeid);
@@ -502,10 +622,10 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<con
 
     std::vector<const CBlockIndex*> vToFetch;
     const CBlockIndex *pindexWalk = state->pindexLastCommonBlock;
-    // Never fetch further than the best block we know the peer has, or more than BLOCK_DOWNLOAD_WINDOW + 1 beyond the last
+    // Never fetch further than the best block we know the peer has, or more than the download window + 1 beyond the last
     // linked block we have in common with this peer. The +1 is so we can detect stalling, namely if we would be able to
     // download that next block if the window were 1 larger.
-    int nWindowEnd = state->pindexLastCommonBlock->nHeight + BLOCK_DOWNLOAD_WINDOW;
+    int nWindowEnd = state->pindexLastCommonBlock->nHeight + GetBlockDownloadWindow(nAvgBlockSize);
     int nMaxHeight = std::min<int>(state->pindexBestKnownBlock->nHeight, nWindowEnd + 1);
     NodeId waitingfor = -1;
     while (pindexWalk->nHeight < nMaxHeight) {
@@ -572,9 +692,41 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats) {
         if (queue.pindex)
             stats.vHeightInFlight.push_back(queue.pindex->nHeight);
     }
+    stats.nBlocksInTransitLimit = state->nBlocksInTransitLimit;
+    stats.nDownloadRate = state->nDownloadRate;
+    stats.nBlockLatency = state->nBlockLatency;
+    stats.nStallingTimeout = GetBlockStallingTimeout(state->vBlockLatencySamples);
     return true;
 }
 
+// Enough blocks to keep the peer busy for a round trip plus BLOCK_DOWNLOAD_QUEUE_TARGET at its measured throughput.
+int GetBlocksInTransitLimit(int64_t nDownloadRate, int64_t nMinPingUsec, int64_t nAvgBlockSize) {
+    if (nDownloadRate == 0 || nAvgBlockSize == 0)
+        return MAX_BLOCKS_IN_TRANSIT_PER_PEER;
+    if (nMinPingUsec == std::numeric_limits<int64_t>::max())
+        nMinPingUsec = 0;
+    int64_t nBlocks = nDownloadRate * (nMinPingUsec + BLOCK_DOWNLOAD_QUEUE_TARGET) / 1000000 / nAvgBlockSize;
+    return std::max<int64_t>(MIN_BLOCKS_IN_TRANSIT_PER_PEER, std::min<int64_t>(MAX_ADAPTIVE_BLOCKS_IN_TRANSIT_PER_PEER, nBlocks));
+}
+
+// The download window spans BLOCK_DOWNLOAD_WINDOW_BYTES of blocks of the recent average size, within bounds.
+unsigned int GetBlockDownloadWindow(int64_t nAvgBlockSize) {
+    if (nAvgBlockSize == 0)
+        return BLOCK_DOWNLOAD_WINDOW;
+    return std::max<uint64_t>(BLOCK_DOWNLOAD_WINDOW, std::min<uint64_t>(MAX_BLOCK_DOWNLOAD_WINDOW, BLOCK_DOWNLOAD_WINDOW_BYTES / nAvgBlockSize));
+}
+
+// Twice the fastest recent delivery of a requested block by the peer, within bounds. A saturated link of
+// our own shows up as higher latency from every peer, so it lengthens the timeout without one staller
+// raising it for everyone else. Taking the minimum and capping it at a few times BLOCK_STALLING_TIMEOUT
+// keeps a peer that delivers slowly on purpose from buying itself much more time.
+int64_t GetBlockStallingTimeout(const std::deque<int64_t>& vLatencySamples) {
+    if (vLatencySamples.empty())
+        return BLOCK_STALLING_TIMEOUT * 1000000;
+    int64_t nMinLatency = *std::min_element(vLatencySamples.begin(), vLatencySamples.end());
+    return std::max<int64_t>(BLOCK_STALLING_TIMEOUT * 1000000, std::min<int64_t>(BLOCK_STALLING_TIMEOUT_MAX * 1000000, nMinLatency * 2));
+}
+
 void RegisterNodeSignals(CNodeSignals& nodeSignals)
 {
     nodeSignals.ProcessMessages.connect(&ProcessMessages);
@@ -620,7 +772,7 @@ bool AddOrphanTx(const CTransactionRef& tx, NodeId peer) EXCLUSIVE_LOCKS_REQUIRE
     // have been mined or received.
     // 100 orphans, each of which is at most 99,999 bytes big is
     // at most 10 megabytes of orphans and somewhat more byprev index (in the worst case):
-    unsigned int sz = GetTransactionWeight(*tx);
+    unsigned int sz = tx->GetWeight();
     if (sz >= MAX_STANDARD_TX_WEIGHT)
     {
         LogPrint("mempool", "ignoring large orphan tx (size: %u, hash: %s)\n", sz, hash.ToString());
@@ -751,6 +903,186 @@ void RequestHeadersFrom(CNode* pto, CConnman& connman, const CBlockIndex* pindex
 
 }
 
+// Requires cs_main.
+// Adds segments anchored at the checkpoints above our best header, lowest first.
+void UpdateHeadersSegments(const CChainParams& chainparams)
+{
+    if (!fCheckpointsEnabled || fImporting || fReindex || pindexBestHeader->GetBlockTime() > GetAdjustedTime() - 24 * 60 * 60)
+        return;
+
+    const MapCheckpoints& checkpoints = chainparams.Checkpoints().mapCheckpoints;
+    for (MapCheckpoints::const_iterator it = checkpoints.begin(); it != checkpoints.end() && mapHeadersSegments.size() < MAX_HEADERS_SEGMENTS; ++it) {
+        // Leave what the sync peer will reach soon to the sync peer
+        if (it->first <= pindexBestHeader->nHeight + (int)MAX_HEADERS_RESULTS)
+            continue;
+        if (mapHeadersSegments.count(it->first) || mapBlockIndex.count(it->second))
+            continue;
+
+        HeadersSegment& segment = mapHeadersSegments[it->first];
+        segment.hashAnchor = it->second;
+        segment.nAnchorHeight = it->first;
+        segment.nStopHeight = it->first + MAX_HEADERS_SEGMENT_SIZE;
+        MapCheckpoints::const_iterator itNext = std::next(it);
+        if (itNext != checkpoints.end() && itNext->first <= segment.nStopHeight) {
+            segment.hashStop = itNext->second;
+            segment.nStopHeight = itNext->first;
+        }
+        segment.nodeFetching = -1;
+        segment.nRequestTime = 0;
+        segment.nHeaders = 0;
+        segment.fComplete = false;
+        LogPrint("net", "added headers segment %d-%d\n", segment.nAnchorHeight, segment.nStopHeight);
+    }
+}
+
+// Requires cs_main.
+void RequestHeadersSegment(CNode* pto, CConnman& connman, HeadersSegment& segment)
+{
+    const CNetMsgMaker msgMaker(pto->GetSendVersion());
+    connman.PushMessage(pto, msgMaker.Make(NetMsgType::GETHEADERS, CBlockLocator(std::vector<uint256>(1, segment.GetTipHash())), segment.hashStop));
+    pto->nPendingHeaderRequests += 1;
+    segment.nodeFetching = pto->GetId();
+    segment.nRequestTime = GetTime();
+    LogPrint("net", "getheaders segment (%d) to peer=%d\n", segment.nAnchorHeight + segment.nHeaders, pto->id);
+}
+
+// Requires cs_main.
+// Hands an unassigned segment to a peer that is idle for headers and has announced enough of the chain.
+void AssignHeadersSegment(CNode* pto, CConnman& connman, CNodeState& state)
+{
+    if (state.fSyncStarted || state.fHeadersSegmentStalled || pto->fClient || pto->nPendingHeaderRequests > 0)
+        return;
+
+    for (auto& entry : mapHeadersSegments) {
+        HeadersSegment& segment = entry.second;
+        if (segment.nodeFetching == pto->GetId())
+            return;
+    }
+    for (auto& entry : mapHeadersSegments) {
+        HeadersSegment& segment = entry.second;
+        if (segment.fComplete || segment.nodeFetching != -1 || pto->nStartingHeight <= segment.nAnchorHeight + segment.nHeaders)
+            continue;
+        RequestHeadersSegment(pto, connman, segment);
+        return;
+    }
+}
+
+// Requires cs_main.
+void ReleaseHeadersSegment(NodeId nodeid)
+{
+    for (auto& entry : mapHeadersSegments) {
+        if (entry.second.nodeFetching == nodeid)
+            entry.second.nodeFetching = -1;
+    }
+}
+
+/**
+ * Connect the segments whose anchor has become known, in order of height.
+ * Returns the last header connected, or NULL if none was.
+ */
+const CBlockIndex* LinkHeadersSegments(const CChainParams& chainparams)
+{
+    std::vector<HeadersSegment> vToLink;
+    {
+        LOCK(cs_main);
+        for (auto it = mapHeadersSegments.begin(); it != mapHeadersSegments.end(); ) {
+            if (!mapBlockIndex.count(it->second.hashAnchor)) {
+                ++it;
+                continue;
+            }
+            if (!it->second.vBatches.empty())
+                vToLink.push_back(std::move(it->second));
+            it = mapHeadersSegments.erase(it);
+        }
+    }
+
+    const CBlockIndex* pindexLinked = NULL;
+    for (const HeadersSegment& segment : vToLink) {
+        // Proof of work was checked on arrival; connect one message worth at a time to keep cs_main hold times short
+        for (const auto& batch : segment.vBatches) {
+            const CBlockIndex* pindexLast = NULL;
+            CValidationState state;
+            if (!ProcessNewBlockHeaders(batch.second, state, chainparams, &pindexLast, false)) {
+                int nDoS;
+                if (state.IsInvalid(nDoS) && nDoS > 0) {
+                    LOCK(cs_main);
+                    Misbehaving(batch.first, nDoS);
+                }
+                LogPrint("net", "failed to connect headers segment %d from peer=%d\n", segment.nAnchorHeight, batch.first);
+                break;
+            }
+            if (!pindexLinked || pindexLast->nChainWork > pindexLinked->nChainWork)
+                pindexLinked = pindexLast;
+        }
+        if (pindexLinked)
+            LogPrint("net", "connected headers segment %d-%d\n", segment.nAnchorHeight, pindexLinked->nHeight);
+    }
+    return pindexLinked;
+}
+
+/**
+ * Handle a headers message answering a segment request. Returns false if the
+ * message is not for a segment and should be processed as usual.
+ */
+bool ProcessHeadersSegment(CNode* pfrom, CConnman& connman, const std::vector<CBlockHeader>& headers, const CChainParams& chainparams)
+{
+    int nAnchorHeight;
+    {
+        LOCK(cs_main);
+        std::map<int, HeadersSegment>::iterator it = mapHeadersSegments.begin();
+        while (it != mapHeadersSegments.end() && (it->second.nodeFetching != pfrom->GetId() || it->second.GetTipHash() != headers[0].hashPrevBlock))
+            ++it;
+        if (it == mapHeadersSegments.end())
+            return false;
+        nAnchorHeight = it->first;
+    }
+
+    uint256 hashLastBlock;
+    for (const CBlockHeader& header : headers) {
+        if (!hashLastBlock.IsNull() && header.hashPrevBlock != hashLastBlock) {
+            LOCK(cs_main);
+            Misbehaving(pfrom->GetId(), 20);
+            ReleaseHeadersSegment(pfrom->GetId());
+            return error("non-continuous headers sequence");
+        }
+        hashLastBlock = header.GetHash();
+    }
+
+    // The expensive part, checking proof of work, runs without cs_main and in parallel
+    CValidationState state;
+    if (!CheckBlockHeaders(headers, state)) {
+        LOCK(cs_main);
+        int nDoS;
+        if (state.IsInvalid(nDoS) && nDoS > 0)
+            Misbehaving(pfrom->GetId(), nDoS);
+        ReleaseHeadersSegment(pfrom->GetId());
+        return error("invalid header received");
+    }
+
+    {
+        LOCK(cs_main);
+        std::map<int, HeadersSegment>::iterator it = mapHeadersSegments.find(nAnchorHeight);
+        if (it == mapHeadersSegments.end() || it->second.nodeFetching != pfrom->GetId())
+            return true;
+        HeadersSegment& segment = it->second;
+
+        std::vector<CBlockHeader> vBatch(headers.begin(), headers.begin() + std::min<size_t>(headers.size(), segment.nStopHeight - segment.nAnchorHeight - segment.nHeaders));
+        segment.nHeaders += vBatch.size();
+        segment.vBatches.emplace_back(pfrom->GetId(), std::move(vBatch));
+        UpdateBlockAvailability(pfrom->GetId(), segment.GetTipHash());
+
+        if (segment.GetTipHash() == segment.hashStop || segment.nAnchorHeight + segment.nHeaders >= segment.nStopHeight || headers.size() < MAX_HEADERS_RESULTS) {
+            segment.fComplete = true;
+            segment.nodeFetching = -1;
+        } else {
+            RequestHeadersSegment(pfrom, connman, segment);
+        }
+    }
+
+    LinkHeadersSegments(chainparams);
+    return true;
+}
+
 
 
 
@@ -944,11 +1276,7 @@ bool static AlreadyHave(const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 
 static void RelayTransaction(const CTransaction& tx, CConnman& connman)
 {
-    CInv inv(MSG_TX, tx.GetHash());
-    connman.ForEachNode([&inv](CNode* pnode)
-    {
-        pnode->PushInventory(inv);
-    });
+    connman.RelayTransaction(tx);
 }
 
 static void RelayAddress(const CAddress& addr, bool fReachable, CConnman& connman)
@@ -987,13 +1315,44 @@ static void RelayAddress(const CAddress& addr, bool fReachable, CConnman& connma
     connman.ForEachNodeThen(std::move(sortfunc), std::move(pushfunc));
 }
 
-void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParams, CConnman& connman, const std::atomic<bool>& interruptMsgProc)
+static bool IsBlockInv(const CInv& inv)
+{
+    return inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK || inv.type == MSG_CMPCT_BLOCK || inv.type == MSG_WITNESS_BLOCK;
+}
+
+/** Queue disk reads for the next main chain blocks a peer asked for. Requires cs_main. */
+static void QueueBlockReads(CNode* pfrom, const Consensus::Params& consensusParams, CConnman& connman)
+{
+    // Blocks that will not be served because of the upload target are not worth reading
+    if (connman.OutboundTargetReached(true) && !pfrom->fWhitelisted)
+        return;
+
+    unsigned int nBlockInvs = 0;
+    BOOST_FOREACH(const CInv& inv, pfrom->vRecvGetData) {
+        if (!IsBlockInv(inv))
+            continue;
+        if (nBlockInvs++ >= MAX_BLOCK_READ_AHEAD_PER_PEER)
+            break;
+        BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
+        if (mi == mapBlockIndex.end() || !(mi->second->nStatus & BLOCK_HAVE_DATA) || !chainActive.Contains(mi->second))
+            continue;
+        if (!blockReader->Request(pfrom->GetId(), inv.hash, mi->second->GetBlockPos(), consensusParams))
+            break;
+    }
+}
+
+/** Returns true if processing stopped to wait for a block being read from disk. */
+bool static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParams, CConnman& connman, const std::atomic<bool>& interruptMsgProc)
 {
     std::deque<CInv>::iterator it = pfrom->vRecvGetData.begin();
     std::vector<CInv> vNotFound;
     const CNetMsgMaker msgMaker(pfrom->GetSendVersion());
+    bool fWaitingForRead = false;
     LOCK(cs_main);
 
+    if (blockReader)
+        QueueBlockReads(pfrom, consensusParams, connman);
+
     while (it != pfrom->vRecvGetData.end()) {
         // Don't bother if send buffer is too full to respond anyway
         if (pfrom->fPauseSend)
@@ -1002,11 +1361,18 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
         const CInv &inv = *it;
         {
             if (interruptMsgProc)
-                return;
+                return false;
+
+            std::shared_ptr<const CBlock> pblockRead;
+            if (blockReader && IsBlockInv(inv) && blockReader->Take(pfrom->GetId(), inv.hash, pblockRead) == CBlockReader::PENDING) {
+                // Come back once the block is in memory; the reader wakes up the message handler
+                fWaitingForRead = true;
+                break;
+            }
 
             it++;
 
-            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK || inv.type == MSG_CMPCT_BLOCK || inv.type == MSG_WITNESS_BLOCK)
+            if (IsBlockInv(inv))
             {
                 bool send = false;
                 BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
@@ -1057,10 +1423,15 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
                 // it's available before trying to send.
                 if (send && (mi->second->nStatus & BLOCK_HAVE_DATA))
                 {
-                    // Send block from disk
-                    CBlock block;
-                    if (!ReadBlockFromDisk(block, (*mi).second, consensusParams, false))
-                        assert(!"cannot load block from disk");
+                    // Send block from disk, unless it has been read ahead already
+                    std::shared_ptr<const CBlock> pblock = pblockRead;
+                    if (!pblock) {
+                        std::shared_ptr<CBlock> pblockFromDisk = std::make_shared<CBlock>();
+                        if (!ReadBlockFromDisk(*pblockFromDisk, (*mi).second, consensusParams, false))
+                            assert(!"cannot load block from disk");
+                        pblock = pblockFromDisk;
+                    }
+                    const CBlock& block = *pblock;
                     if (inv.type == MSG_BLOCK)
                         connman.PushMessage(pfrom, msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::BLOCK, block));
                     else if (inv.type == MSG_WITNESS_BLOCK)
@@ -1145,7 +1516,7 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
             // Track requests for our stuff.
             GetMainSignals().Inventory(inv.hash);
 
-            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK || inv.type == MSG_CMPCT_BLOCK || inv.type == MSG_WITNESS_BLOCK)
+            if (IsBlockInv(inv))
                 break;
         }
     }
@@ -1162,6 +1533,31 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
         // having to download the entire memory pool.
         connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::NOTFOUND, vNotFound));
     }
+    return fWaitingForRead;
+}
+
+void StartBlockReader(CConnman& connman, int nThreads)
+{
+    if (nThreads <= 0)
+        return;
+    CConnman* pconnman = &connman;
+    blockReader.reset(new CBlockReader([pconnman] { pconnman->WakeMessageHandler(); }));
+    blockReader->Start(nThreads);
+}
+
+void StopBlockReader()
+{
+    // The reader itself stays around until the message handler is gone
+    if (blockReader)
+        blockReader->Stop();
+}
+
+bool GetBlockReaderStats(CBlockReaderStats& stats)
+{
+    if (!blockReader)
+        return false;
+    stats = blockReader->GetStats();
+    return true;
 }
 
 uint32_t GetFetchFlags(CNode* pfrom, const CBlockIndex* pprev, const Consensus::Params& chainparams) {
@@ -1811,6 +2207,15 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         CInv inv(MSG_TX, tx.GetHash());
         pfrom->AddInventoryKnown(inv);
 
+        // Check signatures before taking cs_main for acceptance
+        bool fAlreadyHave;
+        {
+            LOCK(cs_main);
+            fAlreadyHave = AlreadyHave(inv);
+        }
+        std::vector<CTxOut> vPreverifiedSpent;
+        bool fPreverified = !fAlreadyHave && PreverifyTransactionScripts(mempool, tx, vPreverifiedSpent);
+
         LOCK(cs_main);
 
         bool fMissingInputs = false;
@@ -1926,6 +2331,9 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
                 recentRejects->insert(tx.GetHash());
             }
         } else {
+            if (fPreverified && !mempool.exists(inv.hash))
+                UncacheTransactionScripts(tx, vPreverifiedSpent);
+
             if (!tx.HasWitness() && !state.CorruptionPossible()) {
                 // Do not use rejection cache for witness transactions or
                 // witness-stripped transactions, as they can have been malleated.
@@ -2063,7 +2471,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         // We want to be a bit conservative just to be extra careful about DoS
         // possibilities in compact block processing...
         if (pindex->nHeight <= chainActive.Height() + 2) {
-            if ((!fAlreadyInFlight && nodestate->nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) ||
+            if ((!fAlreadyInFlight && nodestate->nBlocksInFlight < nodestate->nBlocksInTransitLimit) ||
                  (fAlreadyInFlight && blockInFlightIt->second.first == pfrom->GetId())) {
                 std::list<QueuedBlock>::iterator* queuedBlockIt = NULL;
                 if (!MarkBlockAsInFlight(pfrom->GetId(), pindex->GetBlockHash(), chainparams.GetConsensus(pindex->nHeight), pindex, &queuedBlockIt)) {
@@ -2220,6 +2628,8 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
                 // though the block was successfully read, and rely on the
                 // handling in ProcessNewBlock to ensure the block index is
                 // updated, reject messages go out, etc.
+                // Count the reconstructed block at its full size, like the window and in-flight limits do
+                RecordBlockDownload(pfrom->GetId(), resp.blockhash, ::GetSerializeSize(*pblock, SER_NETWORK, PROTOCOL_VERSION));
                 MarkBlockAsReceived(resp.blockhash); // it is now an empty pointer
                 fBlockRead = true;
                 // mapBlockSource is only used for sending reject messages and DoS scores,
@@ -2263,9 +2673,14 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
 
         if (nCount == 0) {
             // Nothing interesting. Stop asking this peers for more headers.
+            LOCK(cs_main);
+            ReleaseHeadersSegment(pfrom->GetId());
             return true;
         }
 
+        if (ProcessHeadersSegment(pfrom, connman, headers, chainparams))
+            return true;
+
         const CBlockIndex *pindexLast = NULL;
         {
         LOCK(cs_main);
@@ -2321,6 +2736,9 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
             }
         }
 
+        // Connect any segments fetched ahead that these headers reached
+        const CBlockIndex *pindexLinked = LinkHeadersSegments(chainparams);
+
         {
         LOCK(cs_main);
         CNodeState *nodestate = State(pfrom->GetId());
@@ -2340,8 +2758,11 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
             // Dogecoin: do not allow multiple getheader queries in parallel at
             // this point - makes sure that any parallel queries will end here,
             // preventing "getheaders" spam.
-            LogPrint("net", "more getheaders (%d) to end to peer=%d (startheight:%d)\n", pindexLast->nHeight, pfrom->id, pfrom->nStartingHeight);
-            RequestHeadersFrom(pfrom, connman, pindexLast, uint256(), false);
+            const CBlockIndex *pindexContinue = pindexLast;
+            if (pindexLinked && pindexLinked->nHeight > pindexLast->nHeight && pindexLinked->GetAncestor(pindexLast->nHeight) == pindexLast)
+                pindexContinue = pindexLinked;
+            LogPrint("net", "more getheaders (%d) to end to peer=%d (startheight:%d)\n", pindexContinue->nHeight, pfrom->id, pfrom->nStartingHeight);
+            RequestHeadersFrom(pfrom, connman, pindexContinue, uint256(), false);
         }
 
         bool fCanDirectFetch = CanDirectFetch(chainparams.GetConsensus(0));
@@ -2351,7 +2772,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
             std::vector<const CBlockIndex*> vToFetch;
             const CBlockIndex *pindexWalk = pindexLast;
             // Calculate all the blocks we'd need to switch to pindexLast, up to a limit.
-            while (pindexWalk && !chainActive.Contains(pindexWalk) && vToFetch.size() <= MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+            while (pindexWalk && !chainActive.Contains(pindexWalk) && vToFetch.size() <= (size_t)nodestate->nBlocksInTransitLimit) {
                 if (!(pindexWalk->nStatus & BLOCK_HAVE_DATA) &&
                         !mapBlocksInFlight.count(pindexWalk->GetBlockHash()) &&
                         (!IsWitnessEnabled(pindexWalk->pprev, chainparams.GetConsensus(pindexWalk->pprev->nHeight)) || State(pfrom->GetId())->fHaveWitness)) {
@@ -2372,7 +2793,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
                 std::vector<CInv> vGetData;
                 // Download as much as possible, from earliest to latest.
                 BOOST_REVERSE_FOREACH(const CBlockIndex *pindex, vToFetch) {
-                    if (nodestate->nBlocksInFlight >= MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+                    if (nodestate->nBlocksInFlight >= nodestate->nBlocksInTransitLimit) {
                         // Can't download any more from this peer
                         break;
                     }
@@ -2401,6 +2822,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
     else if (strCommand == NetMsgType::BLOCK && !fImporting && !fReindex) // Ignore blocks received while importing
     {
         std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+        const uint64_t nBlockBytes = vRecv.size();
         vRecv >> *pblock;
 
         LogPrint("net", "received block %s peer=%d\n", pblock->GetHash().ToString(), pfrom->id);
@@ -2415,13 +2837,19 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
             LOCK(cs_main);
             // Also always process if we requested the block explicitly, as we may
             // need it even though it is not a candidate for a new best tip.
+            RecordBlockDownload(pfrom->GetId(), hash, nBlockBytes);
             forceProcessing |= MarkBlockAsReceived(hash);
             // mapBlockSource is only used for sending reject messages and DoS scores,
             // so the race between here and cs_main in ProcessNewBlock is fine.
             mapBlockSource.emplace(hash, std::make_pair(pfrom->GetId(), true));
         }
         bool fNewBlock = false;
+        int64_t nProcessStart = GetTimeMicros();
         ProcessNewBlock(chainparams, pblock, forceProcessing, &fNewBlock);
+        {
+            LOCK(cs_main);
+            blockDownloadStats.nProcessMicros += GetTimeMicros() - nProcessStart;
+        }
         if (fNewBlock)
             pfrom->nLastBlockTime = GetTime();
     }
@@ -2701,6 +3129,32 @@ static bool SendRejectsAndCheckIfBanned(CNode* pnode, CConnman& connman)
     return false;
 }
 
+static void RecordMsgProcessStats(CNode* pfrom, const std::string& strCommand, uint64_t nBytes, int64_t nProcessMicros, int64_t nLockWaitMicros)
+{
+    // Unknown commands are lumped together, so peers cannot grow these maps
+    static const std::set<std::string> setKnownCommands(getAllNetMessageTypes().begin(), getAllNetMessageTypes().end());
+    const std::string& strKey = setKnownCommands.count(strCommand) ? strCommand : NET_MESSAGE_COMMAND_OTHER;
+    {
+        LOCK(cs_msgProcessStats);
+        mapMsgProcessStats[strKey].Add(nBytes, nProcessMicros, nLockWaitMicros);
+    }
+    LOCK(pfrom->cs_processStats);
+    pfrom->mapProcessStatsPerMsgCmd[strKey].Add(nBytes, nProcessMicros, nLockWaitMicros);
+}
+
+void GetMsgProcessStats(mapMsgCmdProcessStats& stats)
+{
+    LOCK(cs_msgProcessStats);
+    stats = mapMsgProcessStats;
+}
+
+void GetBlockDownloadStats(CBlockDownloadStats& stats)
+{
+    LOCK(cs_main);
+    stats = blockDownloadStats;
+    stats.nDownloadWindow = GetBlockDownloadWindow(nAvgBlockSize);
+}
+
 bool ProcessMessages(CNode* pfrom, CConnman& connman, const std::atomic<bool>& interruptMsgProc)
 {
     const CChainParams& chainparams = Params();
@@ -2713,15 +3167,16 @@ bool ProcessMessages(CNode* pfrom, CConnman& connman, const std::atomic<bool>& i
     //  (x) data
     //
     bool fMoreWork = false;
+    bool fWaitingForRead = false;
 
     if (!pfrom->vRecvGetData.empty())
-        ProcessGetData(pfrom, chainparams.GetConsensus(chainActive.Height()), connman, interruptMsgProc);
+        fWaitingForRead = ProcessGetData(pfrom, chainparams.GetConsensus(chainActive.Height()), connman, interruptMsgProc);
 
     if (pfrom->fDisconnect)
         return false;
 
     // this maintains the order of responses
-    if (!pfrom->vRecvGetData.empty()) return true;
+    if (!pfrom->vRecvGetData.empty()) return !fWaitingForRead;
 
         // Don't bother if send buffer is too full to respond anyway
         if (pfrom->fPauseSend)
@@ -2774,6 +3229,8 @@ bool ProcessMessages(CNode* pfrom, CConnman& connman, const std::atomic<bool>& i
 
         // Process message
         bool fRet = false;
+        const int64_t nProcessStart = GetTimeMicros();
+        const int64_t nLockWaitStart = GetThreadLockWaitMicros();
         try
         {
             fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime, chainparams, connman, interruptMsgProc);
@@ -2811,6 +3268,8 @@ bool ProcessMessages(CNode* pfrom, CConnman& connman, const std::atomic<bool>& i
             PrintExceptionContinue(NULL, "ProcessMessages()");
         }
 
+        RecordMsgProcessStats(pfrom, strCommand, nMessageSize, GetTimeMicros() - nProcessStart, GetThreadLockWaitMicros() - nLockWaitStart);
+
         if (!fRet) {
             LogPrintf("%s(%s, %u bytes) FAILED peer=%d\n", __func__, SanitizeString(strCommand), nMessageSize, pfrom->id);
         }
@@ -2821,22 +3280,17 @@ bool ProcessMessages(CNode* pfrom, CConnman& connman, const std::atomic<bool>& i
     return fMoreWork;
 }
 
-class CompareInvMempoolOrder
+/** Score a batch of announced txids against the mempool, in relay order. */
+static std::vector<CTxRelayQueue::Entry> ScoreTxRelayBatch(const std::vector<uint256>& vHashes)
 {
-    CTxMemPool *mp;
-public:
-    CompareInvMempoolOrder(CTxMemPool *_mempool)
-    {
-        mp = _mempool;
-    }
-
-    bool operator()(std::set<uint256>::iterator a, std::set<uint256>::iterator b)
-    {
-        /* As std::make_heap produces a max-heap, we want the entries with the
-         * fewest ancestors/highest fee to sort later. */
-        return mp->CompareDepthAndScore(*b, *a);
+    // Topologically and fee-rate sort the inventory we send for privacy and priority reasons.
+    // This happens once per batch, rather than once per peer per trickle.
+    std::vector<CTxRelayQueue::Entry> vEntries;
+    for (const TxMempoolInfo& txinfo : mempool.infoSorted(vHashes)) {
+        vEntries.emplace_back(txinfo.tx, txinfo.feeRate);
     }
-};
+    return vEntries;
+}
 
 bool SendMessages(CNode* pto, CConnman& connman, const std::atomic<bool>& interruptMsgProc)
 {
@@ -2950,6 +3404,10 @@ bool SendMessages(CNode* pto, CConnman& connman, const std::atomic<bool>& interr
             }
         }
 
+        // Fetch further stretches of the header chain from other peers during initial sync
+        UpdateHeadersSegments(Params());
+        AssignHeadersSegment(pto, connman, state);
+
         // Resend wallet transactions that haven't gotten in a block yet
         // Except during reindex, importing and IBD, when old wallet
         // transactions become unconfirmed and spams other nodes.
@@ -3125,10 +3583,21 @@ bool SendMessages(CNode* pto, CConnman& connman, const std::atomic<bool>& interr
                 pto->nNextInvSend = PoissonNextSend(nNow, INVENTORY_BROADCAST_INTERVAL >> !pto->fInbound);
             }
 
+            CTxRelayQueue& txRelayQueue = connman.GetTxRelayQueue();
+            if (fSendTrickle && txRelayQueue.HasPending()) {
+                txRelayQueue.Seal(ScoreTxRelayBatch);
+                // Forget announcements every fully connected peer has already taken
+                uint64_t nMinCursor = txRelayQueue.GetNextSequence();
+                connman.ForEachNode([&nMinCursor](CNode* pnode) {
+                    nMinCursor = std::min<uint64_t>(nMinCursor, pnode->nTxRelayCursor);
+                });
+                txRelayQueue.Prune(nMinCursor);
+            }
+
             // Time to send but the peer has requested we not relay transactions.
             if (fSendTrickle) {
                 LOCK(pto->cs_filter);
-                if (!pto->fRelayTxes) pto->setInventoryTxToSend.clear();
+                if (!pto->fRelayTxes) pto->nTxRelayCursor = txRelayQueue.GetNextSequence();
             }
 
             // Respond to BIP35 mempool requests
@@ -3146,7 +3615,6 @@ bool SendMessages(CNode* pto, CConnman& connman, const std::atomic<bool>& interr
                 for (const auto& txinfo : vtxinfo) {
                     const uint256& hash = txinfo.tx->GetHash();
                     CInv inv(MSG_TX, hash);
-                    pto->setInventoryTxToSend.erase(hash);
                     if (filterrate) {
                         if (txinfo.feeRate.GetFeePerK() < filterrate)
                             continue;
@@ -3166,46 +3634,32 @@ bool SendMessages(CNode* pto, CConnman& connman, const std::atomic<bool>& interr
 
             // Determine transactions to relay
             if (fSendTrickle) {
-                // Produce a vector with all candidates for sending
-                std::vector<std::set<uint256>::iterator> vInvTx;
-                vInvTx.reserve(pto->setInventoryTxToSend.size());
-                for (std::set<uint256>::iterator it = pto->setInventoryTxToSend.begin(); it != pto->setInventoryTxToSend.end(); it++) {
-                    vInvTx.push_back(it);
-                }
                 CAmount filterrate = 0;
                 {
                     LOCK(pto->cs_feeFilter);
                     filterrate = pto->minFeeFilter;
                 }
-                // Topologically and fee-rate sort the inventory we send for privacy and priority reasons.
-                // A heap is used so that not all items need sorting if only a few are being sent.
-                CompareInvMempoolOrder compareInvMempoolOrder(&mempool);
-                std::make_heap(vInvTx.begin(), vInvTx.end(), compareInvMempoolOrder);
+                // The shared queue is already in relay order; walk it from this peer's cursor.
+                // Lock order: cs_inventory (held above) and cs_filter before the queue's lock.
                 // No reason to drain out at many times the network's capacity,
                 // especially since we have many peers and some will draw much shorter delays.
                 unsigned int nRelayedTransactions = 0;
                 LOCK(pto->cs_filter);
-                while (!vInvTx.empty() && nRelayedTransactions < INVENTORY_BROADCAST_MAX) {
-                    // Fetch the top element from the heap
-                    std::pop_heap(vInvTx.begin(), vInvTx.end(), compareInvMempoolOrder);
-                    std::set<uint256>::iterator it = vInvTx.back();
-                    vInvTx.pop_back();
-                    uint256 hash = *it;
-                    // Remove it from the to-be-sent set
-                    pto->setInventoryTxToSend.erase(it);
+                pto->nTxRelayCursor = txRelayQueue.ForEachFrom(pto->nTxRelayCursor, [&](const CTxRelayQueue::Entry& entry) {
+                    AssertLockHeld(pto->cs_inventory);
+                    const uint256& hash = entry.hash;
                     // Check if not in the filter already
                     if (pto->filterInventoryKnown.contains(hash)) {
-                        continue;
+                        return true;
                     }
                     // Not in the mempool anymore? don't bother sending it.
-                    auto txinfo = mempool.info(hash);
-                    if (!txinfo.tx) {
-                        continue;
+                    if (!mempool.exists(hash)) {
+                        return true;
                     }
-                    if (filterrate && txinfo.feeRate.GetFeePerK() < filterrate) {
-                        continue;
+                    if (filterrate && entry.feeRate.GetFeePerK() < filterrate) {
+                        return true;
                     }
-                    if (pto->pfilter && !pto->pfilter->IsRelevantAndUpdate(*txinfo.tx)) continue;
+                    if (pto->pfilter && !pto->pfilter->IsRelevantAndUpdate(*entry.tx)) return true;
                     // Send
                     vInv.push_back(CInv(MSG_TX, hash));
                     nRelayedTransactions++;
@@ -3217,7 +3671,7 @@ bool SendMessages(CNode* pto, CConnman& connman, const std::atomic<bool>& interr
                             vRelayExpiration.pop_front();
                         }
 
-                        auto ret = mapRelay.insert(std::make_pair(hash, std::move(txinfo.tx)));
+                        auto ret = mapRelay.insert(std::make_pair(hash, entry.tx));
                         if (ret.second) {
                             vRelayExpiration.push_back(std::make_pair(nNow + 15 * 60 * 1000000, ret.first));
                         }
@@ -3227,18 +3681,21 @@ bool SendMessages(CNode* pto, CConnman& connman, const std::atomic<bool>& interr
                         vInv.clear();
                     }
                     pto->filterInventoryKnown.insert(hash);
-                }
+                    return nRelayedTransactions < INVENTORY_BROADCAST_MAX;
+                });
             }
         }
         if (!vInv.empty())
             connman.PushMessage(pto, msgMaker.Make(NetMsgType::INV, vInv));
         // Detect whether we're stalling
         nNow = GetTimeMicros();
-        if (state.nStallingSince && state.nStallingSince < nNow - 1000000 * BLOCK_STALLING_TIMEOUT) {
+        const int64_t nStallingTimeout = GetBlockStallingTimeout(state.vBlockLatencySamples);
+        if (state.nStallingSince && state.nStallingSince < nNow - nStallingTimeout) {
             // Stalling only triggers when the block download window cannot move. During normal steady state,
             // the download window should be much larger than the to-be-downloaded set of blocks, so disconnection
             // should only happen during initial block download.
-            LogPrintf("Peer=%d is stalling block download, disconnecting\n", pto->id);
+            LogPrintf("Peer=%d is stalling block download, disconnecting (timeout %ds)\n", pto->id, nStallingTimeout / 1000000);
+            blockDownloadStats.nStallDisconnects++;
             pto->fDisconnect = true;
             return true;
         }
@@ -3293,14 +3750,24 @@ bool SendMessages(CNode* pto, CConnman& connman, const std::atomic<bool>& interr
                 state.nHeadersSyncTimeout = std::numeric_limits<int64_t>::max();
             }
         }
+        // Check for headers segment timeouts
+        for (auto& entry : mapHeadersSegments) {
+            HeadersSegment& segment = entry.second;
+            if (segment.nodeFetching == pto->GetId() && GetTime() > segment.nRequestTime + HEADERS_SEGMENT_TIMEOUT) {
+                LogPrint("net", "Timeout downloading headers segment %d from peer=%d\n", segment.nAnchorHeight, pto->id);
+                segment.nodeFetching = -1;
+                state.fHeadersSegmentStalled = true;
+            }
+        }
         //
         // Message: getdata (blocks)
         //
         std::vector<CInv> vGetData;
-        if (!pto->fClient && (fFetch || !IsInitialBlockDownload()) && state.nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+        state.nBlocksInTransitLimit = GetBlocksInTransitLimit(state.nDownloadRate, pto->nMinPingUsecTime, nAvgBlockSize);
+        if (!pto->fClient && (fFetch || !IsInitialBlockDownload()) && state.nBlocksInFlight < state.nBlocksInTransitLimit) {
             std::vector<const CBlockIndex*> vToDownload;
             NodeId staller = -1;
-            FindNextBlocksToDownload(pto->GetId(), MAX_BLOCKS_IN_TRANSIT_PER_PEER - state.nBlocksInFlight, vToDownload, staller, consensusParams);
+            FindNextBlocksToDownload(pto->GetId(), state.nBlocksInTransitLimit - state.nBlocksInFlight, vToDownload, staller, consensusParams);
             BOOST_FOREACH(const CBlockIndex *pindex, vToDownload) {
                 uint32_t nFetchFlags = GetFetchFlags(pto, pindex->pprev, consensusParams);
                 vGetData.push_back(CInv(MSG_BLOCK | nFetchFlags, pindex->GetBlockHash()));
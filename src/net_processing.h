@@ -6,9 +6,12 @@
 #ifndef BITCOIN_NET_PROCESSING_H
 #define BITCOIN_NET_PROCESSING_H
 
+#include "blockreader.h"
 #include "net.h"
 #include "validationinterface.h"
 
+#include <deque>
+
 /** Default for -maxorphantx, maximum number of orphan transactions kept in memory */
 static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS = 100;
 /** Expiration time for orphan transactions in seconds */
@@ -26,6 +29,17 @@ static constexpr int64_t HEADERS_DOWNLOAD_TIMEOUT_PER_HEADER = 1000; // 1ms/head
  * is set to 1 second.
  */
 static constexpr int64_t MIN_BLOCK_DOWNLOAD_MULTIPLIER = 10; // 10 seconds
+/** Default number of threads reading requested blocks from disk (-blockreadthreads), 0 reads on the message handler thread */
+static const int DEFAULT_BLOCK_READ_THREADS = 2;
+static const int MAX_BLOCK_READ_THREADS = 16;
+/** Number of blocks a peer asked for that are read from disk ahead of sending them */
+static const unsigned int MAX_BLOCK_READ_AHEAD_PER_PEER = 4;
+/** Maximum number of header segments fetched in parallel with the main headers sync during initial sync */
+static const unsigned int MAX_HEADERS_SEGMENTS = 3;
+/** Maximum number of headers buffered per segment until it can be connected to the header tree */
+static const int MAX_HEADERS_SEGMENT_SIZE = 10000;
+/** Time in seconds after which an unanswered segment request is handed to another peer */
+static const int64_t HEADERS_SEGMENT_TIMEOUT = 2 * 60;
 /** Register with a network node to receive its signals */
 void RegisterNodeSignals(CNodeSignals& nodeSignals);
 /** Unregister a network node */
@@ -49,10 +63,51 @@ struct CNodeStateStats {
     int nSyncHeight;
     int nCommonHeight;
     std::vector<int> vHeightInFlight;
+    int nBlocksInTransitLimit;
+    int64_t nDownloadRate;
+    int64_t nBlockLatency;
+    int64_t nStallingTimeout;
 };
 
+/** Block download progress, over all peers since startup */
+struct CBlockDownloadStats {
+    //! When the first requested block arrived (microseconds), or 0
+    int64_t nTimeFirstBlock;
+    uint64_t nBlocksReceived;
+    uint64_t nBytesReceived;
+    //! Rates over the last completed measurement interval
+    double dBlocksPerSec;
+    double dBytesPerSec;
+    //! Time spent processing received blocks, including validating and connecting them
+    int64_t nProcessMicros;
+    //! Time during which the download window could not move because of a stalling peer
+    int64_t nStallMicros;
+    uint64_t nStallDisconnects;
+    unsigned int nDownloadWindow;
+
+    CBlockDownloadStats() : nTimeFirstBlock(0), nBlocksReceived(0), nBytesReceived(0), dBlocksPerSec(0), dBytesPerSec(0),
+        nProcessMicros(0), nStallMicros(0), nStallDisconnects(0), nDownloadWindow(0) {}
+};
+
+/** Number of blocks to keep in flight from a peer delivering nDownloadRate bytes per second, with the given minimum ping (microseconds) */
+int GetBlocksInTransitLimit(int64_t nDownloadRate, int64_t nMinPingUsec, int64_t nAvgBlockSize);
+/** Number of blocks past the last common block that may be downloaded, given the average size of recent blocks */
+unsigned int GetBlockDownloadWindow(int64_t nAvgBlockSize);
+/** Time in microseconds a peer may hold up the download window, given its recent block latencies (microseconds) */
+int64_t GetBlockStallingTimeout(const std::deque<int64_t>& vLatencySamples);
+
 /** Get statistics from node state */
 bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats);
+/** Start the threads reading requested blocks from disk, if nThreads > 0 */
+void StartBlockReader(CConnman& connman, int nThreads);
+/** Stop the block read threads; must be called before the connection manager is destroyed */
+void StopBlockReader();
+/** Get disk read statistics of the block reader. Returns false if it is not running. */
+bool GetBlockReaderStats(CBlockReaderStats& stats);
+/** Get the message handler cost per message type, over all peers since startup */
+void GetMsgProcessStats(mapMsgCmdProcessStats& stats);
+/** Get block download progress and the current download window */
+void GetBlockDownloadStats(CBlockDownloadStats& stats);
 /** Increase a node's misbehavior score. */
 void Misbehaving(NodeId nodeid, int howmuch);
 
@@ -13,40 +13,38 @@
 #include "txmempool.h"
 #include "util.h"
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
 void TxConfirmStats::Initialize(std::vector<double>& defaultBuckets,
                                 unsigned int maxConfirms, double _decay)
 {
     decay = _decay;
+    decayScale = 1;
     for (unsigned int i = 0; i < defaultBuckets.size(); i++) {
         buckets.push_back(defaultBuckets[i]);
         bucketMap[defaultBuckets[i]] = i;
     }
     confAvg.resize(maxConfirms);
-    curBlockConf.resize(maxConfirms);
     unconfTxs.resize(maxConfirms);
     for (unsigned int i = 0; i < maxConfirms; i++) {
         confAvg[i].resize(buckets.size());
-        curBlockConf[i].resize(buckets.size());
         unconfTxs[i].resize(buckets.size());
     }
 
     oldUnconfTxs.resize(buckets.size());
-    curBlockTxCt.resize(buckets.size());
     txCtAvg.resize(buckets.size());
-    curBlockVal.resize(buckets.size());
     avg.resize(buckets.size());
 }
 
-// Zero out the data for the current block
+// Retire the mempool counts of the circular buffer slot the new block reuses
 void TxConfirmStats::ClearCurrent(unsigned int nBlockHeight)
 {
+    std::vector<int>& slot = unconfTxs[nBlockHeight%unconfTxs.size()];
     for (unsigned int j = 0; j < buckets.size(); j++) {
-        oldUnconfTxs[j] += unconfTxs[nBlockHeight%unconfTxs.size()][j];
-        unconfTxs[nBlockHeight%unconfTxs.size()][j] = 0;
-        for (unsigned int i = 0; i < curBlockConf.size(); i++)
-            curBlockConf[i][j] = 0;
-        curBlockTxCt[j] = 0;
-        curBlockVal[j] = 0;
+        oldUnconfTxs[j] += slot[j];
+        slot[j] = 0;
     }
 }
 
@@ -57,21 +55,28 @@ void TxConfirmStats::Record(int blocksToConfirm, double val)
     if (blocksToConfirm < 1)
         return;
     unsigned int bucketindex = bucketMap.lower_bound(val)->second;
-    for (size_t i = blocksToConfirm; i <= curBlockConf.size(); i++) {
-        curBlockConf[i - 1][bucketindex]++;
-    }
-    curBlockTxCt[bucketindex]++;
-    curBlockVal[bucketindex] += val;
+    if ((unsigned int)blocksToConfirm <= confAvg.size())
+        confAvg[blocksToConfirm - 1][bucketindex] += decayScale;
+    txCtAvg[bucketindex] += decayScale;
+    avg[bucketindex] += val * decayScale;
 }
 
 void TxConfirmStats::UpdateMovingAverages()
+{
+    decayScale /= decay;
+    if (decayScale > MAX_DECAY_SCALE)
+        Normalize();
+}
+
+void TxConfirmStats::Normalize()
 {
     for (unsigned int j = 0; j < buckets.size(); j++) {
         for (unsigned int i = 0; i < confAvg.size(); i++)
-            confAvg[i][j] = confAvg[i][j] * decay + curBlockConf[i][j];
-        avg[j] = avg[j] * decay + curBlockVal[j];
-        txCtAvg[j] = txCtAvg[j] * decay + curBlockTxCt[j];
+            confAvg[i][j] /= decayScale;
+        avg[j] /= decayScale;
+        txCtAvg[j] /= decayScale;
     }
+    decayScale = 1;
 }
 
 // returns -1 on error conditions
@@ -109,8 +114,9 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
     // Start counting from highest(default) or lowest feerate transactions
     for (int bucket = startbucket; bucket >= 0 && bucket <= maxbucketindex; bucket += step) {
         curFarBucket = bucket;
-        nConf += confAvg[confTarget - 1][bucket];
-        totalNum += txCtAvg[bucket];
+        for (int confct = 0; confct < confTarget; confct++)
+            nConf += confAvg[confct][bucket] / decayScale;
+        totalNum += txCtAvg[bucket] / decayScale;
         for (unsigned int confct = confTarget; confct < GetMaxConfirms(); confct++)
             extraNum += unconfTxs[(nBlockHeight - confct)%bins][bucket];
         extraNum += oldUnconfTxs[bucket];
@@ -173,16 +179,57 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
     return median;
 }
 
+// Moving averages are stored normalized, as a count of the non-empty buckets
+// followed by each of them as the number of empty buckets skipped and its value
+static void WriteSparse(CAutoFile& fileout, const std::vector<double>& v, double scale)
+{
+    unsigned int nNonEmpty = v.size() - std::count(v.begin(), v.end(), 0.0);
+    fileout << VARINT(nNonEmpty);
+    unsigned int nNext = 0;
+    for (unsigned int i = 0; i < v.size(); i++) {
+        if (v[i] == 0)
+            continue;
+        unsigned int nSkip = i - nNext;
+        fileout << VARINT(nSkip) << v[i] / scale;
+        nNext = i + 1;
+    }
+}
+
+static std::vector<double> ReadSparse(CAutoFile& filein, size_t nSize)
+{
+    std::vector<double> v(nSize);
+    unsigned int nNonEmpty;
+    filein >> VARINT(nNonEmpty);
+    if (nNonEmpty > nSize)
+        throw std::runtime_error("Corrupt estimates file. Too many non-empty buckets");
+    size_t nPos = 0;
+    for (unsigned int i = 0; i < nNonEmpty; i++) {
+        unsigned int nSkip;
+        filein >> VARINT(nSkip);
+        nPos += nSkip;
+        if (nPos >= nSize)
+            throw std::runtime_error("Corrupt estimates file. Bucket index out of range");
+        filein >> v[nPos];
+        if (!(v[nPos] >= 0))
+            throw std::runtime_error("Corrupt estimates file. Moving averages must not be negative");
+        nPos++;
+    }
+    return v;
+}
+
 void TxConfirmStats::Write(CAutoFile& fileout)
 {
     fileout << decay;
     fileout << buckets;
-    fileout << avg;
-    fileout << txCtAvg;
-    fileout << confAvg;
+    WriteSparse(fileout, avg, decayScale);
+    WriteSparse(fileout, txCtAvg, decayScale);
+    unsigned int maxConfirms = confAvg.size();
+    fileout << VARINT(maxConfirms);
+    for (unsigned int i = 0; i < maxConfirms; i++)
+        WriteSparse(fileout, confAvg[i], decayScale);
 }
 
-void TxConfirmStats::Read(CAutoFile& filein)
+void TxConfirmStats::Read(CAutoFile& filein, bool fLegacy)
 {
     // Read data file into temporary variables and do some very basic sanity checking
     std::vector<double> fileBuckets;
@@ -190,7 +237,7 @@ void TxConfirmStats::Read(CAutoFile& filein)
     std::vector<std::vector<double> > fileConfAvg;
     std::vector<double> fileTxCtAvg;
     double fileDecay;
-    size_t maxConfirms;
+    unsigned int maxConfirms;
     size_t numBuckets;
 
     filein >> fileDecay;
@@ -200,38 +247,48 @@ void TxConfirmStats::Read(CAutoFile& filein)
     numBuckets = fileBuckets.size();
     if (numBuckets <= 1 || numBuckets > 1000)
         throw std::runtime_error("Corrupt estimates file. Must have between 2 and 1000 feerate buckets");
-    filein >> fileAvg;
-    if (fileAvg.size() != numBuckets)
-        throw std::runtime_error("Corrupt estimates file. Mismatch in feerate average bucket count");
-    filein >> fileTxCtAvg;
-    if (fileTxCtAvg.size() != numBuckets)
-        throw std::runtime_error("Corrupt estimates file. Mismatch in tx count bucket count");
-    filein >> fileConfAvg;
-    maxConfirms = fileConfAvg.size();
+    if (fLegacy) {
+        filein >> fileAvg;
+        if (fileAvg.size() != numBuckets)
+            throw std::runtime_error("Corrupt estimates file. Mismatch in feerate average bucket count");
+        filein >> fileTxCtAvg;
+        if (fileTxCtAvg.size() != numBuckets)
+            throw std::runtime_error("Corrupt estimates file. Mismatch in tx count bucket count");
+        filein >> fileConfAvg;
+        maxConfirms = fileConfAvg.size();
+    } else {
+        fileAvg = ReadSparse(filein, numBuckets);
+        fileTxCtAvg = ReadSparse(filein, numBuckets);
+        filein >> VARINT(maxConfirms);
+    }
     if (maxConfirms <= 0 || maxConfirms > 6 * 24 * 7) // one week
         throw std::runtime_error("Corrupt estimates file.  Must maintain estimates for between 1 and 1008 (one week) confirms");
-    for (unsigned int i = 0; i < maxConfirms; i++) {
-        if (fileConfAvg[i].size() != numBuckets)
-            throw std::runtime_error("Corrupt estimates file. Mismatch in feerate conf average bucket count");
+    if (fLegacy) {
+        for (unsigned int i = 0; i < maxConfirms; i++) {
+            if (fileConfAvg[i].size() != numBuckets)
+                throw std::runtime_error("Corrupt estimates file. Mismatch in feerate conf average bucket count");
+        }
+        // Older files counted txs confirmed within Y blocks, turn that into a histogram
+        for (unsigned int i = maxConfirms - 1; i > 0; i--) {
+            for (unsigned int j = 0; j < numBuckets; j++)
+                fileConfAvg[i][j] = std::max(0.0, fileConfAvg[i][j] - fileConfAvg[i - 1][j]);
+        }
+    } else {
+        for (unsigned int i = 0; i < maxConfirms; i++)
+            fileConfAvg.push_back(ReadSparse(filein, numBuckets));
     }
     // Now that we've processed the entire feerate estimate data file and not
     // thrown any errors, we can copy it to our data structures
     decay = fileDecay;
+    decayScale = 1;
     buckets = fileBuckets;
     avg = fileAvg;
     confAvg = fileConfAvg;
     txCtAvg = fileTxCtAvg;
     bucketMap.clear();
 
-    // Resize the current block variables which aren't stored in the data file
+    // Resize the mempool counts which aren't stored in the data file
     // to match the number of confirms and buckets
-    curBlockConf.resize(maxConfirms);
-    for (unsigned int i = 0; i < maxConfirms; i++) {
-        curBlockConf[i].resize(buckets.size());
-    }
-    curBlockTxCt.resize(buckets.size());
-    curBlockVal.resize(buckets.size());
-
     unconfTxs.resize(maxConfirms);
     for (unsigned int i = 0; i < maxConfirms; i++) {
         unconfTxs[i].resize(buckets.size());
@@ -288,10 +345,12 @@ void TxConfirmStats::removeTx(unsigned int entryHeight, unsigned int nBestSeenHe
 // of no harm to try to remove them again.
 bool CBlockPolicyEstimator::removeTx(uint256 hash)
 {
+    LOCK(cs);
     std::map<uint256, TxStatsInfo>::iterator pos = mapMemPoolTxs.find(hash);
     if (pos != mapMemPoolTxs.end()) {
         feeStats.removeTx(pos->second.blockHeight, nBestSeenHeight, pos->second.bucketIndex);
-        mapMemPoolTxs.erase(hash);
+        mapMemPoolTxs.erase(pos);
+        ClearCache();
         return true;
     } else {
         return false;
@@ -309,10 +368,26 @@ CBlockPolicyEstimator::CBlockPolicyEstimator(const CFeeRate& _minRelayFee)
     }
     vfeelist.push_back(INF_FEERATE);
     feeStats.Initialize(vfeelist, MAX_BLOCK_CONFIRMS, DEFAULT_DECAY);
+    ClearCache();
+}
+
+void CBlockPolicyEstimator::ClearCache()
+{
+    vMedianCache.assign(feeStats.GetMaxConfirms() + 1, std::numeric_limits<double>::quiet_NaN());
+}
+
+double CBlockPolicyEstimator::EstimateMedianVal(int confTarget)
+{
+    AssertLockHeld(cs);
+    double& median = vMedianCache[confTarget];
+    if (std::isnan(median))
+        median = feeStats.EstimateMedianVal(confTarget, SUFFICIENT_FEETXS, MIN_SUCCESS_PCT, true, nBestSeenHeight);
+    return median;
 }
 
 void CBlockPolicyEstimator::processTransaction(const CTxMemPoolEntry& entry, bool validFeeEstimate)
 {
+    LOCK(cs);
     unsigned int txHeight = entry.GetHeight();
     uint256 hash = entry.GetTx().GetHash();
     if (mapMemPoolTxs.count(hash)) {
@@ -342,10 +417,12 @@ void CBlockPolicyEstimator::processTransaction(const CTxMemPoolEntry& entry, boo
 
     mapMemPoolTxs[hash].blockHeight = txHeight;
     mapMemPoolTxs[hash].bucketIndex = feeStats.NewTx(txHeight, (double)feeRate.GetFeePerK());
+    ClearCache();
 }
 
 bool CBlockPolicyEstimator::processBlockTx(unsigned int nBlockHeight, const CTxMemPoolEntry* entry)
 {
+    LOCK(cs);
     if (!removeTx(entry->GetTx().GetHash())) {
         // This transaction wasn't being tracked for fee estimation
         return false;
@@ -372,6 +449,7 @@ bool CBlockPolicyEstimator::processBlockTx(unsigned int nBlockHeight, const CTxM
 void CBlockPolicyEstimator::processBlock(unsigned int nBlockHeight,
                                          std::vector<const CTxMemPoolEntry*>& entries)
 {
+    LOCK(cs);
     if (nBlockHeight <= nBestSeenHeight) {
         // Ignore side chains and re-orgs; assuming they are random
         // they don't affect the estimate.
@@ -386,18 +464,18 @@ void CBlockPolicyEstimator::processBlock(unsigned int nBlockHeight,
     // of unconfirmed txs to remove from tracking.
     nBestSeenHeight = nBlockHeight;
 
-    // Clear the current block state and update unconfirmed circular buffer
+    // Update unconfirmed circular buffer
     feeStats.ClearCurrent(nBlockHeight);
 
+    // Decay all exponential averages before adding the current block to them
+    feeStats.UpdateMovingAverages();
+
     unsigned int countedTxs = 0;
-    // Repopulate the current block states
     for (unsigned int i = 0; i < entries.size(); i++) {
         if (processBlockTx(nBlockHeight, entries[i]))
             countedTxs++;
     }
-
-    // Update all exponential averages with the current block state
-    feeStats.UpdateMovingAverages();
+    ClearCache();
 
     LogPrint("estimatefee", "Blockpolicy after updating estimates for %u of %u txs in block, since last block %u of %u tracked, new mempool map size %u\n",
              countedTxs, entries.size(), trackedTxs, trackedTxs + untrackedTxs, mapMemPoolTxs.size());
@@ -408,12 +486,13 @@ void CBlockPolicyEstimator::processBlock(unsigned int nBlockHeight,
 
 CFeeRate CBlockPolicyEstimator::estimateFee(int confTarget)
 {
+    LOCK(cs);
     // Return failure if trying to analyze a target we're not tracking
     // It's not possible to get reasonable estimates for confTarget of 1
     if (confTarget <= 1 || (unsigned int)confTarget > feeStats.GetMaxConfirms())
         return CFeeRate(0);
 
-    double median = feeStats.EstimateMedianVal(confTarget, SUFFICIENT_FEETXS, MIN_SUCCESS_PCT, true, nBestSeenHeight);
+    double median = EstimateMedianVal(confTarget);
 
     if (median < 0)
         return CFeeRate(0);
@@ -423,6 +502,10 @@ CFeeRate CBlockPolicyEstimator::estimateFee(int confTarget)
 
 CFeeRate CBlockPolicyEstimator::estimateSmartFee(int confTarget, int *answerFoundAtTarget, const CTxMemPool& pool)
 {
+    // The mempool calls into the estimator with its lock held, so ask it for its limit before taking ours
+    CAmount minPoolFee = pool.GetMinFee(GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000).GetFeePerK();
+
+    LOCK(cs);
     if (answerFoundAtTarget)
         *answerFoundAtTarget = confTarget;
     // Return failure if trying to analyze a target we're not tracking
@@ -435,14 +518,13 @@ CFeeRate CBlockPolicyEstimator::estimateSmartFee(int confTarget, int *answerFoun
 
     double median = -1;
     while (median < 0 && (unsigned int)confTarget <= feeStats.GetMaxConfirms()) {
-        median = feeStats.EstimateMedianVal(confTarget++, SUFFICIENT_FEETXS, MIN_SUCCESS_PCT, true, nBestSeenHeight);
+        median = EstimateMedianVal(confTarget++);
     }
 
     if (answerFoundAtTarget)
         *answerFoundAtTarget = confTarget - 1;
 
     // If mempool is limiting txs , return at least the min feerate from the mempool
-    CAmount minPoolFee = pool.GetMinFee(GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000).GetFeePerK();
     if (minPoolFee > 0 && minPoolFee > median)
         return CFeeRate(minPoolFee);
 
@@ -472,20 +554,31 @@ double CBlockPolicyEstimator::estimateSmartPriority(int confTarget, int *answerF
 
 void CBlockPolicyEstimator::Write(CAutoFile& fileout)
 {
+    LOCK(cs);
+    fileout << FEE_ESTIMATES_FORMAT;
     fileout << nBestSeenHeight;
     feeStats.Write(fileout);
 }
 
 void CBlockPolicyEstimator::Read(CAutoFile& filein, int nFileVersion)
 {
+    LOCK(cs);
+    // Whatever version wrote the file, the dense layout starts with the best seen height
     int nFileBestSeenHeight;
     filein >> nFileBestSeenHeight;
-    feeStats.Read(filein);
+    bool fLegacy = nFileBestSeenHeight >= 0;
+    if (!fLegacy) {
+        if (nFileBestSeenHeight != FEE_ESTIMATES_FORMAT)
+            throw std::runtime_error("Unknown fee estimates file format");
+        filein >> nFileBestSeenHeight;
+    }
+    feeStats.Read(filein, fLegacy);
     nBestSeenHeight = nFileBestSeenHeight;
     if (nFileVersion < 139900) {
         TxConfirmStats priStats;
-        priStats.Read(filein);
+        priStats.Read(filein, true);
     }
+    ClearCache();
 }
 
 FeeFilterRounder::FeeFilterRounder(const CFeeRate& minIncrementalFee)
@@ -8,6 +8,7 @@
 #include "amount.h"
 #include "uint256.h"
 #include "random.h"
+#include "sync.h"
 
 #include <map>
 #include <string>
@@ -43,15 +44,17 @@ class CTxMemPool;
  * track the height of the block chain at entry.  Whenever a block comes in,
  * we count the number of transactions in each bucket and the total amount of feerate
  * paid in each bucket. Then we calculate how many blocks Y it took each
- * transaction to be mined and we track an array of counters in each bucket
- * for how long it to took transactions to get confirmed from 1 to a max of 25
- * and we increment all the counters from Y up to 25. This is because for any
- * number Z>=Y the transaction was successfully mined within Z blocks.  We
- * want to save a history of this information, so at any time we have a
- * counter of the total number of transactions that happened in a given feerate
- * bucket and the total number that were confirmed in each number 1-25 blocks
- * or less for any bucket.   We save this history by keeping an exponentially
- * decaying moving average of each one of these stats.  Furthermore we also
+ * transaction to be mined and we track a histogram in each bucket of how long
+ * it took transactions to get confirmed, from 1 to a max of 25 blocks.  Summing
+ * the histogram up to Z gives the number of transactions that were mined within
+ * Z blocks.  We want to save a history of this information, so at any time we
+ * have a counter of the total number of transactions that happened in a given
+ * feerate bucket and the number that were confirmed after each number 1-25 of
+ * blocks for any bucket.   We save this history by keeping an exponentially
+ * decaying moving average of each one of these stats.  The decay is applied
+ * lazily: instead of scaling every counter down on each block, new data points
+ * are scaled up by the inverse of the decay accumulated so far, so that a
+ * block costs the same no matter how many buckets are tracked.  Furthermore we also
  * keep track of the number unmined (in mempool) transactions in each bucket
  * and for how many blocks they have been outstanding and use that to increase
  * the number of transactions we've seen in that feerate bucket when calculating
@@ -74,29 +77,32 @@ private:
     std::vector<double> buckets;              // The upper-bound of the range for the bucket (inclusive)
     std::map<double, unsigned int> bucketMap; // Map of bucket upper-bound to index into all vectors by bucket
 
+    // All moving averages below are stored multiplied by decayScale, the
+    // inverse of the decay applied since they were last normalized. A data
+    // point recorded now is added as decayScale, and decaying all averages
+    // only means growing decayScale.
+
     // For each bucket X:
     // Count the total # of txs in each bucket
     // Track the historical moving average of this total over blocks
     std::vector<double> txCtAvg;
-    // and calculate the total for the current block to update the moving average
-    std::vector<int> curBlockTxCt;
 
-    // Count the total # of txs confirmed within Y blocks in each bucket
+    // Count the # of txs confirmed in exactly Y+1 blocks in each bucket
     // Track the historical moving average of theses totals over blocks
     std::vector<std::vector<double> > confAvg; // confAvg[Y][X]
-    // and calculate the totals for the current block to update the moving averages
-    std::vector<std::vector<int> > curBlockConf; // curBlockConf[Y][X]
 
     // Sum the total feerate of all tx's in each bucket
     // Track the historical moving average of this total over blocks
     std::vector<double> avg;
-    // and calculate the total for the current block to update the moving average
-    std::vector<double> curBlockVal;
 
     // Combine the conf counts with tx counts to calculate the confirmation % for each Y,X
     // Combine the total value with the tx counts to calculate the avg feerate per bucket
 
     double decay;
+    double decayScale;
+
+    /** Divide all moving averages by decayScale and reset it to 1 */
+    void Normalize();
 
     // Mempool counts of outstanding transactions
     // For each bucket X, track the number of transactions in the mempool
@@ -115,11 +121,11 @@ public:
      */
     void Initialize(std::vector<double>& defaultBuckets, unsigned int maxConfirms, double decay);
 
-    /** Clear the state of the curBlock variables to start counting for the new block */
+    /** Move the mempool counts of the block slot that is about to be reused to the old unconfirmed counts */
     void ClearCurrent(unsigned int nBlockHeight);
 
     /**
-     * Record a new transaction data point in the current block stats
+     * Record a new transaction data point in the moving averages
      * @param blocksToConfirm the number of blocks it took this transaction to confirm
      * @param val the feerate of the transaction
      * @warning blocksToConfirm is 1-based and has to be >= 1
@@ -133,8 +139,8 @@ public:
     void removeTx(unsigned int entryHeight, unsigned int nBestSeenHeight,
                   unsigned int bucketIndex);
 
-    /** Update our estimates by decaying our historical moving average and updating
-        with the data gathered from the current block */
+    /** Decay our historical moving averages by one block. Constant time except
+        for a renormalization every few thousand blocks. */
     void UpdateMovingAverages();
 
     /**
@@ -154,16 +160,35 @@ public:
     /** Return the max number of confirms we're tracking */
     unsigned int GetMaxConfirms() { return confAvg.size(); }
 
-    /** Write state of estimation data to a file*/
+    /** Write state of estimation data to a file, skipping empty buckets */
     void Write(CAutoFile& fileout);
 
     /**
      * Read saved state of estimation data from a file and replace all internal data structures and
      * variables with this state.
+     * @param fLegacy the data was written in the dense format of versions before FEE_ESTIMATES_FORMAT,
+     *        with cumulative confirmation counts
      */
-    void Read(CAutoFile& filein);
+    void Read(CAutoFile& filein, bool fLegacy = false);
 };
 
+/**
+ * Marker of the sparse fee estimates file layout, written before the
+ * estimator's best seen height. Files of the older dense layout start with
+ * that height instead, which is never negative.
+ */
+static const int FEE_ESTIMATES_FORMAT = -2;
+
+/**
+ * Client version required to read files with FEE_ESTIMATES_FORMAT. Released
+ * clients only skip files whose required version exceeds their own, so this
+ * is above every release that knows only the dense layout (up to 1.15.4).
+ */
+static const int FEE_ESTIMATES_FORMAT_CLIENT_VERSION = 1150500;
+
+/** Renormalize the lazily decayed moving averages once their scale exceeds this */
+static const double MAX_DECAY_SCALE = 1e12;
+
 
 
 /** Track confirm delays up to 25 blocks, can't estimate beyond that */
@@ -194,6 +219,9 @@ static const double FEE_SPACING = 1.1;
  *  We want to be able to estimate feerates that are needed on tx's to be included in
  * a certain number of blocks.  Every time a block is added to the best chain, this class records
  * stats on the transactions included in that block
+ *
+ * The estimator has its own lock, so estimates can be queried without holding
+ * mempool.cs.  Answers are cached per target until the tracked data changes.
  */
 class CBlockPolicyEstimator
 {
@@ -244,6 +272,11 @@ public:
     void Read(CAutoFile& filein, int nFileVersion);
 
 private:
+    /** Median feerate for confTarget, cached until the next change. Requires cs. */
+    double EstimateMedianVal(int confTarget);
+
+    mutable CCriticalSection cs;
+
     CFeeRate minTrackedFee;    //!< Passed to constructor to avoid dependency on main
     unsigned int nBestSeenHeight;
     struct TxStatsInfo
@@ -261,6 +294,10 @@ private:
 
     unsigned int trackedTxs;
     unsigned int untrackedTxs;
+
+    //! Result of EstimateMedianVal by target, NaN if not computed since the last change
+    std::vector<double> vMedianCache;
+    void ClearCache();
 };
 
 class FeeFilterRounder
@@ -67,7 +67,7 @@ bool IsStandardTx(const CTransaction& tx, std::string& reason, const bool witnes
     // almost as much to process as they cost the sender in fees, because
     // computing signature hashes is O(ninputs*txsize). Limiting transactions
     // to MAX_STANDARD_TX_WEIGHT mitigates CPU exhaustion attacks.
-    unsigned int sz = GetTransactionWeight(tx);
+    unsigned int sz = tx.GetWeight();
     if (sz >= MAX_STANDARD_TX_WEIGHT) {
         reason = "tx-size";
         return false;
@@ -218,5 +218,5 @@ int64_t GetVirtualTransactionSize(int64_t nWeight, int64_t nSigOpCost)
 
 int64_t GetVirtualTransactionSize(const CTransaction& tx, int64_t nSigOpCost)
 {
-    return GetVirtualTransactionSize(GetTransactionWeight(tx), nSigOpCost);
+    return GetVirtualTransactionSize(tx.GetWeight(), nSigOpCost);
 }
@@ -67,28 +67,41 @@ uint256 CTransaction::ComputeHash() const
     return SerializeHash(*this, SER_GETHASH, SERIALIZE_TRANSACTION_NO_WITNESS);
 }
 
-uint256 CTransaction::GetWitnessHash() const
+uint256 CTransaction::ComputeWitnessHash() const
 {
     if (!HasWitness()) {
-        return GetHash();
+        return hash;
     }
     return SerializeHash(*this, SER_GETHASH, 0);
 }
 
 /* For backward compatibility, the hash is initialized to 0. TODO: remove the need for this default constructor entirely. */
-CTransaction::CTransaction() : nVersion(CTransaction::CURRENT_VERSION), vin(), vout(), nLockTime(0), hash() {}
-CTransaction::CTransaction(const CMutableTransaction &tx) : nVersion(tx.nVersion), vin(tx.vin), vout(tx.vout), nLockTime(tx.nLockTime), hash(ComputeHash()) {}
-CTransaction::CTransaction(CMutableTransaction &&tx) : nVersion(tx.nVersion), vin(std::move(tx.vin)), vout(std::move(tx.vout)), nLockTime(tx.nLockTime), hash(ComputeHash()) {}
+CTransaction::CTransaction() : nVersion(CTransaction::CURRENT_VERSION), vin(), vout(), nLockTime(0), hash(), hashWitness(),
+    nTotalSizeCached(-1), nBaseSizeCached(-1), nLegacySigOpsCached(-1), nP2SHSigOpsCached(-1), nValueOutCached(-1) {}
+CTransaction::CTransaction(const CMutableTransaction &tx) : nVersion(tx.nVersion), vin(tx.vin), vout(tx.vout), nLockTime(tx.nLockTime), hash(ComputeHash()), hashWitness(ComputeWitnessHash()),
+    nTotalSizeCached(-1), nBaseSizeCached(-1), nLegacySigOpsCached(-1), nP2SHSigOpsCached(-1), nValueOutCached(-1) {}
+CTransaction::CTransaction(CMutableTransaction &&tx) : nVersion(tx.nVersion), vin(std::move(tx.vin)), vout(std::move(tx.vout)), nLockTime(tx.nLockTime), hash(ComputeHash()), hashWitness(ComputeWitnessHash()),
+    nTotalSizeCached(-1), nBaseSizeCached(-1), nLegacySigOpsCached(-1), nP2SHSigOpsCached(-1), nValueOutCached(-1) {}
+CTransaction::CTransaction(const CTransaction &tx) : nVersion(tx.nVersion), vin(tx.vin), vout(tx.vout), nLockTime(tx.nLockTime), hash(tx.hash), hashWitness(tx.hashWitness),
+    nTotalSizeCached(tx.nTotalSizeCached.load(std::memory_order_relaxed)),
+    nBaseSizeCached(tx.nBaseSizeCached.load(std::memory_order_relaxed)),
+    nLegacySigOpsCached(tx.nLegacySigOpsCached.load(std::memory_order_relaxed)),
+    nP2SHSigOpsCached(tx.nP2SHSigOpsCached.load(std::memory_order_relaxed)),
+    nValueOutCached(tx.nValueOutCached.load(std::memory_order_relaxed)) {}
 
 CAmount CTransaction::GetValueOut() const
 {
-    CAmount nValueOut = 0;
+    CAmount nValueOut = nValueOutCached.load(std::memory_order_relaxed);
+    if (nValueOut >= 0)
+        return nValueOut;
+    nValueOut = 0;
     for (std::vector<CTxOut>::const_iterator it(vout.begin()); it != vout.end(); ++it)
     {
         nValueOut += it->nValue;
         if (!MoneyRange(it->nValue) || !MoneyRange(nValueOut))
             throw std::runtime_error(std::string(__func__) + ": value out of range");
     }
+    nValueOutCached.store(nValueOut, std::memory_order_relaxed);
     return nValueOut;
 }
 
@@ -108,7 +121,7 @@ unsigned int CTransaction::CalculateModifiedSize(unsigned int nTxSize) const
     // Providing any more cleanup incentive than making additional inputs free would
     // risk encouraging people to create junk outputs to redeem later.
     if (nTxSize == 0)
-        nTxSize = (GetTransactionWeight(*this) + WITNESS_SCALE_FACTOR - 1) / WITNESS_SCALE_FACTOR;
+        nTxSize = (GetWeight() + WITNESS_SCALE_FACTOR - 1) / WITNESS_SCALE_FACTOR;
     for (std::vector<CTxIn>::const_iterator it(vin.begin()); it != vin.end(); ++it)
     {
         unsigned int offset = 41U + std::min(110U, (unsigned int)it->scriptSig.size());
@@ -120,7 +133,55 @@ unsigned int CTransaction::CalculateModifiedSize(unsigned int nTxSize) const
 
 unsigned int CTransaction::GetTotalSize() const
 {
-    return ::GetSerializeSize(*this, SER_NETWORK, PROTOCOL_VERSION);
+    int64_t nSize = nTotalSizeCached.load(std::memory_order_relaxed);
+    if (nSize < 0) {
+        nSize = ::GetSerializeSize(*this, SER_NETWORK, PROTOCOL_VERSION);
+        nTotalSizeCached.store(nSize, std::memory_order_relaxed);
+    }
+    return nSize;
+}
+
+unsigned int CTransaction::GetBaseSize() const
+{
+    int64_t nSize = nBaseSizeCached.load(std::memory_order_relaxed);
+    if (nSize < 0) {
+        nSize = HasWitness() ? ::GetSerializeSize(*this, SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS) : GetTotalSize();
+        nBaseSizeCached.store(nSize, std::memory_order_relaxed);
+    }
+    return nSize;
+}
+
+int64_t CTransaction::GetWeight() const
+{
+    return (int64_t)GetBaseSize() * (WITNESS_SCALE_FACTOR - 1) + GetTotalSize();
+}
+
+unsigned int CTransaction::GetLegacySigOpCount() const
+{
+    int64_t nSigOps = nLegacySigOpsCached.load(std::memory_order_relaxed);
+    if (nSigOps < 0) {
+        nSigOps = 0;
+        for (const CTxIn& txin : vin)
+            nSigOps += txin.scriptSig.GetSigOpCount(false);
+        for (const CTxOut& txout : vout)
+            nSigOps += txout.scriptPubKey.GetSigOpCount(false);
+        nLegacySigOpsCached.store(nSigOps, std::memory_order_relaxed);
+    }
+    return nSigOps;
+}
+
+bool CTransaction::GetCachedP2SHSigOpCount(unsigned int& nSigOps) const
+{
+    int64_t nCached = nP2SHSigOpsCached.load(std::memory_order_relaxed);
+    if (nCached < 0)
+        return false;
+    nSigOps = nCached;
+    return true;
+}
+
+void CTransaction::SetCachedP2SHSigOpCount(unsigned int nSigOps) const
+{
+    nP2SHSigOpsCached.store(nSigOps, std::memory_order_relaxed);
 }
 
 std::string CTransaction::ToString() const
@@ -143,5 +204,5 @@ std::string CTransaction::ToString() const
 
 int64_t GetTransactionWeight(const CTransaction& tx)
 {
-    return ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS) * (WITNESS_SCALE_FACTOR -1) + ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+    return tx.GetWeight();
 }
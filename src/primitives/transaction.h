@@ -11,6 +11,8 @@
 #include "serialize.h"
 #include "uint256.h"
 
+#include <atomic>
+
 static const int SERIALIZE_TRANSACTION_NO_WITNESS = 0x40000000;
 
 static const int WITNESS_SCALE_FACTOR = 4;
@@ -300,8 +302,21 @@ public:
 private:
     /** Memory only. */
     const uint256 hash;
+    const uint256 hashWitness;
+
+    /**
+     * Memory only. Values derived from the fields above, computed on first
+     * use and -1 until then. Relaxed atomics suffice, as every thread
+     * computes the same value.
+     */
+    mutable std::atomic<int64_t> nTotalSizeCached;
+    mutable std::atomic<int64_t> nBaseSizeCached;
+    mutable std::atomic<int64_t> nLegacySigOpsCached;
+    mutable std::atomic<int64_t> nP2SHSigOpsCached;
+    mutable std::atomic<int64_t> nValueOutCached;
 
     uint256 ComputeHash() const;
+    uint256 ComputeWitnessHash() const;
 
 public:
     /** Construct a CTransaction that qualifies as IsNull() */
@@ -311,6 +326,9 @@ public:
     CTransaction(const CMutableTransaction &tx);
     CTransaction(CMutableTransaction &&tx);
 
+    /** Copy, including the derived values computed so far */
+    CTransaction(const CTransaction &tx);
+
     template <typename Stream>
     inline void Serialize(Stream& s) const {
         SerializeTransaction(*this, s);
@@ -329,10 +347,12 @@ public:
         return hash;
     }
 
-    // Compute a hash that includes both transaction and witness data
-    uint256 GetWitnessHash() const;
+    // Hash that includes both transaction and witness data
+    const uint256& GetWitnessHash() const {
+        return hashWitness;
+    }
 
-    // Return sum of txouts.
+    // Return sum of txouts. Throws if a value or the sum is out of range.
     CAmount GetValueOut() const;
     // GetValueIn() is a method on CCoinsViewCache, because
     // inputs must be known to compute value in.
@@ -350,6 +370,23 @@ public:
      */
     unsigned int GetTotalSize() const;
 
+    /** Size without witness data */
+    unsigned int GetBaseSize() const;
+
+    /** Weight as defined by BIP 141 */
+    int64_t GetWeight() const;
+
+    /** Number of sigops in scriptSigs and scriptPubKeys, counted the legacy way */
+    unsigned int GetLegacySigOpCount() const;
+
+    /**
+     * Sigops in the redeem scripts of P2SH inputs, if GetP2SHSigOpCount has
+     * counted them before. The count only depends on the outputs spent,
+     * which are fixed by the prevouts, so it can be kept with the transaction.
+     */
+    bool GetCachedP2SHSigOpCount(unsigned int& nSigOps) const;
+    void SetCachedP2SHSigOpCount(unsigned int nSigOps) const;
+
     bool IsCoinBase() const
     {
         return (vin.size() == 1 && vin[0].prevout.IsNull());
@@ -14,6 +14,7 @@
 #include "policy/policy.h"
 #include "primitives/transaction.h"
 #include "rpc/server.h"
+#include "script/sigcache.h"
 #include "streams.h"
 #include "sync.h"
 #include "txmempool.h"
@@ -1362,6 +1363,37 @@ UniValue getmempoolinfo(const JSONRPCRequest& request)
     return mempoolInfoToJSON();
 }
 
+UniValue getsigcacheinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw runtime_error(
+            "getsigcacheinfo\n"
+            "\nReturns details on the signature cache, to help sizing -maxsigcachesize.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"size\": xxxxx,               (numeric) Number of cached signatures\n"
+            "  \"maxsize\": xxxxx,            (numeric) Number of signatures the cache can hold\n"
+            "  \"usage\": xxxxx,              (numeric) Memory usage of the cache in bytes\n"
+            "  \"hits\": xxxxx,               (numeric) Signature checks answered by the cache since startup\n"
+            "  \"misses\": xxxxx,             (numeric) Signature checks that had to be verified since startup\n"
+            "  \"loaded\": xxxxx              (numeric) Signatures restored from disk at startup\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getsigcacheinfo", "")
+            + HelpExampleRpc("getsigcacheinfo", "")
+        );
+
+    CSignatureCacheStats stats = GetSignatureCacheStats();
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("size", (uint64_t)stats.nEntries);
+    ret.pushKV("maxsize", (uint64_t)stats.nMaxEntries);
+    ret.pushKV("usage", (uint64_t)(stats.nMaxEntries * sizeof(uint256)));
+    ret.pushKV("hits", stats.nHits);
+    ret.pushKV("misses", stats.nMisses);
+    ret.pushKV("loaded", (uint64_t)stats.nLoaded);
+    return ret;
+}
+
 UniValue preciousblock(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 1)
@@ -1490,6 +1522,7 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getmempooldescendants",  &getmempooldescendants,  true,  {"txid","verbose"} },
     { "blockchain",         "getmempoolentry",        &getmempoolentry,        true,  {"txid"} },
     { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         true,  {} },
+    { "blockchain",         "getsigcacheinfo",        &getsigcacheinfo,        true,  {} },
     { "blockchain",         "getrawmempool",          &getrawmempool,          true,  {"verbose"} },
     { "blockchain",         "gettxout",               &gettxout,               true,  {"txid","n","include_mempool"} },
     { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true,  {} },
@@ -17,6 +17,7 @@
 #include "net.h"
 #include "pow.h"
 #include "rpc/server.h"
+#include "templateengine.h"
 #include "txmempool.h"
 #include "util.h"
 #include "utilstrencodings.h"
@@ -74,6 +75,29 @@ UniValue GetNetworkHashPS(int lookup, int height) {
     return workDiff.getdouble() / timeDiff;
 }
 
+/** Get a block template from the template engine if it is running, otherwise assemble one */
+static std::unique_ptr<CBlockTemplate> CreateBlockTemplate(const CScript& scriptPubKey, bool fMineWitnessTx)
+{
+    if (g_templateEngine && !fMineWitnessTx)
+        return g_templateEngine->GetTemplate(scriptPubKey);
+    return BlockAssembler(Params()).CreateNewBlock(scriptPubKey, fMineWitnessTx);
+}
+
+/** Sequence number of the template engine's current template, 0 without the engine */
+static uint64_t GetTemplateSequence()
+{
+    return g_templateEngine ? g_templateEngine->GetTemplateSequence() : 0;
+}
+
+/**
+ * Whether block is a coinbase-only template handed out right after a tip
+ * change, and the engine has had a new template since it was created.
+ */
+static bool IsEmptyTemplateOutdated(const CBlock& block, uint64_t nSequenceLast)
+{
+    return block.vtx.size() == 1 && GetTemplateSequence() != nSequenceLast;
+}
+
 UniValue getnetworkhashps(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() > 2)
@@ -568,11 +592,13 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
     static CBlockIndex* pindexPrev;
     static int64_t nStart;
     static std::unique_ptr<CBlockTemplate> pblocktemplate;
+    static uint64_t nTemplateSequenceLast;
     // Cache whether the last invocation was with segwit support, to avoid returning
     // a segwit-block to a non-segwit caller.
     static bool fLastTemplateSupportsSegwit = true;
     if (pindexPrev != chainActive.Tip() ||
         (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast && GetTime() - nStart > 5) ||
+        (pblocktemplate && IsEmptyTemplateOutdated(pblocktemplate->block, nTemplateSequenceLast)) ||
         fLastTemplateSupportsSegwit != fSupportsSegwit)
     {
         // Clear pindexPrev so future calls make a new block, despite any failures from here on
@@ -583,10 +609,11 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
         CBlockIndex* pindexPrevNew = chainActive.Tip();
         nStart = GetTime();
         fLastTemplateSupportsSegwit = fSupportsSegwit;
+        nTemplateSequenceLast = GetTemplateSequence();
 
         // Create new block
         CScript scriptDummy = CScript() << OP_TRUE;
-        pblocktemplate = BlockAssembler(Params()).CreateNewBlock(scriptDummy, fMineWitnessTx);
+        pblocktemplate = CreateBlockTemplate(scriptDummy, fMineWitnessTx);
         if (!pblocktemplate)
             throw JSONRPCError(RPC_OUT_OF_MEMORY, "Out of memory");
 
@@ -1018,6 +1045,7 @@ static UniValue AuxMiningCreateBlock(const CScript& scriptPubKey)
     static unsigned nTransactionsUpdatedLast;
     static const CBlockIndex* pindexPrev = nullptr;
     static uint64_t nStart;
+    static uint64_t nTemplateSequenceLast;
     static std::map<CScriptID, CBlock*> curBlocks;
     static unsigned nExtraNonce = 0;
 
@@ -1040,7 +1068,8 @@ static UniValue AuxMiningCreateBlock(const CScript& scriptPubKey)
         // Update block
         if (pblock == nullptr || pindexPrev != chainActive.Tip()
             || (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast
-                && GetTime() - nStart > 60))
+                && GetTime() - nStart > 60)
+            || IsEmptyTemplateOutdated(*pblock, nTemplateSequenceLast))
         {
             if (pindexPrev != chainActive.Tip())
             {
@@ -1052,8 +1081,9 @@ static UniValue AuxMiningCreateBlock(const CScript& scriptPubKey)
             }
 
             // Create new block with nonce = 0 and extraNonce = 1
+            const uint64_t nTemplateSequence = GetTemplateSequence();
             std::unique_ptr<CBlockTemplate> newBlock
-                = BlockAssembler(Params()).CreateNewBlock(scriptPubKey, fMineWitnessTx);
+                = CreateBlockTemplate(scriptPubKey, fMineWitnessTx);
             if (!newBlock)
                 throw JSONRPCError(RPC_OUT_OF_MEMORY, "out of memory");
 
@@ -1061,6 +1091,7 @@ static UniValue AuxMiningCreateBlock(const CScript& scriptPubKey)
             nTransactionsUpdatedLast = mempool.GetTransactionsUpdated();
             pindexPrev = chainActive.Tip();
             nStart = GetTime();
+            nTemplateSequenceLast = nTemplateSequence;
 
             // Finalise it by setting the version and building the merkle root
             IncrementExtraNonce(&newBlock->block, pindexPrev, nExtraNonce);
@@ -1185,6 +1216,7 @@ UniValue getauxblockbip22(const JSONRPCRequest& request)
         static unsigned nTransactionsUpdatedLast;
         static const CBlockIndex* pindexPrev = nullptr;
         static uint64_t nStart;
+        static uint64_t nTemplateSequenceLast;
         static CBlock* pblock = nullptr;
         static unsigned nExtraNonce = 0;
 
@@ -1195,7 +1227,8 @@ UniValue getauxblockbip22(const JSONRPCRequest& request)
             LOCK(cs_main);
             if (pindexPrev != chainActive.Tip()
                 || (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast
-                    && GetTime() - nStart > 60))
+                    && GetTime() - nStart > 60)
+                || (pblock && IsEmptyTemplateOutdated(*pblock, nTemplateSequenceLast)))
             {
                 if (pindexPrev != chainActive.Tip())
                 {
@@ -1206,7 +1239,8 @@ UniValue getauxblockbip22(const JSONRPCRequest& request)
                 }
 
                 // Create new block with nonce = 0 and extraNonce = 1
-                std::unique_ptr<CBlockTemplate> newBlock(BlockAssembler(Params()).CreateNewBlock(coinbaseScript->reserveScript, fMineWitnessTx));
+                const uint64_t nTemplateSequence = GetTemplateSequence();
+                std::unique_ptr<CBlockTemplate> newBlock(CreateBlockTemplate(coinbaseScript->reserveScript, fMineWitnessTx));
                 if (!newBlock)
                     throw JSONRPCError(RPC_OUT_OF_MEMORY, "out of memory");
 
@@ -1214,6 +1248,7 @@ UniValue getauxblockbip22(const JSONRPCRequest& request)
                 nTransactionsUpdatedLast = mempool.GetTransactionsUpdated();
                 pindexPrev = chainActive.Tip();
                 nStart = GetTime();
+                nTemplateSequenceLast = nTemplateSequence;
 
                 // Finalise it by setting the version and building the merkle root
                 IncrementExtraNonce(&newBlock->block, pindexPrev, nExtraNonce);
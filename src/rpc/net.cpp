@@ -348,6 +348,13 @@ UniValue getnettotals(const JSONRPCRequest& request)
             "    \"serve_historical_blocks\": true|false,  (boolean) True if serving historical blocks\n"
             "    \"bytes_left_in_cycle\": t,               (numeric) Bytes left in current time cycle\n"
             "    \"time_left_in_cycle\": t                 (numeric) Seconds left in current time cycle\n"
+            "  },\n"
+            "  \"blockreads\":             (only if blocks are read ahead of serving them, see -blockreadthreads)\n"
+            "  {\n"
+            "    \"blocks\": n,                            (numeric) Blocks read from disk\n"
+            "    \"bytes\": n,                             (numeric) Bytes read from disk\n"
+            "    \"time_us\": n,                           (numeric) Total time spent reading, in microseconds\n"
+            "    \"queued\": n                             (numeric) Reads queued or in progress\n"
             "  }\n"
             "}\n"
             "\nExamples:\n"
@@ -370,9 +377,97 @@ UniValue getnettotals(const JSONRPCRequest& request)
     outboundLimit.pushKV("bytes_left_in_cycle", g_connman->GetOutboundTargetBytesLeft());
     outboundLimit.pushKV("time_left_in_cycle", g_connman->GetMaxOutboundTimeLeftInCycle());
     obj.pushKV("uploadtarget", outboundLimit);
+
+    CBlockReaderStats readerStats;
+    if (GetBlockReaderStats(readerStats)) {
+        UniValue blockReads(UniValue::VOBJ);
+        blockReads.pushKV("blocks", readerStats.nBlocksRead);
+        blockReads.pushKV("bytes", readerStats.nBytesRead);
+        blockReads.pushKV("time_us", readerStats.nReadMicros);
+        blockReads.pushKV("queued", (uint64_t)readerStats.nQueued);
+        obj.pushKV("blockreads", blockReads);
+    }
     return obj;
 }
 
+static UniValue MsgProcessStatsToJSON(const mapMsgCmdProcessStats& mapStats)
+{
+    UniValue ret(UniValue::VOBJ);
+    BOOST_FOREACH(const mapMsgCmdProcessStats::value_type &i, mapStats) {
+        UniValue obj(UniValue::VOBJ);
+        obj.pushKV("count", i.second.nCount);
+        obj.pushKV("bytes", i.second.nBytes);
+        obj.pushKV("time_us", i.second.nProcessMicros);
+        obj.pushKV("lockwait_us", i.second.nLockWaitMicros);
+        obj.pushKV("maxtime_us", i.second.nMaxProcessMicros);
+        ret.pushKV(i.first, obj);
+    }
+    return ret;
+}
+
+UniValue getnetmsgstats(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 1)
+        throw runtime_error(
+            "getnetmsgstats ( peers )\n"
+            "\nReturns how much message handler time each received message type has used,\n"
+            "in total since startup and optionally per connected peer.\n"
+            "\nArguments:\n"
+            "1. peers     (boolean, optional, default=false) Also return statistics per connected peer\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"totals\": {                 (json object) Statistics over all peers since startup\n"
+            "    \"msg\": {                  (json object) Statistics for one message type (\"*other*\" for unknown ones)\n"
+            "      \"count\": n,             (numeric) Number of messages processed\n"
+            "      \"bytes\": n,             (numeric) Total payload size of these messages\n"
+            "      \"time_us\": n,           (numeric) Total processing time in microseconds\n"
+            "      \"lockwait_us\": n,       (numeric) Part of time_us spent waiting for contended locks such as cs_main\n"
+            "      \"maxtime_us\": n         (numeric) Longest time spent processing a single message\n"
+            "    },\n"
+            "    ...\n"
+            "  },\n"
+            "  \"peers\": [                  (json array, only if peers is true)\n"
+            "    {\n"
+            "      \"id\": n,                (numeric) Peer index\n"
+            "      \"msgs\": { ... }         (json object) Same as totals, for this peer\n"
+            "    },\n"
+            "    ...\n"
+            "  ]\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getnetmsgstats", "")
+            + HelpExampleCli("getnetmsgstats", "true")
+            + HelpExampleRpc("getnetmsgstats", "true")
+        );
+    if(!g_connman)
+        throw JSONRPCError(RPC_CLIENT_P2P_DISABLED, "Error: Peer-to-peer functionality missing or disabled");
+
+    bool fPeers = false;
+    if (request.params.size() > 0)
+        fPeers = request.params[0].get_bool();
+
+    mapMsgCmdProcessStats mapTotals;
+    GetMsgProcessStats(mapTotals);
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("totals", MsgProcessStatsToJSON(mapTotals));
+
+    if (fPeers) {
+        vector<CNodeStats> vstats;
+        g_connman->GetNodeStats(vstats);
+
+        UniValue peers(UniValue::VARR);
+        BOOST_FOREACH(const CNodeStats& stats, vstats) {
+            UniValue obj(UniValue::VOBJ);
+            obj.pushKV("id", stats.nodeid);
+            obj.pushKV("msgs", MsgProcessStatsToJSON(stats.mapProcessStatsPerMsgCmd));
+            peers.push_back(obj);
+        }
+        ret.pushKV("peers", peers);
+    }
+    return ret;
+}
+
 static UniValue GetNetworksInfo()
 {
     UniValue networks(UniValue::VARR);
@@ -394,6 +489,96 @@ static UniValue GetNetworksInfo()
     return networks;
 }
 
+UniValue getblockdownloadinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw runtime_error(
+            "getblockdownloadinfo\n"
+            "\nReturns block download progress, where the time goes and the per-peer download state.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"blocks\": n,                  (numeric) Height of the active chain\n"
+            "  \"headers\": n,                 (numeric) Height of the best known header\n"
+            "  \"initialblockdownload\": b,    (boolean) Whether the node is in initial block download\n"
+            "  \"window\": n,                  (numeric) Current block download window, in blocks\n"
+            "  \"received\": {\n"
+            "    \"blocks\": n,                (numeric) Requested blocks received since startup\n"
+            "    \"bytes\": n,                 (numeric) Size of these blocks\n"
+            "    \"elapsed\": n,               (numeric) Seconds since the first of these blocks arrived\n"
+            "    \"blocks_per_sec\": x.x,      (numeric) Blocks received per second over the last measurement interval\n"
+            "    \"bytes_per_sec\": x.x        (numeric) Bytes received per second over the last measurement interval\n"
+            "  },\n"
+            "  \"time\": {\n"
+            "    \"process_us\": n,            (numeric) Time spent processing received blocks, including validation\n"
+            "    \"stalled_us\": n,            (numeric) Time the download window was held up by stalling peers\n"
+            "    \"stall_disconnects\": n      (numeric) Number of peers disconnected for stalling\n"
+            "  },\n"
+            "  \"peers\": [\n"
+            "    {\n"
+            "      \"id\": n,                  (numeric) Peer index\n"
+            "      \"inflight\": n,            (numeric) Blocks in flight from this peer\n"
+            "      \"limit\": n,               (numeric) Maximum number of blocks in flight from this peer\n"
+            "      \"bytes_per_sec\": n,       (numeric) Measured download throughput of this peer\n"
+            "      \"latency_us\": n,          (numeric) Measured time from requesting a block to receiving it\n"
+            "      \"stalling_timeout\": n     (numeric) Seconds this peer may hold up the download window before being disconnected\n"
+            "    },\n"
+            "    ...\n"
+            "  ]\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getblockdownloadinfo", "")
+            + HelpExampleRpc("getblockdownloadinfo", "")
+        );
+    if(!g_connman)
+        throw JSONRPCError(RPC_CLIENT_P2P_DISABLED, "Error: Peer-to-peer functionality missing or disabled");
+
+    CBlockDownloadStats downloadStats;
+    GetBlockDownloadStats(downloadStats);
+
+    UniValue ret(UniValue::VOBJ);
+    {
+        LOCK(cs_main);
+        ret.pushKV("blocks", chainActive.Height());
+        ret.pushKV("headers", pindexBestHeader ? pindexBestHeader->nHeight : -1);
+    }
+    ret.pushKV("initialblockdownload", IsInitialBlockDownload());
+    ret.pushKV("window", (uint64_t)downloadStats.nDownloadWindow);
+
+    UniValue received(UniValue::VOBJ);
+    received.pushKV("blocks", downloadStats.nBlocksReceived);
+    received.pushKV("bytes", downloadStats.nBytesReceived);
+    received.pushKV("elapsed", downloadStats.nTimeFirstBlock ? (GetTimeMicros() - downloadStats.nTimeFirstBlock) / 1000000 : 0);
+    received.pushKV("blocks_per_sec", downloadStats.dBlocksPerSec);
+    received.pushKV("bytes_per_sec", downloadStats.dBytesPerSec);
+    ret.pushKV("received", received);
+
+    UniValue time(UniValue::VOBJ);
+    time.pushKV("process_us", downloadStats.nProcessMicros);
+    time.pushKV("stalled_us", downloadStats.nStallMicros);
+    time.pushKV("stall_disconnects", downloadStats.nStallDisconnects);
+    ret.pushKV("time", time);
+
+    vector<CNodeStats> vstats;
+    g_connman->GetNodeStats(vstats);
+
+    UniValue peers(UniValue::VARR);
+    BOOST_FOREACH(const CNodeStats& stats, vstats) {
+        CNodeStateStats statestats;
+        if (!GetNodeStateStats(stats.nodeid, statestats))
+            continue;
+        UniValue obj(UniValue::VOBJ);
+        obj.pushKV("id", stats.nodeid);
+        obj.pushKV("inflight", (uint64_t)statestats.vHeightInFlight.size());
+        obj.pushKV("limit", statestats.nBlocksInTransitLimit);
+        obj.pushKV("bytes_per_sec", statestats.nDownloadRate);
+        obj.pushKV("latency_us", statestats.nBlockLatency);
+        obj.pushKV("stalling_timeout", statestats.nStallingTimeout / 1000000);
+        peers.push_back(obj);
+    }
+    ret.pushKV("peers", peers);
+    return ret;
+}
+
 UniValue getnetworkinfo(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 0)
@@ -619,6 +804,8 @@ static const CRPCCommand commands[] =
     { "network",            "disconnectnode",         &disconnectnode,         true,  {"address"} },
     { "network",            "getaddednodeinfo",       &getaddednodeinfo,       true,  {"node"} },
     { "network",            "getnettotals",           &getnettotals,           true,  {} },
+    { "network",            "getnetmsgstats",         &getnetmsgstats,         true,  {"peers"} },
+    { "network",            "getblockdownloadinfo",   &getblockdownloadinfo,   true,  {} },
     { "network",            "getnetworkinfo",         &getnetworkinfo,         true,  {} },
     { "network",            "setban",                 &setban,                 true,  {"subnet", "command", "bantime", "absolute"} },
     { "network",            "listbanned",             &listbanned,             true,  {} },
@@ -63,7 +63,7 @@ void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry)
 {
     entry.pushKV("txid", tx.GetHash().GetHex());
     entry.pushKV("hash", tx.GetWitnessHash().GetHex());
-    entry.pushKV("size", (int)::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION));
+    entry.pushKV("size", (int)tx.GetTotalSize());
     entry.pushKV("vsize", (int)::GetVirtualTransactionSize(tx));
     entry.pushKV("version", tx.nVersion);
     entry.pushKV("locktime", (int64_t)tx.nLockTime);
@@ -882,7 +882,6 @@ UniValue sendrawtransaction(const JSONRPCRequest& request)
             + HelpExampleRpc("sendrawtransaction", "\"signedhex\"")
         );
 
-    LOCK(cs_main);
     RPCTypeCheck(request.params, boost::assign::list_of(UniValue::VSTR)(UniValue::VBOOL));
 
     // parse hex string from parameter
@@ -892,6 +891,11 @@ UniValue sendrawtransaction(const JSONRPCRequest& request)
     CTransactionRef tx(MakeTransactionRef(std::move(mtx)));
     const uint256& hashTx = tx->GetHash();
 
+    std::vector<CTxOut> vPreverifiedSpent;
+    bool fPreverified = PreverifyTransactionScripts(mempool, *tx, vPreverifiedSpent);
+
+    LOCK(cs_main);
+
     bool fLimitFree = false;
     CAmount nMaxRawTxFee = maxTxFee;
     if (request.params.size() > 1 && request.params[1].get_bool())
@@ -906,6 +910,8 @@ UniValue sendrawtransaction(const JSONRPCRequest& request)
         CValidationState state;
         bool fMissingInputs;
         if (!AcceptToMemoryPool(mempool, state, std::move(tx), fLimitFree, &fMissingInputs, NULL, false, nMaxRawTxFee)) {
+            if (fPreverified)
+                UncacheTransactionScripts(*tx, vPreverifiedSpent);
             if (state.IsInvalid()) {
                 throw JSONRPCError(RPC_TRANSACTION_REJECTED, strprintf("%i: %s", state.GetRejectCode(), state.GetRejectReason()));
             } else {
@@ -921,14 +927,103 @@ UniValue sendrawtransaction(const JSONRPCRequest& request)
     if(!g_connman)
         throw JSONRPCError(RPC_CLIENT_P2P_DISABLED, "Error: Peer-to-peer functionality missing or disabled");
 
-    CInv inv(MSG_TX, hashTx);
-    g_connman->ForEachNode([&inv](CNode* pnode)
-    {
-        pnode->PushInventory(inv);
-    });
+    g_connman->RelayTransaction(*tx);
     return hashTx.GetHex();
 }
 
+UniValue sendrawtransactions(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
+        throw runtime_error(
+            "sendrawtransactions [\"hexstring\",...] ( allowhighfees )\n"
+            "\nSubmits raw transactions (serialized, hex-encoded) to local node and network.\n"
+            "The scripts of all transactions are checked in parallel, and transactions spending\n"
+            "outputs of other transactions in the list are accepted after them.\n"
+            "\nArguments:\n"
+            "1. \"hexstrings\"   (array, required) The hex strings of the raw transactions\n"
+            "2. allowhighfees    (boolean, optional, default=false) Allow high fees\n"
+            "\nResult:\n"
+            "[                   (array) One object per transaction, in the order given\n"
+            "  {\n"
+            "    \"txid\" : \"hex\",  (string) The transaction hash in hex\n"
+            "    \"error\" : \"msg\"  (string, optional) Why the transaction was rejected, if it was\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("sendrawtransactions", "\"[\\\"signedhex\\\",\\\"signedhex\\\"]\"") +
+            "\nAs a json rpc call\n"
+            + HelpExampleRpc("sendrawtransactions", "[\"signedhex\",\"signedhex\"]")
+        );
+
+    RPCTypeCheck(request.params, boost::assign::list_of(UniValue::VARR)(UniValue::VBOOL));
+
+    // parse hex strings from parameter
+    const UniValue& hexstrings = request.params[0].get_array();
+    std::vector<CTransactionRef> vtx;
+    vtx.reserve(hexstrings.size());
+    for (unsigned int i = 0; i < hexstrings.size(); i++) {
+        CMutableTransaction mtx;
+        if (!hexstrings[i].isStr() || !DecodeHexTx(mtx, hexstrings[i].get_str()))
+            throw JSONRPCError(RPC_DESERIALIZATION_ERROR, strprintf("TX decode failed for transaction %u", i));
+        vtx.push_back(MakeTransactionRef(std::move(mtx)));
+    }
+
+    bool fLimitFree = false;
+    CAmount nMaxRawTxFee = maxTxFee;
+    if (request.params.size() > 1 && request.params[1].get_bool())
+        nMaxRawTxFee = 0;
+
+    // Transactions already in the mempool are relayed again, those in the chain are reported
+    std::vector<std::string> vError(vtx.size());
+    std::vector<size_t> vSubmit;
+    {
+        LOCK(cs_main);
+        CCoinsViewCache &view = *pcoinsTip;
+        for (size_t i = 0; i < vtx.size(); i++) {
+            const uint256& hashTx = vtx[i]->GetHash();
+            const CCoins* existingCoins = view.AccessCoins(hashTx);
+            if (existingCoins && existingCoins->nHeight < 1000000000)
+                vError[i] = "transaction already in block chain";
+            else if (!mempool.exists(hashTx))
+                vSubmit.push_back(i);
+        }
+    }
+
+    std::vector<CTransactionRef> vtxSubmit;
+    for (size_t i : vSubmit)
+        vtxSubmit.push_back(vtx[i]);
+    std::vector<CValidationState> vState;
+    std::vector<bool> vMissingInputs;
+    AcceptToMemoryPoolBatch(mempool, vtxSubmit, fLimitFree, vState, vMissingInputs, false, nMaxRawTxFee);
+    for (size_t j = 0; j < vSubmit.size(); j++) {
+        const CValidationState& state = vState[j];
+        if (state.IsValid())
+            continue;
+        if (state.IsInvalid())
+            vError[vSubmit[j]] = strprintf("%i: %s", state.GetRejectCode(), state.GetRejectReason());
+        else if (vMissingInputs[j])
+            vError[vSubmit[j]] = "Missing inputs";
+        else
+            vError[vSubmit[j]] = state.GetRejectReason();
+    }
+
+    if(!g_connman)
+        throw JSONRPCError(RPC_CLIENT_P2P_DISABLED, "Error: Peer-to-peer functionality missing or disabled");
+
+    UniValue result(UniValue::VARR);
+    for (size_t i = 0; i < vtx.size(); i++) {
+        UniValue entry(UniValue::VOBJ);
+        entry.pushKV("txid", vtx[i]->GetHash().GetHex());
+        if (vError[i].empty())
+            g_connman->RelayTransaction(*vtx[i]);
+        else
+            entry.pushKV("error", vError[i]);
+        result.push_back(entry);
+    }
+    return result;
+}
+
 static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         okSafeMode
   //  --------------------- ------------------------  -----------------------  ----------
@@ -937,6 +1032,7 @@ static const CRPCCommand commands[] =
     { "rawtransactions",    "decoderawtransaction",   &decoderawtransaction,   true,  {"hexstring"} },
     { "rawtransactions",    "decodescript",           &decodescript,           true,  {"hexstring"} },
     { "rawtransactions",    "sendrawtransaction",     &sendrawtransaction,     false, {"hexstring","allowhighfees"} },
+    { "rawtransactions",    "sendrawtransactions",    &sendrawtransactions,    false, {"hexstrings","allowhighfees"} },
     { "rawtransactions",    "signrawtransaction",     &signrawtransaction,     false, {"hexstring","prevtxs","privkeys","sighashtype"} }, /* uses wallet if enabled */
 
     { "blockchain",         "gettxoutproof",          &gettxoutproof,          true,  {"txids", "blockhash"} },
@@ -11,6 +11,7 @@
 #include "crypto/sha256.h"
 #include "pubkey.h"
 #include "script/script.h"
+#include "streams.h"
 #include "uint256.h"
 
 using namespace std;
@@ -56,13 +57,115 @@ bool CastToBool(const valtype& vch)
  */
 #define stacktop(i)  (stack.at(stack.size()+(i)))
 #define altstacktop(i)  (altstack.at(altstack.size()+(i)))
+
+namespace {
+
+/** Maximum number of spare stack element buffers kept per thread */
+static const size_t MAX_ARENA_FREE_ELEMENTS = 64;
+
+/**
+ * Memory reused by script execution on one thread. Buffers of popped stack
+ * elements are kept in vFree and handed out again for the next push, so
+ * that once a thread has verified a few scripts, executing the usual
+ * templates does not touch the heap anymore.
+ */
+struct ScriptArena
+{
+    vector<valtype> vFree;
+    vector<vector<valtype> > vStacks;
+    valtype vchPushValue;
+    valtype vchSig;
+    CScript scriptCode;
+    CScript scriptSigPattern;
+    CScript scriptRedeem;
+    ScriptArenaStats stats;
+};
+
+thread_local ScriptArena scriptArena;
+
+/** Give the buffer of an element that is no longer used back to the arena */
+inline void ReleaseBuffer(valtype& vch)
+{
+    if (scriptArena.vFree.size() < MAX_ARENA_FREE_ELEMENTS && vch.capacity() > 0) {
+        scriptArena.vFree.push_back(valtype());
+        scriptArena.vFree.back().swap(vch);
+    }
+}
+
+/** A stack element buffer from the arena, or an empty one */
+inline valtype TakeBuffer()
+{
+    valtype vch;
+    if (!scriptArena.vFree.empty()) {
+        vch.swap(scriptArena.vFree.back());
+        scriptArena.vFree.pop_back();
+        scriptArena.stats.nReused++;
+    } else {
+        scriptArena.stats.nFresh++;
+    }
+    return vch;
+}
+
+/**
+ * Stack borrowed from the arena for the duration of a scope. The elements
+ * left on it are released to the arena when it goes out of scope.
+ */
+class ArenaStack
+{
+public:
+    ArenaStack()
+    {
+        if (!scriptArena.vStacks.empty()) {
+            stack.swap(scriptArena.vStacks.back());
+            scriptArena.vStacks.pop_back();
+            scriptArena.stats.nReused++;
+        } else {
+            scriptArena.stats.nFresh++;
+        }
+    }
+
+    ~ArenaStack()
+    {
+        for (valtype& vch : stack)
+            ReleaseBuffer(vch);
+        stack.clear();
+        scriptArena.vStacks.push_back(vector<valtype>());
+        scriptArena.vStacks.back().swap(stack);
+    }
+
+    vector<valtype> stack;
+};
+
+} // anon namespace
+
+ScriptArenaStats GetScriptArenaStats()
+{
+    return scriptArena.stats;
+}
+
 static inline void popstack(vector<valtype>& stack)
 {
     if (stack.empty())
         throw runtime_error("popstack(): stack empty");
+    ReleaseBuffer(stack.back());
     stack.pop_back();
 }
 
+static inline void pushstack(vector<valtype>& stack, const valtype& vch)
+{
+    // Copy before pushing, vch may be an element of the stack itself
+    valtype vchNew = TakeBuffer();
+    vchNew.assign(vch.begin(), vch.end());
+    stack.push_back(std::move(vchNew));
+}
+
+static inline void pushnum(vector<valtype>& stack, const CScriptNum& bn)
+{
+    valtype vchNew = TakeBuffer();
+    bn.getvch(vchNew);
+    stack.push_back(std::move(vchNew));
+}
+
 bool static IsCompressedOrUncompressedPubKey(const valtype &vchPubKey) {
     if (vchPubKey.size() < 33) {
         //  Non-canonical public key: too short
@@ -176,7 +279,8 @@ bool static IsLowDERSignature(const valtype &vchSig, ScriptError* serror) {
     if (!IsValidSignatureEncoding(vchSig)) {
         return set_error(serror, SCRIPT_ERR_SIG_DER);
     }
-    std::vector<unsigned char> vchSigCopy(vchSig.begin(), vchSig.begin() + vchSig.size() - 1);
+    std::vector<unsigned char>& vchSigCopy = scriptArena.vchSig;
+    vchSigCopy.assign(vchSig.begin(), vchSig.begin() + vchSig.size() - 1);
     if (!CPubKey::CheckLowS(vchSigCopy)) {
         return set_error(serror, SCRIPT_ERR_SIG_HIGH_S);
     }
@@ -259,9 +363,10 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
     CScript::const_iterator pend = script.end();
     CScript::const_iterator pbegincodehash = script.begin();
     opcodetype opcode;
-    valtype vchPushValue;
+    valtype& vchPushValue = scriptArena.vchPushValue;
     vector<bool> vfExec;
-    vector<valtype> altstack;
+    ArenaStack altstackArena;
+    vector<valtype>& altstack = altstackArena.stack;
     set_error(serror, SCRIPT_ERR_UNKNOWN_ERROR);
     if (script.size() > MAX_SCRIPT_SIZE)
         return set_error(serror, SCRIPT_ERR_SCRIPT_SIZE);
@@ -307,7 +412,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                 if (fRequireMinimal && !CheckMinimalPush(vchPushValue, opcode)) {
                     return set_error(serror, SCRIPT_ERR_MINIMALDATA);
                 }
-                stack.push_back(vchPushValue);
+                pushstack(stack, vchPushValue);
             } else if (fExec || (OP_IF <= opcode && opcode <= OP_ENDIF))
             switch (opcode)
             {
@@ -334,7 +439,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                 {
                     // ( -- value)
                     CScriptNum bn((int)opcode - (int)(OP_1 - 1));
-                    stack.push_back(bn.getvch());
+                    pushnum(stack, bn);
                     // The result of these opcodes should always be the minimal way to push the data
                     // they push, so no need for a CheckMinimalPush here.
                 }
@@ -503,8 +608,8 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                 {
                     if (stack.size() < 1)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    altstack.push_back(stacktop(-1));
-                    popstack(stack);
+                    altstack.push_back(std::move(stacktop(-1)));
+                    stack.pop_back();
                 }
                 break;
 
@@ -512,8 +617,8 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                 {
                     if (altstack.size() < 1)
                         return set_error(serror, SCRIPT_ERR_INVALID_ALTSTACK_OPERATION);
-                    stack.push_back(altstacktop(-1));
-                    popstack(altstack);
+                    stack.push_back(std::move(altstacktop(-1)));
+                    altstack.pop_back();
                 }
                 break;
 
@@ -532,10 +637,8 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                     // (x1 x2 -- x1 x2 x1 x2)
                     if (stack.size() < 2)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    valtype vch1 = stacktop(-2);
-                    valtype vch2 = stacktop(-1);
-                    stack.push_back(vch1);
-                    stack.push_back(vch2);
+                    pushstack(stack, stacktop(-2));
+                    pushstack(stack, stacktop(-2));
                 }
                 break;
 
@@ -544,12 +647,9 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                     // (x1 x2 x3 -- x1 x2 x3 x1 x2 x3)
                     if (stack.size() < 3)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    valtype vch1 = stacktop(-3);
-                    valtype vch2 = stacktop(-2);
-                    valtype vch3 = stacktop(-1);
-                    stack.push_back(vch1);
-                    stack.push_back(vch2);
-                    stack.push_back(vch3);
+                    pushstack(stack, stacktop(-3));
+                    pushstack(stack, stacktop(-3));
+                    pushstack(stack, stacktop(-3));
                 }
                 break;
 
@@ -558,10 +658,8 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                     // (x1 x2 x3 x4 -- x1 x2 x3 x4 x1 x2)
                     if (stack.size() < 4)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    valtype vch1 = stacktop(-4);
-                    valtype vch2 = stacktop(-3);
-                    stack.push_back(vch1);
-                    stack.push_back(vch2);
+                    pushstack(stack, stacktop(-4));
+                    pushstack(stack, stacktop(-4));
                 }
                 break;
 
@@ -570,11 +668,11 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                     // (x1 x2 x3 x4 x5 x6 -- x3 x4 x5 x6 x1 x2)
                     if (stack.size() < 6)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    valtype vch1 = stacktop(-6);
-                    valtype vch2 = stacktop(-5);
+                    valtype vch1 = std::move(stacktop(-6));
+                    valtype vch2 = std::move(stacktop(-5));
                     stack.erase(stack.end()-6, stack.end()-4);
-                    stack.push_back(vch1);
-                    stack.push_back(vch2);
+                    stack.push_back(std::move(vch1));
+                    stack.push_back(std::move(vch2));
                 }
                 break;
 
@@ -593,9 +691,8 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                     // (x - 0 | x x)
                     if (stack.size() < 1)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    valtype vch = stacktop(-1);
-                    if (CastToBool(vch))
-                        stack.push_back(vch);
+                    if (CastToBool(stacktop(-1)))
+                        pushstack(stack, stacktop(-1));
                 }
                 break;
 
@@ -603,7 +700,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                 {
                     // -- stacksize
                     CScriptNum bn(stack.size());
-                    stack.push_back(bn.getvch());
+                    pushnum(stack, bn);
                 }
                 break;
 
@@ -621,8 +718,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                     // (x -- x x)
                     if (stack.size() < 1)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    valtype vch = stacktop(-1);
-                    stack.push_back(vch);
+                    pushstack(stack, stacktop(-1));
                 }
                 break;
 
@@ -640,8 +736,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                     // (x1 x2 -- x1 x2 x1)
                     if (stack.size() < 2)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    valtype vch = stacktop(-2);
-                    stack.push_back(vch);
+                    pushstack(stack, stacktop(-2));
                 }
                 break;
 
@@ -656,10 +751,13 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                     popstack(stack);
                     if (n < 0 || n >= (int)stack.size())
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    valtype vch = stacktop(-n-1);
-                    if (opcode == OP_ROLL)
+                    if (opcode == OP_ROLL) {
+                        valtype vch = std::move(stacktop(-n-1));
                         stack.erase(stack.end()-n-1);
-                    stack.push_back(vch);
+                        stack.push_back(std::move(vch));
+                    } else {
+                        pushstack(stack, stacktop(-n-1));
+                    }
                 }
                 break;
 
@@ -689,8 +787,9 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                     // (x1 x2 -- x2 x1 x2)
                     if (stack.size() < 2)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    valtype vch = stacktop(-1);
-                    stack.insert(stack.end()-2, vch);
+                    valtype vch = TakeBuffer();
+                    vch.assign(stacktop(-1).begin(), stacktop(-1).end());
+                    stack.insert(stack.end()-2, std::move(vch));
                 }
                 break;
 
@@ -701,7 +800,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                     if (stack.size() < 1)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
                     CScriptNum bn(stacktop(-1).size());
-                    stack.push_back(bn.getvch());
+                    pushnum(stack, bn);
                 }
                 break;
 
@@ -726,7 +825,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                     //    fEqual = !fEqual;
                     popstack(stack);
                     popstack(stack);
-                    stack.push_back(fEqual ? vchTrue : vchFalse);
+                    pushstack(stack, fEqual ? vchTrue : vchFalse);
                     if (opcode == OP_EQUALVERIFY)
                     {
                         if (fEqual)
@@ -763,7 +862,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                     default:            assert(!"invalid opcode"); break;
                     }
                     popstack(stack);
-                    stack.push_back(bn.getvch());
+                    pushnum(stack, bn);
                 }
                 break;
 
@@ -812,7 +911,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                     }
                     popstack(stack);
                     popstack(stack);
-                    stack.push_back(bn.getvch());
+                    pushnum(stack, bn);
 
                     if (opcode == OP_NUMEQUALVERIFY)
                     {
@@ -836,7 +935,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                     popstack(stack);
                     popstack(stack);
                     popstack(stack);
-                    stack.push_back(fValue ? vchTrue : vchFalse);
+                    pushstack(stack, fValue ? vchTrue : vchFalse);
                 }
                 break;
 
@@ -854,19 +953,20 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                     if (stack.size() < 1)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
                     valtype& vch = stacktop(-1);
-                    valtype vchHash((opcode == OP_RIPEMD160 || opcode == OP_SHA1 || opcode == OP_HASH160) ? 20 : 32);
+                    unsigned char vchHash[32];
+                    size_t nHashSize = (opcode == OP_RIPEMD160 || opcode == OP_SHA1 || opcode == OP_HASH160) ? 20 : 32;
                     if (opcode == OP_RIPEMD160)
-                        CRIPEMD160().Write(vch.data(), vch.size()).Finalize(vchHash.data());
+                        CRIPEMD160().Write(vch.data(), vch.size()).Finalize(vchHash);
                     else if (opcode == OP_SHA1)
-                        CSHA1().Write(vch.data(), vch.size()).Finalize(vchHash.data());
+                        CSHA1().Write(vch.data(), vch.size()).Finalize(vchHash);
                     else if (opcode == OP_SHA256)
-                        CSHA256().Write(vch.data(), vch.size()).Finalize(vchHash.data());
+                        CSHA256().Write(vch.data(), vch.size()).Finalize(vchHash);
                     else if (opcode == OP_HASH160)
-                        CHash160().Write(vch.data(), vch.size()).Finalize(vchHash.data());
+                        CHash160().Write(vch.data(), vch.size()).Finalize(vchHash);
                     else if (opcode == OP_HASH256)
-                        CHash256().Write(vch.data(), vch.size()).Finalize(vchHash.data());
-                    popstack(stack);
-                    stack.push_back(vchHash);
+                        CHash256().Write(vch.data(), vch.size()).Finalize(vchHash);
+                    // Replace the input in place, reusing its buffer
+                    vch.assign(vchHash, vchHash + nHashSize);
                 }
                 break;                                   
 
@@ -888,11 +988,14 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                     valtype& vchPubKey = stacktop(-1);
 
                     // Subset of script starting at the most recent codeseparator
-                    CScript scriptCode(pbegincodehash, pend);
+                    CScript& scriptCode = scriptArena.scriptCode;
+                    scriptCode.assign(pbegincodehash, pend);
 
                     // Drop the signature in pre-segwit scripts but not segwit scripts
                     if (sigversion == SIGVERSION_BASE) {
-                        scriptCode.FindAndDelete(CScript(vchSig));
+                        scriptArena.scriptSigPattern.resize(0);
+                        scriptArena.scriptSigPattern << vchSig;
+                        scriptCode.FindAndDelete(scriptArena.scriptSigPattern);
                     }
 
                     if (!CheckSignatureEncoding(vchSig, flags, serror) || !CheckPubKeyEncoding(vchPubKey, flags, sigversion, serror)) {
@@ -906,7 +1009,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
 
                     popstack(stack);
                     popstack(stack);
-                    stack.push_back(fSuccess ? vchTrue : vchFalse);
+                    pushstack(stack, fSuccess ? vchTrue : vchFalse);
                     if (opcode == OP_CHECKSIGVERIFY)
                     {
                         if (fSuccess)
@@ -949,14 +1052,17 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
 
                     // Subset of script starting at the most recent codeseparator
-                    CScript scriptCode(pbegincodehash, pend);
+                    CScript& scriptCode = scriptArena.scriptCode;
+                    scriptCode.assign(pbegincodehash, pend);
 
                     // Drop the signature in pre-segwit scripts but not segwit scripts
                     for (int k = 0; k < nSigsCount; k++)
                     {
                         valtype& vchSig = stacktop(-isig-k);
                         if (sigversion == SIGVERSION_BASE) {
-                            scriptCode.FindAndDelete(CScript(vchSig));
+                            scriptArena.scriptSigPattern.resize(0);
+                            scriptArena.scriptSigPattern << vchSig;
+                            scriptCode.FindAndDelete(scriptArena.scriptSigPattern);
                         }
                     }
 
@@ -1013,7 +1119,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                         return set_error(serror, SCRIPT_ERR_SIG_NULLDUMMY);
                     popstack(stack);
 
-                    stack.push_back(fSuccess ? vchTrue : vchFalse);
+                    pushstack(stack, fSuccess ? vchTrue : vchFalse);
 
                     if (opcode == OP_CHECKMULTISIGVERIFY)
                     {
@@ -1168,11 +1274,30 @@ uint256 GetOutputsHash(const CTransaction& txTo) {
 
 } // anon namespace
 
+/** Serialized size of an input with an empty script: prevout, script length and nSequence */
+static const size_t LEGACY_SIGHASH_INPUT_SIZE = 36 + 1 + 4;
+
 PrecomputedTransactionData::PrecomputedTransactionData(const CTransaction& txTo)
 {
     hashPrevouts = GetPrevoutHash(txTo);
     hashSequence = GetSequenceHash(txTo);
     hashOutputs = GetOutputsHash(txTo);
+
+    vLegacyInputs.reserve(txTo.vin.size() * LEGACY_SIGHASH_INPUT_SIZE);
+    CVectorWriter inputs(SER_GETHASH, 0, vLegacyInputs, 0);
+    for (const CTxIn& txin : txTo.vin)
+        inputs << txin.prevout << CScriptBase() << txin.nSequence;
+    CVectorWriter outputs(SER_GETHASH, 0, vLegacyOutputs, 0);
+    outputs << txTo.vout << txTo.nLockTime;
+
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << txTo.nVersion;
+    WriteCompactSize(ss, txTo.vin.size());
+    vLegacyMidstates.reserve(txTo.vin.size());
+    for (size_t i = 0; i < txTo.vin.size(); i++) {
+        vLegacyMidstates.push_back(ss);
+        ss.write((const char*)vLegacyInputs.data() + i * LEGACY_SIGHASH_INPUT_SIZE, LEGACY_SIGHASH_INPUT_SIZE);
+    }
 }
 
 uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType, const CAmount& amount, SigVersion sigversion, const PrecomputedTransactionData* cache)
@@ -1239,6 +1364,28 @@ uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsig
     // Wrapper to serialize only the necessary parts of the transaction being signed
     CTransactionSignatureSerializer txTmp(txTo, scriptCode, nIn, nHashType);
 
+    // Every input and output is committed to the way it was precomputed unless
+    // the hash type is SIGHASH_NONE or SIGHASH_SINGLE
+    if (cache && cache->vLegacyMidstates.size() == txTo.vin.size() &&
+        (nHashType & 0x1f) != SIGHASH_SINGLE && (nHashType & 0x1f) != SIGHASH_NONE) {
+        const bool fAnyoneCanPay = !!(nHashType & SIGHASH_ANYONECANPAY);
+        const char* pinput = (const char*)cache->vLegacyInputs.data() + nIn * LEGACY_SIGHASH_INPUT_SIZE;
+        CHashWriter ss(fAnyoneCanPay ? CHashWriter(SER_GETHASH, 0) : cache->vLegacyMidstates[nIn]);
+        if (fAnyoneCanPay) {
+            ss << txTo.nVersion;
+            WriteCompactSize(ss, 1);
+        }
+        // The signed input, with scriptCode in place of its script
+        ss.write(pinput, 36);
+        txTmp.SerializeScriptCode(ss);
+        ss.write(pinput + 37, 4);
+        if (!fAnyoneCanPay)
+            ss.write(pinput + LEGACY_SIGHASH_INPUT_SIZE, cache->vLegacyInputs.size() - (nIn + 1) * LEGACY_SIGHASH_INPUT_SIZE);
+        ss.write((const char*)cache->vLegacyOutputs.data(), cache->vLegacyOutputs.size());
+        ss << nHashType;
+        return ss.GetHash();
+    }
+
     // Serialize and hash
     CHashWriter ss(SER_GETHASH, 0);
     ss << txTmp << nHashType;
@@ -1257,11 +1404,11 @@ bool TransactionSignatureChecker::CheckSig(const vector<unsigned char>& vchSigIn
         return false;
 
     // Hash type is one byte tacked on to the end of the signature
-    vector<unsigned char> vchSig(vchSigIn);
-    if (vchSig.empty())
+    if (vchSigIn.empty())
         return false;
-    int nHashType = vchSig.back();
-    vchSig.pop_back();
+    int nHashType = vchSigIn.back();
+    vector<unsigned char>& vchSig = scriptArena.vchSig;
+    vchSig.assign(vchSigIn.begin(), vchSigIn.end() - 1);
 
     uint256 sighash = SignatureHash(scriptCode, *txTo, nIn, nHashType, amount, sigversion, this->txdata);
 
@@ -1406,7 +1553,226 @@ static bool VerifyWitnessProgram(const CScriptWitness& witness, int witversion,
     return true;
 }
 
+namespace {
+
+/** Outcome of verifying a spend through the standard template fast paths */
+enum TemplateResult
+{
+    TEMPLATE_VALID,
+    TEMPLATE_INVALID,
+    //! Not a standard template, or a case left to the interpreter
+    TEMPLATE_UNKNOWN,
+};
+
+/** Push the data of a script made of data pushes only, exactly as EvalScript would. */
+bool EvalDataPushes(const CScript& script, unsigned int flags, vector<valtype>& stack)
+{
+    if (script.size() > MAX_SCRIPT_SIZE)
+        return false;
+    valtype& vchPushValue = scriptArena.vchPushValue;
+    opcodetype opcode;
+    CScript::const_iterator pc = script.begin();
+    while (pc < script.end()) {
+        if (!script.GetOp(pc, opcode, vchPushValue) || opcode > OP_PUSHDATA4)
+            return false;
+        if (vchPushValue.size() > MAX_SCRIPT_ELEMENT_SIZE)
+            return false;
+        if ((flags & SCRIPT_VERIFY_MINIMALDATA) && !CheckMinimalPush(vchPushValue, opcode))
+            return false;
+        pushstack(stack, vchPushValue);
+        if (stack.size() > 1000)
+            return false;
+    }
+    return true;
+}
+
+bool MatchPayToPubkeyHash(const CScript& script)
+{
+    return script.size() == 25 && script[0] == OP_DUP && script[1] == OP_HASH160 && script[2] == 20 &&
+           script[23] == OP_EQUALVERIFY && script[24] == OP_CHECKSIG;
+}
+
+bool MatchPayToPubkey(const CScript& script)
+{
+    return (script.size() == 35 && script[0] == 33 && script[34] == OP_CHECKSIG) ||
+           (script.size() == 67 && script[0] == 65 && script[66] == OP_CHECKSIG);
+}
+
+/** OP_m <pubkey>... OP_n OP_CHECKMULTISIG with 33 or 65 byte keys and m <= n */
+bool MatchMultisig(const CScript& script, int& nRequired, int& nKeys)
+{
+    if (script.size() < 3 || script.back() != OP_CHECKMULTISIG)
+        return false;
+    opcodetype opRequired = (opcodetype)script[0];
+    opcodetype opKeys = (opcodetype)script[script.size() - 2];
+    if (opRequired < OP_1 || opRequired > OP_16 || opKeys < OP_1 || opKeys > OP_16)
+        return false;
+    nKeys = 0;
+    size_t nPos = 1;
+    while (nPos < script.size() - 2 && (script[nPos] == 33 || script[nPos] == 65)) {
+        nPos += 1 + script[nPos];
+        nKeys++;
+    }
+    nRequired = CScript::DecodeOP_N(opRequired);
+    return nPos == script.size() - 2 && CScript::DecodeOP_N(opKeys) == nKeys && nRequired <= nKeys;
+}
+
+/** Copy of scriptCode with the signatures removed, as OP_CHECKSIG and OP_CHECKMULTISIG make it */
+const CScript& GetTemplateScriptCode(const CScript& script, vector<valtype>::const_iterator itSigBegin, vector<valtype>::const_iterator itSigEnd)
+{
+    CScript& scriptCode = scriptArena.scriptCode;
+    scriptCode.assign(script.begin(), script.end());
+    // Same order as the interpreter, starting from the top of the stack
+    while (itSigEnd != itSigBegin) {
+        --itSigEnd;
+        scriptArena.scriptSigPattern.resize(0);
+        scriptArena.scriptSigPattern << *itSigEnd;
+        scriptCode.FindAndDelete(scriptArena.scriptSigPattern);
+    }
+    return scriptCode;
+}
+
+/** <sig> <pubkey> OP_CHECKSIG as the last operation of a script */
+TemplateResult VerifyTemplateCheckSig(const vector<valtype>& stack, const CScript& script, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror)
+{
+    const valtype& vchSig = stack[0];
+    const valtype& vchPubKey = stack[1];
+    // Encoding errors are reported by the interpreter, no signature has been checked yet
+    if (!CheckSignatureEncoding(vchSig, flags, NULL) || !CheckPubKeyEncoding(vchPubKey, flags, SIGVERSION_BASE, NULL))
+        return TEMPLATE_UNKNOWN;
+    const CScript& scriptCode = GetTemplateScriptCode(script, stack.begin(), stack.begin() + 1);
+    if (checker.CheckSig(vchSig, vchPubKey, scriptCode, SIGVERSION_BASE)) {
+        set_success(serror);
+        return TEMPLATE_VALID;
+    }
+    set_error(serror, (flags & SCRIPT_VERIFY_NULLFAIL) && vchSig.size() ? SCRIPT_ERR_SIG_NULLFAIL : SCRIPT_ERR_EVAL_FALSE);
+    return TEMPLATE_INVALID;
+}
+
+/** <dummy> <sig>... followed by a multisig script. Mirrors OP_CHECKMULTISIG in EvalScript. */
+TemplateResult VerifyTemplateMultisig(vector<valtype>& stack, const CScript& script, int nRequired, int nKeys, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror)
+{
+    // Extra items would be left on the stack, a bad dummy fails after the signatures
+    if ((int)stack.size() != nRequired + 1)
+        return TEMPLATE_UNKNOWN;
+    if ((flags & SCRIPT_VERIFY_NULLDUMMY) && stack[0].size())
+        return TEMPLATE_UNKNOWN;
+
+    const CScript& scriptCode = GetTemplateScriptCode(script, stack.begin() + 1, stack.end());
+
+    // Keys go on top of the signatures, so both are walked from the top like in EvalScript
+    size_t nPos = 1;
+    for (int i = 0; i < nKeys; i++) {
+        stack.push_back(TakeBuffer());
+        stack.back().assign(script.begin() + nPos + 1, script.begin() + nPos + 1 + script[nPos]);
+        nPos += 1 + script[nPos];
+    }
+    int isig = nRequired;
+    int ikey = nRequired + nKeys;
+    int nSigsCount = nRequired;
+    int nKeysCount = nKeys;
+    bool fSuccess = true;
+    while (fSuccess && nSigsCount > 0) {
+        const valtype& vchSig = stack[isig];
+        const valtype& vchPubKey = stack[ikey];
+        if (!CheckSignatureEncoding(vchSig, flags, serror) || !CheckPubKeyEncoding(vchPubKey, flags, SIGVERSION_BASE, serror))
+            return TEMPLATE_INVALID;
+        if (checker.CheckSig(vchSig, vchPubKey, scriptCode, SIGVERSION_BASE)) {
+            isig--;
+            nSigsCount--;
+        }
+        ikey--;
+        nKeysCount--;
+        if (nSigsCount > nKeysCount)
+            fSuccess = false;
+    }
+
+    if (!fSuccess) {
+        if (flags & SCRIPT_VERIFY_NULLFAIL) {
+            for (int i = 1; i <= nRequired; i++) {
+                if (stack[i].size()) {
+                    set_error(serror, SCRIPT_ERR_SIG_NULLFAIL);
+                    return TEMPLATE_INVALID;
+                }
+            }
+        }
+        set_error(serror, SCRIPT_ERR_EVAL_FALSE);
+        return TEMPLATE_INVALID;
+    }
+    set_success(serror);
+    return TEMPLATE_VALID;
+}
+
+/**
+ * Verify a spend of P2PK, P2PKH or (P2SH) multisig without the opcode loop.
+ * A result other than TEMPLATE_UNKNOWN, including the error, is the same as
+ * that of the interpreter. Unusual spends are left to the interpreter before
+ * any signature is checked, so no signature is verified twice.
+ */
+TemplateResult VerifyStandardTemplate(const CScript& scriptSig, const CScript& scriptPubKey, const CScriptWitness& witness, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror)
+{
+    // Let the interpreter handle witnesses and the flag combinations it asserts on
+    if (!witness.IsNull())
+        return TEMPLATE_UNKNOWN;
+    if ((flags & (SCRIPT_VERIFY_CLEANSTACK | SCRIPT_VERIFY_WITNESS)) && !(flags & SCRIPT_VERIFY_P2SH))
+        return TEMPLATE_UNKNOWN;
+    if ((flags & SCRIPT_VERIFY_CLEANSTACK) && !(flags & SCRIPT_VERIFY_WITNESS))
+        return TEMPLATE_UNKNOWN;
+
+    ArenaStack stackArena;
+    vector<valtype>& stack = stackArena.stack;
+    if (!EvalDataPushes(scriptSig, flags, stack))
+        return TEMPLATE_UNKNOWN;
+
+    const CScript* pscript = &scriptPubKey;
+    if (scriptPubKey.IsPayToScriptHash()) {
+        if (!(flags & SCRIPT_VERIFY_P2SH) || stack.empty())
+            return TEMPLATE_UNKNOWN;
+        const valtype& vchRedeemScript = stack.back();
+        unsigned char vchHash[20];
+        CHash160().Write(vchRedeemScript.data(), vchRedeemScript.size()).Finalize(vchHash);
+        if (memcmp(vchHash, &scriptPubKey[2], sizeof(vchHash)) != 0)
+            return TEMPLATE_UNKNOWN;
+        CScript& scriptRedeem = scriptArena.scriptRedeem;
+        scriptRedeem.assign(vchRedeemScript.begin(), vchRedeemScript.end());
+        popstack(stack);
+        pscript = &scriptRedeem;
+    }
+    const CScript& script = *pscript;
+
+    int nRequired, nKeys;
+    if (MatchPayToPubkeyHash(script)) {
+        if (stack.size() != 2)
+            return TEMPLATE_UNKNOWN;
+        unsigned char vchHash[20];
+        CHash160().Write(stack[1].data(), stack[1].size()).Finalize(vchHash);
+        if (memcmp(vchHash, &script[3], sizeof(vchHash)) != 0)
+            return TEMPLATE_UNKNOWN;
+        return VerifyTemplateCheckSig(stack, script, flags, checker, serror);
+    } else if (MatchPayToPubkey(script)) {
+        if (stack.size() != 1)
+            return TEMPLATE_UNKNOWN;
+        stack.push_back(TakeBuffer());
+        stack.back().assign(script.begin() + 1, script.end() - 1);
+        return VerifyTemplateCheckSig(stack, script, flags, checker, serror);
+    } else if (MatchMultisig(script, nRequired, nKeys)) {
+        return VerifyTemplateMultisig(stack, script, nRequired, nKeys, flags, checker, serror);
+    }
+    return TEMPLATE_UNKNOWN;
+}
+
+} // anon namespace
+
 bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, const CScriptWitness* witness, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror)
+{
+    static const CScriptWitness emptyWitness;
+    TemplateResult result = VerifyStandardTemplate(scriptSig, scriptPubKey, witness ? *witness : emptyWitness, flags, checker, serror);
+    if (result != TEMPLATE_UNKNOWN)
+        return result == TEMPLATE_VALID;
+    return VerifyScriptInterpreted(scriptSig, scriptPubKey, witness, flags, checker, serror);
+}
+
+bool VerifyScriptInterpreted(const CScript& scriptSig, const CScript& scriptPubKey, const CScriptWitness* witness, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror)
 {
     static const CScriptWitness emptyWitness;
     if (witness == NULL) {
@@ -1420,12 +1786,17 @@ bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, const C
         return set_error(serror, SCRIPT_ERR_SIG_PUSHONLY);
     }
 
-    vector<vector<unsigned char> > stack, stackCopy;
+    ArenaStack stackArena, stackCopyArena;
+    vector<valtype>& stack = stackArena.stack;
+    vector<valtype>& stackCopy = stackCopyArena.stack;
     if (!EvalScript(stack, scriptSig, flags, checker, SIGVERSION_BASE, serror))
         // serror is set
         return false;
-    if (flags & SCRIPT_VERIFY_P2SH)
-        stackCopy = stack;
+    // Only the redeem script of a P2SH output needs the stack as left by scriptSig
+    if ((flags & SCRIPT_VERIFY_P2SH) && scriptPubKey.IsPayToScriptHash()) {
+        for (const valtype& vch : stack)
+            pushstack(stackCopy, vch);
+    }
     if (!EvalScript(stack, scriptPubKey, flags, checker, SIGVERSION_BASE, serror))
         // serror is set
         return false;
@@ -1469,7 +1840,8 @@ bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, const C
         assert(!stack.empty());
 
         const valtype& pubKeySerialized = stack.back();
-        CScript pubKey2(pubKeySerialized.begin(), pubKeySerialized.end());
+        CScript& pubKey2 = scriptArena.scriptRedeem;
+        pubKey2.assign(pubKeySerialized.begin(), pubKeySerialized.end());
         popstack(stack);
 
         if (!EvalScript(stack, pubKey2, flags, checker, SIGVERSION_BASE, serror))
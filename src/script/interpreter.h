@@ -6,6 +6,7 @@
 #ifndef BITCOIN_SCRIPT_INTERPRETER_H
 #define BITCOIN_SCRIPT_INTERPRETER_H
 
+#include "hash.h"
 #include "script_error.h"
 #include "primitives/transaction.h"
 
@@ -114,6 +115,17 @@ struct PrecomputedTransactionData
 {
     uint256 hashPrevouts, hashSequence, hashOutputs;
 
+    /**
+     * Legacy signature hashes serialize the whole transaction for every input.
+     * With SIGHASH_ALL the inputs before the signed one come out the same for
+     * every input, so the hash state after them is kept for each input, along
+     * with the serialization of the inputs with empty scripts and that of the
+     * outputs and nLockTime.
+     */
+    std::vector<CHashWriter> vLegacyMidstates;
+    std::vector<unsigned char> vLegacyInputs;
+    std::vector<unsigned char> vLegacyOutputs;
+
     PrecomputedTransactionData(const CTransaction& tx);
 };
 
@@ -177,6 +189,25 @@ public:
 bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript& script, unsigned int flags, const BaseSignatureChecker& checker, SigVersion sigversion, ScriptError* error = NULL);
 bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, const CScriptWitness* witness, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror = NULL);
 
+/**
+ * VerifyScript without the fast paths for P2PK, P2PKH and (P2SH) multisig
+ * spends, which VerifyScript runs before falling back to the interpreter.
+ * Both give the same result and error for every input.
+ */
+bool VerifyScriptInterpreted(const CScript& scriptSig, const CScript& scriptPubKey, const CScriptWitness* witness, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror = NULL);
+
+/** Buffers handed out by the script execution arena of one thread */
+struct ScriptArenaStats
+{
+    uint64_t nReused; //!< stack elements and stacks served from buffers of earlier scripts
+    uint64_t nFresh;  //!< stack elements and stacks the arena had no buffer for, which grow on the heap
+
+    ScriptArenaStats() : nReused(0), nFresh(0) {}
+};
+
+/** Arena counters of the calling thread since it started */
+ScriptArenaStats GetScriptArenaStats();
+
 size_t CountWitnessSigOps(const CScript& scriptSig, const CScript& scriptPubKey, const CScriptWitness* witness, unsigned int flags);
 
 #endif // BITCOIN_SCRIPT_INTERPRETER_H
@@ -9,6 +9,7 @@
 #include "crypto/common.h"
 #include "prevector.h"
 
+#include <algorithm>
 #include <assert.h>
 #include <climits>
 #include <limits>
@@ -316,12 +317,25 @@ public:
         return serialize(m_value);
     }
 
+    //! Serialize into vch, reusing its memory
+    void getvch(std::vector<unsigned char>& vch) const
+    {
+        serialize(m_value, vch);
+    }
+
     static std::vector<unsigned char> serialize(const int64_t& value)
     {
+        std::vector<unsigned char> result;
+        serialize(value, result);
+        return result;
+    }
+
+    static void serialize(const int64_t& value, std::vector<unsigned char>& result)
+    {
+        result.clear();
         if(value == 0)
-            return std::vector<unsigned char>();
+            return;
 
-        std::vector<unsigned char> result;
         const bool neg = value < 0;
         uint64_t absvalue = neg ? -value : value;
 
@@ -345,8 +359,6 @@ public:
             result.push_back(neg ? 0x80 : 0);
         else if (neg)
             result.back() |= 0x80;
-
-        return result;
     }
 
 private:
@@ -572,6 +584,9 @@ public:
         int nFound = 0;
         if (b.empty())
             return nFound;
+        // Every match starts at an opcode, so without a byte match there is nothing to delete
+        if (std::search(begin(), end(), b.begin(), b.end()) == end())
+            return nFound;
         CScript result;
         iterator pc = begin(), pc2 = begin();
         opcodetype opcode;
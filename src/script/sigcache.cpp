@@ -5,37 +5,24 @@
 
 #include "sigcache.h"
 
+#include "clientversion.h"
 #include "memusage.h"
 #include "pubkey.h"
 #include "random.h"
+#include "streams.h"
 #include "uint256.h"
 #include "util.h"
+#include "utiltime.h"
 
 #include "cuckoocache.h"
+
+#include <atomic>
+
 #include <boost/thread.hpp>
 
-namespace {
+static const uint64_t SIG_CACHE_DUMP_VERSION = 1;
 
-/**
- * We're hashing a nonce into the entries themselves, so we don't need extra
- * blinding in the set hash computation.
- *
- * This may exhibit platform endian dependent behavior but because these are
- * nonced hashes (random) and this state is only ever used locally it is safe.
- * All that matters is local consistency.
- */
-class SignatureCacheHasher
-{
-public:
-    template <uint8_t hash_select>
-    uint32_t operator()(const uint256& key) const
-    {
-        static_assert(hash_select <8, "SignatureCacheHasher only has 8 hashes available.");
-        uint32_t u;
-        std::memcpy(&u, key.begin()+4*hash_select, 4);
-        return u;
-    }
-};
+namespace {
 
 /**
  * Valid signature cache, to avoid doing expensive ECDSA signature checking
@@ -50,9 +37,12 @@ private:
     typedef CuckooCache::cache<uint256, SignatureCacheHasher> map_type;
     map_type setValid;
     boost::shared_mutex cs_sigcache;
+    uint32_t nMaxEntries;
+    std::atomic<uint64_t> nHits;
+    std::atomic<uint64_t> nMisses;
 
 public:
-    CSignatureCache()
+    CSignatureCache() : nMaxEntries(0), nHits(0), nMisses(0)
     {
         GetRandBytes(nonce.begin(), 32);
     }
@@ -65,9 +55,20 @@ public:
 
     bool
     Get(const uint256& entry, const bool erase)
+    {
+        bool fFound;
+        {
+            boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
+            fFound = setValid.contains(entry, erase);
+        }
+        (fFound ? nHits : nMisses).fetch_add(1, std::memory_order_relaxed);
+        return fFound;
+    }
+
+    void Erase(const uint256& entry)
     {
         boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
-        return setValid.contains(entry, erase);
+        setValid.contains(entry, true);
     }
 
     void Set(uint256& entry)
@@ -77,7 +78,33 @@ public:
     }
     uint32_t setup_bytes(size_t n)
     {
-        return setValid.setup_bytes(n);
+        nMaxEntries = setValid.setup_bytes(n);
+        return nMaxEntries;
+    }
+
+    /** Copy the nonce and all entries that were not erased */
+    void GetEntries(uint256& nonceOut, std::vector<uint256>& vEntries)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
+        nonceOut = nonce;
+        setValid.for_each([&vEntries](const uint256& entry) { vEntries.push_back(entry); });
+    }
+
+    /** Switch to a persisted nonce and add its entries. Entries already present become unreachable. */
+    void Restore(const uint256& nonceIn, const std::vector<uint256>& vEntries)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
+        nonce = nonceIn;
+        for (const uint256& entry : vEntries)
+            setValid.insert(entry);
+    }
+
+    void GetStats(CSignatureCacheStats& stats)
+    {
+        stats.nHits = nHits;
+        stats.nMisses = nMisses;
+        stats.nMaxEntries = nMaxEntries;
+        stats.nEntries = setValid.count();
     }
 };
 
@@ -88,6 +115,8 @@ public:
  * signatureCache could be made local to VerifySignature.
 */
 static CSignatureCache signatureCache;
+
+static size_t nSignatureCacheLoaded = 0;
 }
 
 // To be called once in AppInit2/TestingSetup to initialize the signatureCache
@@ -101,6 +130,70 @@ void InitSignatureCache()
             (nElems*sizeof(uint256)) >>20, nMaxCacheSize>>20, nElems);
 }
 
+void DumpSignatureCache()
+{
+    int64_t nStart = GetTimeMicros();
+    uint256 nonce;
+    std::vector<uint256> vEntries;
+    signatureCache.GetEntries(nonce, vEntries);
+
+    try {
+        FILE* filestr = fopen((GetDataDir() / "sigcache.dat.new").string().c_str(), "wb");
+        if (!filestr) {
+            return;
+        }
+
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+        file << SIG_CACHE_DUMP_VERSION;
+        file << nonce;
+        file << vEntries;
+        FileCommit(file.Get());
+        file.fclose();
+        RenameOver(GetDataDir() / "sigcache.dat.new", GetDataDir() / "sigcache.dat");
+        LogPrintf("Dumped %u signature cache entries in %gs\n", vEntries.size(), (GetTimeMicros() - nStart) * 0.000001);
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to dump signature cache: %s. Continuing anyway.\n", e.what());
+    }
+}
+
+bool LoadSignatureCache()
+{
+    FILE* filestr = fopen((GetDataDir() / "sigcache.dat").string().c_str(), "rb");
+    CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        LogPrintf("Failed to open signature cache file from disk. Continuing anyway.\n");
+        return false;
+    }
+
+    try {
+        uint64_t version;
+        file >> version;
+        if (version != SIG_CACHE_DUMP_VERSION) {
+            return false;
+        }
+        uint256 nonce;
+        std::vector<uint256> vEntries;
+        file >> nonce;
+        file >> vEntries;
+        signatureCache.Restore(nonce, vEntries);
+        nSignatureCacheLoaded = vEntries.size();
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to deserialize signature cache file from disk: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+
+    LogPrintf("Imported %u signature cache entries from disk\n", nSignatureCacheLoaded);
+    return true;
+}
+
+CSignatureCacheStats GetSignatureCacheStats()
+{
+    CSignatureCacheStats stats;
+    signatureCache.GetStats(stats);
+    stats.nLoaded = nSignatureCacheLoaded;
+    return stats;
+}
+
 bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
 {
     uint256 entry;
@@ -113,3 +206,11 @@ bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsig
         signatureCache.Set(entry);
     return true;
 }
+
+bool UncachingTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
+{
+    uint256 entry;
+    signatureCache.ComputeEntry(entry, sighash, vchSig, pubkey);
+    signatureCache.Erase(entry);
+    return true;
+}
@@ -8,6 +8,7 @@
 
 #include "script/interpreter.h"
 
+#include <cstring>
 #include <vector>
 
 // DoS prevention: limit cache size to 32MB (over 1000000 entries on 64-bit
@@ -16,6 +17,29 @@
 static const unsigned int DEFAULT_MAX_SIG_CACHE_SIZE = 32;
 // Maximum sig cache size allowed
 static const int64_t MAX_MAX_SIG_CACHE_SIZE = 16384;
+/** Default for -persistsigcache, keeping the signature cache across restarts */
+static const bool DEFAULT_PERSIST_SIG_CACHE = false;
+
+/**
+ * We're hashing a nonce into the entries themselves, so we don't need extra
+ * blinding in the set hash computation.
+ *
+ * This may exhibit platform endian dependent behavior but because these are
+ * nonced hashes (random) and this state is only ever used locally it is safe.
+ * All that matters is local consistency.
+ */
+class SignatureCacheHasher
+{
+public:
+    template <uint8_t hash_select>
+    uint32_t operator()(const uint256& key) const
+    {
+        static_assert(hash_select <8, "SignatureCacheHasher only has 8 hashes available.");
+        uint32_t u;
+        std::memcpy(&u, key.begin()+4*hash_select, 4);
+        return u;
+    }
+};
 
 class CPubKey;
 
@@ -30,6 +54,41 @@ public:
     bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
 };
 
+/**
+ * Signature checker that marks every signature it is asked about for erasure
+ * from the signature cache and reports it valid, without verifying anything.
+ * Only for dropping the signatures of scripts that were already checked.
+ */
+class UncachingTransactionSignatureChecker : public TransactionSignatureChecker
+{
+public:
+    UncachingTransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, const CAmount& amount, PrecomputedTransactionData& txdataIn) : TransactionSignatureChecker(txToIn, nInIn, amount, txdataIn) {}
+
+    bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
+};
+
+/** Signature cache usage, see GetSignatureCacheStats */
+struct CSignatureCacheStats
+{
+    //! Lookups that found the signature, and ones that had to verify it
+    uint64_t nHits;
+    uint64_t nMisses;
+    //! Entries in the cache, and how many it can hold
+    size_t nEntries;
+    size_t nMaxEntries;
+    //! Entries restored from disk at startup
+    size_t nLoaded;
+
+    CSignatureCacheStats() : nHits(0), nMisses(0), nEntries(0), nMaxEntries(0), nLoaded(0) {}
+};
+
 void InitSignatureCache();
 
+/** Write the signature cache and its nonce to sigcache.dat in the data directory */
+void DumpSignatureCache();
+/** Restore the signature cache from disk. Must be called before any signature is checked. */
+bool LoadSignatureCache();
+
+CSignatureCacheStats GetSignatureCacheStats();
+
 #endif // BITCOIN_SCRIPT_SIGCACHE_H
@@ -20,6 +20,18 @@ void PrintLockContention(const char* pszName, const char* pszFile, int nLine)
 }
 #endif /* DEBUG_LOCKCONTENTION */
 
+static thread_local int64_t nThreadLockWaitMicros = 0;
+
+int64_t GetThreadLockWaitMicros()
+{
+    return nThreadLockWaitMicros;
+}
+
+void AddThreadLockWait(int64_t nWaitStart)
+{
+    nThreadLockWaitMicros += GetTimeMicros() - nWaitStart;
+}
+
 #ifdef DEBUG_LOCKORDER
 //
 // Early deadlock detection.
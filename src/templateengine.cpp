@@ -0,0 +1,275 @@
+// Copyright (c) 2026 The Bunkercoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "templateengine.h"
+
+#include "chain.h"
+#include "chainparams.h"
+#include "consensus/consensus.h"
+#include "consensus/validation.h"
+#include "policy/policy.h"
+#include "txmempool.h"
+#include "util.h"
+#include "utiltime.h"
+#include "validation.h"
+#include "version.h"
+
+#include <chrono>
+
+std::unique_ptr<CBlockTemplateEngine> g_templateEngine;
+
+CBlockTemplateEngine::CBlockTemplateEngine(const CChainParams& chainparamsIn) :
+    chainparams(chainparamsIn), pindexTemplatePrev(NULL), fTemplateFull(false), nTemplateWeight(0), nTemplateSize(0),
+    nTemplateSigOpsCost(0), nTransactionsUpdatedLast(0), nTimeLastRebuild(0), nTemplateSequence(0),
+    fRequestShutdown(false), fTipChanged(false), fActive(false)
+{
+}
+
+CBlockTemplateEngine::~CBlockTemplateEngine()
+{
+    Stop();
+}
+
+void CBlockTemplateEngine::Start()
+{
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        fRequestShutdown = false;
+    }
+    threadUpdate = std::thread(&TraceThread<std::function<void()> >, "blktemplate", std::function<void()>(std::bind(&CBlockTemplateEngine::ThreadUpdate, this)));
+}
+
+void CBlockTemplateEngine::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        fRequestShutdown = true;
+    }
+    cond.notify_all();
+    if (threadUpdate.joinable())
+        threadUpdate.join();
+}
+
+std::unique_ptr<CBlockTemplate> CBlockTemplateEngine::GetTemplate(const CScript& scriptPubKeyIn)
+{
+    std::shared_ptr<const CBlockTemplate> psnapshot;
+    const CBlockIndex* pindexPrev;
+    {
+        LOCK(cs_main);
+        fActive = true;
+        if (!ptemplate || pindexTemplatePrev != chainActive.Tip())
+            Rebuild();
+        psnapshot = ptemplate;
+        pindexPrev = pindexTemplatePrev;
+    }
+
+    std::unique_ptr<CBlockTemplate> pblocktemplate(new CBlockTemplate(*psnapshot));
+    CMutableTransaction coinbaseTx(*pblocktemplate->block.vtx[0]);
+    coinbaseTx.vout[0].scriptPubKey = scriptPubKeyIn;
+    pblocktemplate->block.vtx[0] = MakeTransactionRef(std::move(coinbaseTx));
+    pblocktemplate->vTxSigOpsCost[0] = WITNESS_SCALE_FACTOR * GetLegacySigOpCount(*pblocktemplate->block.vtx[0]);
+
+    // The snapshot keeps the time it was built at; on min-difficulty chains this can also change nBits
+    {
+        LOCK(cs_main);
+        UpdateTime(&pblocktemplate->block, chainparams.GetConsensus(pindexPrev->nHeight + 1), pindexPrev);
+    }
+    return pblocktemplate;
+}
+
+void CBlockTemplateEngine::UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload)
+{
+    if (!fActive || fInitialDownload)
+        return;
+
+    // Hand out work on the new tip right away; the full template follows from the update thread
+    bool fBuilt = false;
+    {
+        LOCK(cs_main);
+        if (chainActive.Tip() == pindexNew && pindexTemplatePrev != pindexNew) {
+            try {
+                Rebuild(false);
+                fBuilt = true;
+            } catch (const std::exception& e) {
+                LogPrintf("%s: failed to create empty block template: %s\n", __func__, e.what());
+            }
+        }
+    }
+    if (fBuilt)
+        GetMainSignals().NewBlockTemplate(pindexNew, false);
+
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        fTipChanged = true;
+        vQueuedTxs.clear();
+    }
+    cond.notify_one();
+}
+
+void CBlockTemplateEngine::SyncTransaction(const CTransaction &tx, const CBlockIndex *pindex, int posInBlock)
+{
+    // Only transactions entering the mempool; anything else comes with a new tip
+    if (!fActive || pindex != NULL)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        vQueuedTxs.push_back(tx.GetHash());
+    }
+    cond.notify_one();
+}
+
+void CBlockTemplateEngine::ThreadUpdate()
+{
+    while (true) {
+        std::vector<uint256> vHashes;
+        bool fRebuild;
+        {
+            std::unique_lock<std::mutex> lock(cs);
+            cond.wait_for(lock, std::chrono::seconds(1));
+            if (fRequestShutdown)
+                return;
+            if (!fActive)
+                continue;
+            vHashes.swap(vQueuedTxs);
+            fRebuild = fTipChanged;
+            fTipChanged = false;
+        }
+        // Periodically start over to pick up better packages and drop evicted transactions
+        if (GetTime() - nTimeLastRebuild >= TEMPLATE_REBUILD_INTERVAL && mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast)
+            fRebuild = true;
+        if (!fRebuild && vHashes.empty())
+            continue;
+
+        const CBlockIndex* pindexRebuilt = NULL;
+        try {
+            LOCK2(cs_main, mempool.cs);
+            if (fRebuild || !ptemplate || !fTemplateFull || pindexTemplatePrev != chainActive.Tip()) {
+                Rebuild();
+                pindexRebuilt = pindexTemplatePrev;
+            } else if (!vHashes.empty()) {
+                AddTransactions(vHashes);
+            }
+        } catch (const std::exception& e) {
+            LogPrintf("%s: failed to update block template: %s\n", __func__, e.what());
+        }
+        if (pindexRebuilt)
+            GetMainSignals().NewBlockTemplate(pindexRebuilt, true);
+    }
+}
+
+void CBlockTemplateEngine::Rebuild(bool fAddTransactions)
+{
+    AssertLockHeld(cs_main);
+    LOCK(mempool.cs);
+
+    int64_t nTimeStart = GetTimeMicros();
+    const CBlockIndex* pindexPrev = chainActive.Tip();
+    unsigned int nTransactionsUpdated = mempool.GetTransactionsUpdated();
+    std::unique_ptr<CBlockTemplate> pblocktemplate = BlockAssembler(chainparams).CreateNewBlock(CScript() << OP_TRUE, false, fAddTransactions);
+    if (!pblocktemplate)
+        throw std::runtime_error("CreateNewBlock failed");
+
+    // Same reserve for the coinbase as BlockAssembler, it is replaced for every caller
+    setTemplateTxs.clear();
+    setTemplateSpent.clear();
+    nTemplateWeight = 4000;
+    nTemplateSize = 1000;
+    nTemplateSigOpsCost = 400;
+    const CBlock& block = pblocktemplate->block;
+    for (size_t i = 1; i < block.vtx.size(); i++) {
+        const CTransaction& tx = *block.vtx[i];
+        setTemplateTxs.insert(tx.GetHash());
+        for (const CTxIn& txin : tx.vin)
+            setTemplateSpent.insert(txin.prevout);
+        nTemplateWeight += tx.GetWeight();
+        nTemplateSize += tx.GetTotalSize();
+        nTemplateSigOpsCost += pblocktemplate->vTxSigOpsCost[i];
+    }
+
+    ptemplate = std::move(pblocktemplate);
+    pindexTemplatePrev = pindexPrev;
+    fTemplateFull = fAddTransactions;
+    nTemplateSequence++;
+    if (fAddTransactions) {
+        nTransactionsUpdatedLast = nTransactionsUpdated;
+        nTimeLastRebuild = GetTime();
+    }
+    LogPrint("bench", "%s: rebuilt %s block template at height %d in %.2fms\n", __func__, fAddTransactions ? "full" : "empty", pindexPrev->nHeight + 1, 0.001 * (GetTimeMicros() - nTimeStart));
+}
+
+void CBlockTemplateEngine::AddTransactions(const std::vector<uint256>& vHashes)
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(mempool.cs);
+
+    const BlockAssembler assembler(chainparams);
+    const int nHeight = pindexTemplatePrev->nHeight + 1;
+    const int64_t nLockTimeCutoff = (STANDARD_LOCKTIME_VERIFY_FLAGS & LOCKTIME_MEDIAN_TIME_PAST)
+                                    ? pindexTemplatePrev->GetMedianTimePast()
+                                    : ptemplate->block.GetBlockTime();
+
+    std::shared_ptr<CBlockTemplate> pblocktemplate;
+    CAmount nFees = 0;
+    for (const uint256& hash : vHashes) {
+        if (setTemplateTxs.count(hash))
+            continue;
+        CTxMemPool::txiter it = mempool.mapTx.find(hash);
+        if (it == mempool.mapTx.end())
+            continue;
+        const CTransaction& tx = it->GetTx();
+        if (tx.HasWitness() || !IsFinalTx(tx, nHeight, nLockTimeCutoff))
+            continue;
+        if (it->GetModifiedFee() < assembler.GetBlockMinFeeRate().GetFee(it->GetTxSize()))
+            continue;
+
+        // Unconfirmed parents must already be in the template, and nothing in it may spend the same outputs
+        bool fCanAdd = true;
+        for (const CTxIn& txin : tx.vin) {
+            if (setTemplateSpent.count(txin.prevout) || (mempool.exists(txin.prevout.hash) && !setTemplateTxs.count(txin.prevout.hash))) {
+                fCanAdd = false;
+                break;
+            }
+        }
+        if (!fCanAdd)
+            continue;
+
+        uint64_t nTxSize = tx.GetTotalSize();
+        if (nTemplateWeight + it->GetTxWeight() >= assembler.GetBlockMaxWeight() ||
+            nTemplateSize + nTxSize >= assembler.GetBlockMaxSize() ||
+            nTemplateSigOpsCost + it->GetSigOpCost() >= MAX_BLOCK_SIGOPS_COST)
+            continue;
+
+        if (!pblocktemplate)
+            pblocktemplate = std::make_shared<CBlockTemplate>(*ptemplate);
+        pblocktemplate->block.vtx.push_back(it->GetSharedTx());
+        pblocktemplate->vTxFees.push_back(it->GetFee());
+        pblocktemplate->vTxSigOpsCost.push_back(it->GetSigOpCost());
+        nFees += it->GetFee();
+
+        setTemplateTxs.insert(hash);
+        for (const CTxIn& txin : tx.vin)
+            setTemplateSpent.insert(txin.prevout);
+        nTemplateWeight += it->GetTxWeight();
+        nTemplateSize += nTxSize;
+        nTemplateSigOpsCost += it->GetSigOpCost();
+    }
+    if (!pblocktemplate)
+        return;
+
+    CMutableTransaction coinbaseTx(*pblocktemplate->block.vtx[0]);
+    coinbaseTx.vout[0].nValue += nFees;
+    pblocktemplate->block.vtx[0] = MakeTransactionRef(std::move(coinbaseTx));
+    pblocktemplate->vTxFees[0] -= nFees;
+
+    // Transactions are only checked against the template's own spends here, so validate the result
+    // like BlockAssembler does, and start over from the mempool if it does not hold up.
+    CValidationState state;
+    if (!TestBlockValidity(state, chainparams, pblocktemplate->block, chainActive.Tip(), false, false)) {
+        LogPrintf("%s: TestBlockValidity failed: %s, rebuilding block template\n", __func__, FormatStateMessage(state));
+        Rebuild();
+        return;
+    }
+    ptemplate = std::move(pblocktemplate);
+    nTemplateSequence++;
+}
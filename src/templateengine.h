@@ -0,0 +1,106 @@
+// Copyright (c) 2026 The Bunkercoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TEMPLATEENGINE_H
+#define BITCOIN_TEMPLATEENGINE_H
+
+#include "amount.h"
+#include "miner.h"
+#include "primitives/transaction.h"
+#include "script/script.h"
+#include "uint256.h"
+#include "validationinterface.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+class CChainParams;
+
+/** Seconds after which a template is rebuilt from scratch if the mempool changed */
+static const int64_t TEMPLATE_REBUILD_INTERVAL = 60;
+
+/**
+ * Keeps a block template for the current tip up to date in the background,
+ * so that mining RPCs can hand out templates without assembling a block
+ * themselves.
+ *
+ * When the tip changes, a coinbase-only template is made right away on the
+ * thread that connected the block, so miners can switch to the new parent
+ * without waiting for transaction selection. The full template is then
+ * rebuilt with BlockAssembler on the update thread. It is also rebuilt every
+ * TEMPLATE_REBUILD_INTERVAL seconds while the mempool changes; in between,
+ * transactions accepted to the mempool are appended to it as long as their
+ * unconfirmed parents are already in it and they fit. Both kinds of new
+ * template are announced through the NewBlockTemplate signal.
+ *
+ * The engine stays idle until the first template is requested.
+ */
+class CBlockTemplateEngine : public CValidationInterface
+{
+public:
+    CBlockTemplateEngine(const CChainParams& chainparamsIn);
+    ~CBlockTemplateEngine();
+
+    void Start();
+    void Stop();
+
+    /**
+     * Copy of the template for the current tip, paying the coinbase to
+     * scriptPubKeyIn. Builds the template first if none is ready for the
+     * current tip. Throws like BlockAssembler::CreateNewBlock.
+     */
+    std::unique_ptr<CBlockTemplate> GetTemplate(const CScript& scriptPubKeyIn);
+
+    /** Increases whenever the template changes */
+    uint64_t GetTemplateSequence() const { return nTemplateSequence; }
+
+protected:
+    virtual void UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload);
+    virtual void SyncTransaction(const CTransaction &tx, const CBlockIndex *pindex, int posInBlock);
+
+private:
+    void ThreadUpdate();
+    /** Build the template from scratch, coinbase-only unless fAddTransactions. Requires cs_main. */
+    void Rebuild(bool fAddTransactions = true);
+    /**
+     * Append mempool transactions to the template, and check the result with
+     * TestBlockValidity. Rebuilds the template if that fails. Requires cs_main
+     * and mempool.cs.
+     */
+    void AddTransactions(const std::vector<uint256>& vHashes);
+
+    const CChainParams& chainparams;
+
+    // Template and its resource usage, protected by cs_main
+    std::shared_ptr<const CBlockTemplate> ptemplate;
+    const CBlockIndex* pindexTemplatePrev;
+    bool fTemplateFull;
+    std::set<uint256> setTemplateTxs;
+    std::set<COutPoint> setTemplateSpent;
+    uint64_t nTemplateWeight;
+    uint64_t nTemplateSize;
+    int64_t nTemplateSigOpsCost;
+    std::atomic<unsigned int> nTransactionsUpdatedLast;
+    std::atomic<int64_t> nTimeLastRebuild;
+    std::atomic<uint64_t> nTemplateSequence;
+
+    // Events for the update thread
+    std::mutex cs;
+    std::condition_variable cond;
+    bool fRequestShutdown;
+    bool fTipChanged;
+    std::vector<uint256> vQueuedTxs;
+    std::atomic<bool> fActive;
+    std::thread threadUpdate;
+};
+
+/** The template engine, if running */
+extern std::unique_ptr<CBlockTemplateEngine> g_templateEngine;
+
+#endif // BITCOIN_TEMPLATEENGINE_H
@@ -0,0 +1,60 @@
+// Copyright (c) 2026 The Bunkercoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "net_processing.h"
+#include "validation.h"
+
+#include "test/test_bitcoin.h"
+
+#include <limits>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockdownload_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(blocks_in_transit_limit)
+{
+    // Without measurements the fixed limit applies
+    BOOST_CHECK_EQUAL(GetBlocksInTransitLimit(0, 0, 100000), MAX_BLOCKS_IN_TRANSIT_PER_PEER);
+    BOOST_CHECK_EQUAL(GetBlocksInTransitLimit(1000000, 0, 0), MAX_BLOCKS_IN_TRANSIT_PER_PEER);
+
+    // 1MB/s with 100kB blocks: 100ms ping plus 2s of queued blocks
+    BOOST_CHECK_EQUAL(GetBlocksInTransitLimit(1000000, 100000, 100000), 21);
+    // A peer that never answered a ping is sized by the queue target alone
+    BOOST_CHECK_EQUAL(GetBlocksInTransitLimit(1000000, std::numeric_limits<int64_t>::max(), 100000), 20);
+
+    // Bounded on both ends
+    BOOST_CHECK_EQUAL(GetBlocksInTransitLimit(1000, 100000, 100000), MIN_BLOCKS_IN_TRANSIT_PER_PEER);
+    BOOST_CHECK_EQUAL(GetBlocksInTransitLimit(1000000000, 100000, 100000), MAX_ADAPTIVE_BLOCKS_IN_TRANSIT_PER_PEER);
+}
+
+BOOST_AUTO_TEST_CASE(block_download_window)
+{
+    BOOST_CHECK_EQUAL(GetBlockDownloadWindow(0), BLOCK_DOWNLOAD_WINDOW);
+    // Large blocks never shrink the window below the default
+    BOOST_CHECK_EQUAL(GetBlockDownloadWindow(1024 * 1024), BLOCK_DOWNLOAD_WINDOW);
+    // Small blocks widen it to span BLOCK_DOWNLOAD_WINDOW_BYTES
+    BOOST_CHECK_EQUAL(GetBlockDownloadWindow(64 * 1024), BLOCK_DOWNLOAD_WINDOW_BYTES / (64 * 1024));
+    BOOST_CHECK_EQUAL(GetBlockDownloadWindow(250), MAX_BLOCK_DOWNLOAD_WINDOW);
+}
+
+BOOST_AUTO_TEST_CASE(block_stalling_timeout)
+{
+    std::deque<int64_t> vSamples;
+    BOOST_CHECK_EQUAL(GetBlockStallingTimeout(vSamples), (int64_t)BLOCK_STALLING_TIMEOUT * 1000000);
+    vSamples.push_back(100000);
+    BOOST_CHECK_EQUAL(GetBlockStallingTimeout(vSamples), (int64_t)BLOCK_STALLING_TIMEOUT * 1000000);
+
+    // A slow peer gets twice its fastest recent delivery
+    vSamples.assign(1, 3 * 1000000);
+    vSamples.push_back(2 * 1000000);
+    vSamples.push_back(3500000);
+    BOOST_CHECK_EQUAL(GetBlockStallingTimeout(vSamples), 4 * 1000000);
+
+    // Delivering slowly on purpose buys no more than the fixed ceiling
+    vSamples.assign(BLOCK_STALLING_LATENCY_SAMPLES, 1000 * 1000000);
+    BOOST_CHECK_EQUAL(GetBlockStallingTimeout(vSamples), (int64_t)BLOCK_STALLING_TIMEOUT_MAX * 1000000);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -391,4 +391,43 @@ BOOST_AUTO_TEST_CASE(cuckoocache_generations)
     test_cache_generations<CuckooCache::cache<uint256, uint256Hasher>>();
 }
 
+/* Test that for_each visits exactly the elements in the cache that are not
+ * erased, so that a cache copied through it keeps all its hits.
+ */
+BOOST_AUTO_TEST_CASE(cuckoocache_for_each)
+{
+    insecure_rand = FastRandomContext(true);
+    CuckooCache::cache<uint256, uint256Hasher> cc{};
+    cc.setup_bytes(1 << 20);
+    // Fewer elements than an epoch holds, so that none of them are aged out
+    std::vector<uint256> hashes(10000);
+    for (uint256& h : hashes) {
+        insecure_GetRandHash(h);
+        cc.insert(h);
+    }
+    for (size_t i = 0; i < hashes.size(); i += 2)
+        cc.contains(hashes[i], true);
+
+    std::vector<uint256> visited;
+    cc.for_each([&visited](const uint256& h) { visited.push_back(h); });
+    std::sort(visited.begin(), visited.end());
+    BOOST_CHECK(std::adjacent_find(visited.begin(), visited.end()) == visited.end());
+    BOOST_CHECK_EQUAL(cc.count(), visited.size());
+
+    CuckooCache::cache<uint256, uint256Hasher> copy{};
+    copy.setup_bytes(1 << 20);
+    for (const uint256& h : visited)
+        copy.insert(h);
+    size_t nExpected = 0;
+    for (size_t i = 0; i < hashes.size(); i++) {
+        bool fVisited = std::binary_search(visited.begin(), visited.end(), hashes[i]);
+        // Erased elements are skipped, all others are still there
+        BOOST_CHECK_EQUAL(fVisited, i % 2 == 1 && cc.contains(hashes[i], false));
+        BOOST_CHECK_EQUAL(copy.contains(hashes[i], false), fVisited);
+        nExpected += fVisited;
+    }
+    BOOST_CHECK_EQUAL(visited.size(), nExpected);
+    BOOST_CHECK(nExpected > hashes.size() / 3);
+}
+
 BOOST_AUTO_TEST_SUITE_END();
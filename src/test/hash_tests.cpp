@@ -105,6 +105,18 @@ BOOST_AUTO_TEST_CASE(siphash)
 
     BOOST_CHECK_EQUAL(SipHashUint256(0x0706050403020100ULL, 0x0F0E0D0C0B0A0908ULL, uint256S("1f1e1d1c1b1a191817161514131211100f0e0d0c0b0a09080706050403020100")), 0x7127512f72f27cceull);
 
+    // SipHashUint256Extra matches hashing the 36 bytes one at a time
+    uint256 val = uint256S("1f1e1d1c1b1a191817161514131211100f0e0d0c0b0a09080706050403020100");
+    for (uint32_t extra : {0U, 1U, 0x23222120U, 0xFFFFFFFFU}) {
+        CSipHasher hasherExtra(0x0706050403020100ULL, 0x0F0E0D0C0B0A0908ULL);
+        hasherExtra.Write(val.begin(), 32);
+        for (int i = 0; i < 4; i++) {
+            unsigned char c = extra >> (8 * i);
+            hasherExtra.Write(&c, 1);
+        }
+        BOOST_CHECK_EQUAL(SipHashUint256Extra(0x0706050403020100ULL, 0x0F0E0D0C0B0A0908ULL, val, extra), hasherExtra.Finalize());
+    }
+
     // Check test vectors from spec, one byte at a time
     CSipHasher hasher2(0x0706050403020100ULL, 0x0F0E0D0C0B0A0908ULL);
     for (uint8_t x=0; x<ARRAYLEN(siphash_4_2_testvec); ++x)
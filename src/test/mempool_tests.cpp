@@ -430,6 +430,145 @@ BOOST_AUTO_TEST_CASE(MempoolAncestorIndexingTest)
 }
 
 
+BOOST_AUTO_TEST_CASE(MempoolPriorityIndexingTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+    TestMemPoolEntryHelper entry;
+    entry.Height(1);
+
+    /* highest priority at entry, little value to age */
+    CMutableTransaction tx1 = CMutableTransaction();
+    tx1.vout.resize(1);
+    tx1.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx1.vout[0].nValue = 1 * COIN;
+    pool.addUnchecked(tx1.GetHash(), entry.Priority(100.0).FromTx(tx1, &pool));
+
+    /* no priority at entry, but ages fastest */
+    CMutableTransaction tx2 = CMutableTransaction();
+    tx2.vout.resize(1);
+    tx2.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx2.vout[0].nValue = 100 * COIN;
+    pool.addUnchecked(tx2.GetHash(), entry.Priority(0.0).FromTx(tx2, &pool));
+
+    CMutableTransaction tx3 = CMutableTransaction();
+    tx3.vout.resize(1);
+    tx3.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx3.vout[0].nValue = 1 * COIN + 1;
+    pool.addUnchecked(tx3.GetHash(), entry.Priority(50.0).FromTx(tx3, &pool));
+
+    std::vector<std::string> sortedOrder;
+    sortedOrder.resize(3);
+    sortedOrder[0] = tx1.GetHash().ToString();
+    sortedOrder[1] = tx3.GetHash().ToString();
+    sortedOrder[2] = tx2.GetHash().ToString();
+    CheckSort<priority_score>(pool, sortedOrder);
+
+    /* One block later tx2 has aged past the others */
+    pool.UpdatePriorityHeight(2);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(tx2.GetHash())->GetCachedPriority(), pool.mapTx.find(tx2.GetHash())->GetPriority(2));
+    sortedOrder[0] = tx2.GetHash().ToString();
+    sortedOrder[1] = tx1.GetHash().ToString();
+    sortedOrder[2] = tx3.GetHash().ToString();
+    CheckSort<priority_score>(pool, sortedOrder);
+
+    /* Prioritisation moves an entry within the index */
+    pool.PrioritiseTransaction(tx3.GetHash(), tx3.GetHash().ToString(), 1e10, 0);
+    sortedOrder[0] = tx3.GetHash().ToString();
+    sortedOrder[1] = tx2.GetHash().ToString();
+    sortedOrder[2] = tx1.GetHash().ToString();
+    CheckSort<priority_score>(pool, sortedOrder);
+
+    /* New entries are keyed at the current priority height */
+    CMutableTransaction tx4 = CMutableTransaction();
+    tx4.vout.resize(1);
+    tx4.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx4.vout[0].nValue = 1 * COIN + 2;
+    pool.addUnchecked(tx4.GetHash(), entry.Priority(0.0).FromTx(tx4, &pool));
+    BOOST_CHECK_EQUAL(pool.mapTx.find(tx4.GetHash())->GetCachedPriority(), pool.mapTx.find(tx4.GetHash())->GetPriority(2));
+    sortedOrder.push_back(tx4.GetHash().ToString());
+    CheckSort<priority_score>(pool, sortedOrder);
+}
+
+static std::set<uint256> LinkHashes(const CTxMemPool::linkEntries& links)
+{
+    std::set<uint256> setHashes;
+    BOOST_FOREACH(CTxMemPool::txiter it, links)
+        setHashes.insert(it->GetTx().GetHash());
+    BOOST_CHECK_EQUAL(setHashes.size(), links.size());
+    return setHashes;
+}
+
+BOOST_AUTO_TEST_CASE(MempoolLinksTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+    TestMemPoolEntryHelper entry;
+
+    /* A parent with three children, which are all spent by one transaction */
+    CMutableTransaction txParent;
+    txParent.vin.resize(1);
+    txParent.vin[0].scriptSig = CScript() << OP_11;
+    txParent.vout.resize(3);
+    for (int i = 0; i < 3; i++) {
+        txParent.vout[i].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        txParent.vout[i].nValue = 33000LL;
+    }
+    pool.addUnchecked(txParent.GetHash(), entry.FromTx(txParent));
+
+    CMutableTransaction txChild[3];
+    CMutableTransaction txJoin;
+    txJoin.vin.resize(3);
+    txJoin.vout.resize(1);
+    txJoin.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txJoin.vout[0].nValue = 30000LL;
+    std::set<uint256> setChildren;
+    for (int i = 0; i < 3; i++) {
+        txChild[i].vin.resize(1);
+        txChild[i].vin[0].scriptSig = CScript() << OP_11;
+        txChild[i].vin[0].prevout = COutPoint(txParent.GetHash(), i);
+        txChild[i].vout.resize(1);
+        txChild[i].vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        txChild[i].vout[0].nValue = 11000LL;
+        pool.addUnchecked(txChild[i].GetHash(), entry.FromTx(txChild[i]));
+        setChildren.insert(txChild[i].GetHash());
+        txJoin.vin[i].prevout = COutPoint(txChild[i].GetHash(), 0);
+    }
+    pool.addUnchecked(txJoin.GetHash(), entry.FromTx(txJoin));
+
+    CTxMemPool::txiter itParent = pool.mapTx.find(txParent.GetHash());
+    CTxMemPool::txiter itJoin = pool.mapTx.find(txJoin.GetHash());
+    BOOST_CHECK(pool.GetMemPoolParents(itParent).empty());
+    BOOST_CHECK(LinkHashes(pool.GetMemPoolChildren(itParent)) == setChildren);
+    BOOST_CHECK(LinkHashes(pool.GetMemPoolParents(itJoin)) == setChildren);
+    BOOST_CHECK(pool.GetMemPoolChildren(itJoin).empty());
+    for (int i = 0; i < 3; i++) {
+        CTxMemPool::txiter itChild = pool.mapTx.find(txChild[i].GetHash());
+        BOOST_CHECK_EQUAL(pool.GetMemPoolParents(itChild).size(), 1);
+        BOOST_CHECK(*pool.GetMemPoolParents(itChild).begin() == itParent);
+        BOOST_CHECK_EQUAL(pool.GetMemPoolChildren(itChild).size(), 1);
+        BOOST_CHECK(*pool.GetMemPoolChildren(itChild).begin() == itJoin);
+    }
+
+    /* Removing a child takes the joining transaction with it */
+    pool.removeRecursive(txChild[1]);
+    BOOST_CHECK_EQUAL(pool.size(), 3);
+    setChildren.erase(txChild[1].GetHash());
+    BOOST_CHECK(LinkHashes(pool.GetMemPoolChildren(itParent)) == setChildren);
+    BOOST_CHECK(pool.GetMemPoolChildren(pool.mapTx.find(txChild[0].GetHash())).empty());
+    BOOST_CHECK(pool.GetMemPoolChildren(pool.mapTx.find(txChild[2].GetHash())).empty());
+
+    /* Confirming the parent leaves the children without links */
+    std::vector<CTransactionRef> vtx;
+    vtx.push_back(MakeTransactionRef(txParent));
+    pool.removeForBlock(vtx, 1);
+    BOOST_CHECK_EQUAL(pool.size(), 2);
+    for (int i = 0; i < 3; i += 2) {
+        CTxMemPool::txiter itChild = pool.mapTx.find(txChild[i].GetHash());
+        BOOST_CHECK(pool.GetMemPoolParents(itChild).empty());
+        BOOST_CHECK(pool.GetMemPoolChildren(itChild).empty());
+        BOOST_CHECK_EQUAL(itChild->GetCountWithAncestors(), 1);
+    }
+}
+
 BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
 {
     CTxMemPool pool(CFeeRate(COIN / 1000));
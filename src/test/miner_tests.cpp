@@ -18,9 +18,15 @@
 #include "utilstrencodings.h"
 
 #include "test/test_bitcoin.h"
+#include "test/test_random.h"
+
+#include "arith_uint256.h"
 
 #include <memory>
 
+#include <boost/multi_index_container.hpp>
+#include <boost/multi_index/ordered_index.hpp>
+
 #include <boost/test/unit_test.hpp>
 
 BOOST_FIXTURE_TEST_SUITE(miner_tests, TestingSetup)
@@ -496,4 +502,249 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
     fCheckpointsEnabled = true;
 }
 
+// Reference for CPackageSelector: the selection loop BlockAssembler used
+// before, with modified entries in a boost multi_index.
+namespace {
+
+struct RefModifiedEntry {
+    RefModifiedEntry(CTxMemPool::txiter entry) : iter(entry), nSizeWithAncestors(entry->GetSizeWithAncestors()),
+        nModFeesWithAncestors(entry->GetModFeesWithAncestors()), nSigOpCostWithAncestors(entry->GetSigOpCostWithAncestors()) {}
+
+    CTxMemPool::txiter iter;
+    uint64_t nSizeWithAncestors;
+    CAmount nModFeesWithAncestors;
+    int64_t nSigOpCostWithAncestors;
+};
+
+struct RefCompareIter {
+    bool operator()(const CTxMemPool::txiter& a, const CTxMemPool::txiter& b) const { return &(*a) < &(*b); }
+};
+
+struct RefEntryIter {
+    typedef CTxMemPool::txiter result_type;
+    result_type operator()(const RefModifiedEntry& entry) const { return entry.iter; }
+};
+
+struct RefCompareModifiedEntry {
+    bool operator()(const RefModifiedEntry& a, const RefModifiedEntry& b) const
+    {
+        double f1 = (double)a.nModFeesWithAncestors * b.nSizeWithAncestors;
+        double f2 = (double)b.nModFeesWithAncestors * a.nSizeWithAncestors;
+        if (f1 == f2) {
+            return CTxMemPool::CompareIteratorByHash()(a.iter, b.iter);
+        }
+        return f1 > f2;
+    }
+};
+
+typedef boost::multi_index_container<
+    RefModifiedEntry,
+    boost::multi_index::indexed_by<
+        boost::multi_index::ordered_unique<RefEntryIter, RefCompareIter>,
+        boost::multi_index::ordered_non_unique<
+            boost::multi_index::tag<ancestor_score>,
+            boost::multi_index::identity<RefModifiedEntry>,
+            RefCompareModifiedEntry
+        >
+    >
+> RefModifiedSet;
+
+struct RefUpdateForParent {
+    RefUpdateForParent(CTxMemPool::txiter it) : iter(it) {}
+    void operator()(RefModifiedEntry& e)
+    {
+        e.nModFeesWithAncestors -= iter->GetModifiedFee();
+        e.nSizeWithAncestors -= iter->GetTxSize();
+        e.nSigOpCostWithAncestors -= iter->GetSigOpCost();
+    }
+    CTxMemPool::txiter iter;
+};
+
+// Simple block limits shared by the reference and the selector loop
+struct TestBlockLimits {
+    uint64_t nMaxWeight;
+    uint64_t nWeight;
+    int64_t nSigOpsCost;
+
+    TestBlockLimits(uint64_t nMaxWeightIn) : nMaxWeight(nMaxWeightIn), nWeight(4000), nSigOpsCost(400) {}
+    bool Fits(uint64_t nSize, int64_t nSigOps) const
+    {
+        return nWeight + WITNESS_SCALE_FACTOR * nSize < nMaxWeight && nSigOpsCost + nSigOps < MAX_BLOCK_SIGOPS_COST;
+    }
+    void Add(CTxMemPool::txiter it)
+    {
+        nWeight += it->GetTxWeight();
+        nSigOpsCost += it->GetSigOpCost();
+    }
+};
+
+int RefUpdatePackagesForAdded(CTxMemPool& pool, const CTxMemPool::setEntries& alreadyAdded, RefModifiedSet& mapModifiedTx)
+{
+    int nDescendantsUpdated = 0;
+    BOOST_FOREACH(const CTxMemPool::txiter it, alreadyAdded) {
+        CTxMemPool::setEntries descendants;
+        pool.CalculateDescendants(it, descendants);
+        BOOST_FOREACH(CTxMemPool::txiter desc, descendants) {
+            if (alreadyAdded.count(desc))
+                continue;
+            ++nDescendantsUpdated;
+            RefModifiedSet::iterator mit = mapModifiedTx.find(desc);
+            if (mit == mapModifiedTx.end()) {
+                RefModifiedEntry modEntry(desc);
+                RefUpdateForParent update(it);
+                update(modEntry);
+                mapModifiedTx.insert(modEntry);
+            } else {
+                mapModifiedTx.modify(mit, RefUpdateForParent(it));
+            }
+        }
+    }
+    return nDescendantsUpdated;
+}
+
+int RefSelectPackages(CTxMemPool& pool, TestBlockLimits& limits, const CFeeRate& minFeeRate, std::vector<uint256>& vSelected)
+{
+    RefModifiedSet mapModifiedTx;
+    CTxMemPool::setEntries inBlock, failedTx;
+    int nDescendantsUpdated = 0;
+    CTxMemPool::indexed_transaction_set::index<ancestor_score>::type::iterator mi = pool.mapTx.get<ancestor_score>().begin();
+    while (mi != pool.mapTx.get<ancestor_score>().end() || !mapModifiedTx.empty()) {
+        if (mi != pool.mapTx.get<ancestor_score>().end()) {
+            CTxMemPool::txiter it = pool.mapTx.project<0>(mi);
+            if (mapModifiedTx.count(it) || inBlock.count(it) || failedTx.count(it)) {
+                ++mi;
+                continue;
+            }
+        }
+
+        bool fUsingModified = false;
+        CTxMemPool::txiter iter;
+        RefModifiedSet::index<ancestor_score>::type::iterator modit = mapModifiedTx.get<ancestor_score>().begin();
+        if (mi == pool.mapTx.get<ancestor_score>().end()) {
+            iter = modit->iter;
+            fUsingModified = true;
+        } else {
+            iter = pool.mapTx.project<0>(mi);
+            if (modit != mapModifiedTx.get<ancestor_score>().end() &&
+                    RefCompareModifiedEntry()(*modit, RefModifiedEntry(iter))) {
+                iter = modit->iter;
+                fUsingModified = true;
+            } else {
+                ++mi;
+            }
+        }
+
+        RefModifiedEntry package = fUsingModified ? *modit : RefModifiedEntry(iter);
+        if (package.nModFeesWithAncestors < minFeeRate.GetFee(package.nSizeWithAncestors))
+            break;
+        if (!limits.Fits(package.nSizeWithAncestors, package.nSigOpCostWithAncestors)) {
+            if (fUsingModified) {
+                mapModifiedTx.get<ancestor_score>().erase(modit);
+                failedTx.insert(iter);
+            }
+            continue;
+        }
+
+        CTxMemPool::setEntries ancestors;
+        uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+        std::string dummy;
+        pool.CalculateMemPoolAncestors(*iter, ancestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
+        for (CTxMemPool::setEntries::iterator iit = ancestors.begin(); iit != ancestors.end(); ) {
+            if (inBlock.count(*iit))
+                ancestors.erase(iit++);
+            else
+                iit++;
+        }
+        ancestors.insert(iter);
+
+        std::vector<CTxMemPool::txiter> sortedEntries(ancestors.begin(), ancestors.end());
+        std::sort(sortedEntries.begin(), sortedEntries.end(), CompareTxIterByAncestorCount());
+        BOOST_FOREACH(CTxMemPool::txiter it, sortedEntries) {
+            limits.Add(it);
+            inBlock.insert(it);
+            vSelected.push_back(it->GetTx().GetHash());
+            mapModifiedTx.erase(it);
+        }
+        nDescendantsUpdated += RefUpdatePackagesForAdded(pool, ancestors, mapModifiedTx);
+    }
+    return nDescendantsUpdated;
+}
+
+int SelectPackages(CTxMemPool& pool, TestBlockLimits& limits, const CFeeRate& minFeeRate, std::vector<uint256>& vSelected)
+{
+    CPackageSelector selector(pool);
+    CPackageSelector::Package package;
+    std::vector<CTxMemPool::txiter> vEntries;
+    int nDescendantsUpdated = 0;
+    while (selector.Next(package)) {
+        if (package.nModFeesWithAncestors < minFeeRate.GetFee(package.nSizeWithAncestors))
+            break;
+        if (!limits.Fits(package.nSizeWithAncestors, package.nSigOpCostWithAncestors)) {
+            selector.Failed();
+            continue;
+        }
+        selector.GetPackageEntries(vEntries);
+        BOOST_FOREACH(CTxMemPool::txiter it, vEntries) {
+            limits.Add(it);
+            vSelected.push_back(it->GetTx().GetHash());
+        }
+        nDescendantsUpdated += selector.Added(vEntries);
+    }
+    return nDescendantsUpdated;
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE(PackageSelector_matches_reference)
+{
+    seed_insecure_rand(true);
+    TestMemPoolEntryHelper entry;
+    const CFeeRate minFeeRate(1000);
+
+    for (int nRound = 0; nRound < 10; nRound++) {
+        CTxMemPool pool(CFeeRate(0));
+        LOCK(pool.cs);
+
+        // Random graph of transactions spending confirmed outputs and outputs of earlier ones
+        std::vector<COutPoint> vUnspent;
+        for (int i = 0; i < 400; i++) {
+            CMutableTransaction tx;
+            int nInputs = 1 + insecure_rand() % 3;
+            for (int j = 0; j < nInputs; j++) {
+                CTxIn txin;
+                if (!vUnspent.empty() && insecure_rand() % 3) {
+                    size_t n = insecure_rand() % vUnspent.size();
+                    txin.prevout = vUnspent[n];
+                    vUnspent[n] = vUnspent.back();
+                    vUnspent.pop_back();
+                } else {
+                    txin.prevout = COutPoint(ArithToUint256(arith_uint256(nRound * 10000 + i * 10 + j + 1)), 0);
+                }
+                txin.scriptSig = CScript() << std::vector<unsigned char>(insecure_rand() % 200, 0x42);
+                tx.vin.push_back(txin);
+            }
+            tx.vout.resize(2);
+            for (int j = 0; j < 2; j++) {
+                tx.vout[j].scriptPubKey = CScript() << OP_TRUE;
+                tx.vout[j].nValue = COIN;
+            }
+            // Few distinct fees, so that fee rates tie often
+            CAmount nFee = (insecure_rand() % 8) * 500;
+            pool.addUnchecked(tx.GetHash(), entry.Fee(nFee).SigOpsCost(insecure_rand() % 40).FromTx(tx));
+            for (int j = 0; j < 2; j++)
+                vUnspent.push_back(COutPoint(tx.GetHash(), j));
+        }
+
+        // From small blocks, where many packages fail and modified entries are retried, to the whole pool
+        const uint64_t nMaxWeight = 4000 + 1000 * WITNESS_SCALE_FACTOR * (1 << nRound);
+        TestBlockLimits limitsRef(nMaxWeight), limits(nMaxWeight);
+        std::vector<uint256> vSelectedRef, vSelected;
+        int nUpdatedRef = RefSelectPackages(pool, limitsRef, minFeeRate, vSelectedRef);
+        int nUpdated = SelectPackages(pool, limits, minFeeRate, vSelected);
+        BOOST_CHECK(vSelected == vSelectedRef);
+        BOOST_CHECK_EQUAL(nUpdated, nUpdatedRef);
+        BOOST_CHECK(!vSelected.empty());
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
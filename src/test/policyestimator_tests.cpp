@@ -2,8 +2,10 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "clientversion.h"
 #include "policy/policy.h"
 #include "policy/fees.h"
+#include "streams.h"
 #include "txmempool.h"
 #include "uint256.h"
 #include "util.h"
@@ -197,4 +199,125 @@ BOOST_AUTO_TEST_CASE(BlockPolicyEstimates)
     }
 }
 
+BOOST_AUTO_TEST_CASE(BlockPolicyEstimatesPersist)
+{
+    CTxMemPool mpool(CFeeRate(1000));
+    TestMemPoolEntryHelper entry;
+    CAmount basefee(2000);
+    std::vector<uint256> txHashes[10];
+
+    CScript garbage;
+    for (unsigned int i = 0; i < 128; i++)
+        garbage.push_back('X');
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = garbage;
+    tx.vout.resize(1);
+    tx.vout[0].nValue=0LL;
+
+    // Same pattern as above, but for long enough that the lazily applied decay gets renormalized
+    std::vector<CTransactionRef> block;
+    int blocknum = 0;
+    while (blocknum < 14000) {
+        for (int j = 0; j < 10; j++) {
+            tx.vin[0].prevout.n = 100*blocknum+j;
+            uint256 hash = tx.GetHash();
+            mpool.addUnchecked(hash, entry.Fee(basefee * (j+1)).Time(GetTime()).Priority(0).Height(blocknum).FromTx(tx, &mpool));
+            txHashes[j].push_back(hash);
+        }
+        for (int h = 0; h <= blocknum%10; h++) {
+            for (const uint256& hash : txHashes[9-h]) {
+                CTransactionRef ptx = mpool.get(hash);
+                if (ptx)
+                    block.push_back(ptx);
+            }
+            txHashes[9-h].clear();
+        }
+        mpool.removeForBlock(block, ++blocknum);
+        block.clear();
+    }
+    // Nothing may be left in the mempool, its counts are not saved
+    for (int j = 0; j < 10; j++) {
+        for (const uint256& hash : txHashes[j])
+            block.push_back(mpool.get(hash));
+    }
+    mpool.removeForBlock(block, ++blocknum);
+    BOOST_CHECK_EQUAL(mpool.size(), 0U);
+
+    CAutoFile file(tmpfile(), SER_DISK, CLIENT_VERSION);
+    BOOST_CHECK(mpool.WriteFeeEstimates(file));
+    rewind(file.Get());
+    CTxMemPool mpool2(CFeeRate(1000));
+    BOOST_CHECK(mpool2.ReadFeeEstimates(file));
+
+    BOOST_CHECK(mpool.estimateFee(2).GetFeePerK() > 0);
+    for (int i = 1; i <= (int)MAX_BLOCK_CONFIRMS; i++) {
+        CAmount nFee = mpool.estimateFee(i).GetFeePerK();
+        CAmount nFee2 = mpool2.estimateFee(i).GetFeePerK();
+        BOOST_CHECK(nFee2 >= nFee - 1 && nFee2 <= nFee + 1);
+    }
+
+    // Unknown formats are rejected without touching the estimates
+    CAutoFile file2(tmpfile(), SER_DISK, CLIENT_VERSION);
+    file2 << FEE_ESTIMATES_FORMAT_CLIENT_VERSION << CLIENT_VERSION << (FEE_ESTIMATES_FORMAT - 1);
+    rewind(file2.Get());
+    BOOST_CHECK(!mpool2.ReadFeeEstimates(file2));
+    BOOST_CHECK(mpool2.estimateFee(2) == mpool.estimateFee(2));
+
+    // Files requiring a newer client are skipped
+    CAutoFile file3(tmpfile(), SER_DISK, CLIENT_VERSION);
+    file3 << (std::max(CLIENT_VERSION, FEE_ESTIMATES_FORMAT_CLIENT_VERSION) + 1) << CLIENT_VERSION << FEE_ESTIMATES_FORMAT;
+    rewind(file3.Get());
+    BOOST_CHECK(!mpool2.ReadFeeEstimates(file3));
+    BOOST_CHECK(mpool2.estimateFee(2) == mpool.estimateFee(2));
+}
+
+BOOST_AUTO_TEST_CASE(BlockPolicyEstimatesLegacyFile)
+{
+    // Dense layout written by clients up to and including the 1.15.4 release
+    std::vector<double> buckets;
+    buckets.push_back(1000);
+    buckets.push_back(5000);
+    buckets.push_back(INF_FEERATE);
+    std::vector<double> avg(3), txCtAvg(3);
+    std::vector<std::vector<double> > confAvg(MAX_BLOCK_CONFIRMS, std::vector<double>(3));
+    // 1000 txs paying 900 per kB, of which 100 more confirm with every block
+    avg[0] = 900 * 1000;
+    txCtAvg[0] = 1000;
+    // 1000 txs paying 4000 per kB, 100 confirming in one block and 990 in two
+    avg[1] = 4000 * 1000;
+    txCtAvg[1] = 1000;
+    for (unsigned int i = 0; i < MAX_BLOCK_CONFIRMS; i++) {
+        confAvg[i][0] = std::min(100 * (i + 1), 1000U);
+        confAvg[i][1] = i == 0 ? 100 : i == 1 ? 990 : 1000;
+    }
+
+    CAutoFile file(tmpfile(), SER_DISK, CLIENT_VERSION);
+    file << 139900 << CLIENT_VERSION;
+    file << 1000; // best seen height
+    file << DEFAULT_DECAY << buckets << avg << txCtAvg << confAvg;
+    rewind(file.Get());
+    CTxMemPool mpool(CFeeRate(1000));
+    BOOST_CHECK(mpool.ReadFeeEstimates(file));
+
+    // Confirmation counts were cumulative, 9 blocks only confirm 90% of the cheaper txs
+    BOOST_CHECK_EQUAL(mpool.estimateFee(2).GetFeePerK(), 4000);
+    BOOST_CHECK_EQUAL(mpool.estimateFee(9).GetFeePerK(), 4000);
+    BOOST_CHECK_EQUAL(mpool.estimateFee(10).GetFeePerK(), 900);
+
+    // Written back in the new layout, which reads the same
+    CAutoFile file2(tmpfile(), SER_DISK, CLIENT_VERSION);
+    BOOST_CHECK(mpool.WriteFeeEstimates(file2));
+    rewind(file2.Get());
+    int nVersionRequired, nVersionThatWrote, nFormat;
+    file2 >> nVersionRequired >> nVersionThatWrote >> nFormat;
+    BOOST_CHECK_EQUAL(nVersionRequired, FEE_ESTIMATES_FORMAT_CLIENT_VERSION);
+    BOOST_CHECK_EQUAL(nFormat, FEE_ESTIMATES_FORMAT);
+    rewind(file2.Get());
+    CTxMemPool mpool2(CFeeRate(1000));
+    BOOST_CHECK(mpool2.ReadFeeEstimates(file2));
+    for (int i = 1; i <= (int)MAX_BLOCK_CONFIRMS; i++)
+        BOOST_CHECK(mpool2.estimateFee(i) == mpool.estimateFee(i));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
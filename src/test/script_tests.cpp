@@ -13,6 +13,7 @@
 #include "util.h"
 #include "utilstrencodings.h"
 #include "test/test_bitcoin.h"
+#include "test/test_random.h"
 #include "rpc/server.h"
 
 #if defined(HAVE_CONSENSUS_LIB)
@@ -1443,4 +1444,118 @@ BOOST_AUTO_TEST_CASE(script_FindAndDelete)
     BOOST_CHECK(s == expect);
 }
 
+static std::vector<unsigned char> SignTemplateInput(const CKey& key, const CScript& scriptCode, const CMutableTransaction& txSpend)
+{
+    std::vector<unsigned char> vchSig;
+    BOOST_CHECK(key.Sign(SignatureHash(scriptCode, txSpend, 0, SIGHASH_ALL, 0, SIGVERSION_BASE), vchSig));
+    vchSig.push_back(static_cast<unsigned char>(SIGHASH_ALL));
+    return vchSig;
+}
+
+BOOST_AUTO_TEST_CASE(script_standard_template_fastpath)
+{
+    // VerifyScript verifies standard templates without the interpreter; compare
+    // it with the interpreter for valid spends and randomly broken ones.
+    static const unsigned int vFlags[] = {
+        SCRIPT_VERIFY_P2SH, SCRIPT_VERIFY_STRICTENC, SCRIPT_VERIFY_DERSIG, SCRIPT_VERIFY_LOW_S,
+        SCRIPT_VERIFY_SIGPUSHONLY, SCRIPT_VERIFY_MINIMALDATA, SCRIPT_VERIFY_NULLDUMMY,
+        SCRIPT_VERIFY_CLEANSTACK, SCRIPT_VERIFY_WITNESS, SCRIPT_VERIFY_NULLFAIL,
+    };
+    KeyData keys;
+    CScript scriptMultisig = CScript() << OP_1 << ToByteVector(keys.pubkey0C) << ToByteVector(keys.pubkey1C) << OP_2 << OP_CHECKMULTISIG;
+    CScript scriptRedeemMultisig = CScript() << OP_2 << ToByteVector(keys.pubkey0) << ToByteVector(keys.pubkey1C) << ToByteVector(keys.pubkey2C) << OP_3 << OP_CHECKMULTISIG;
+    CScript scriptRedeemP2PKH = GetScriptForDestination(keys.pubkey2C.GetID());
+
+    std::vector<CScript> vScriptPubKeys;
+    vScriptPubKeys.push_back(CScript() << ToByteVector(keys.pubkey0) << OP_CHECKSIG);
+    vScriptPubKeys.push_back(GetScriptForDestination(keys.pubkey1C.GetID()));
+    vScriptPubKeys.push_back(scriptMultisig);
+    vScriptPubKeys.push_back(GetScriptForDestination(CScriptID(scriptRedeemMultisig)));
+    vScriptPubKeys.push_back(GetScriptForDestination(CScriptID(scriptRedeemP2PKH)));
+
+    seed_insecure_rand(true);
+    for (size_t n = 0; n < vScriptPubKeys.size(); n++) {
+        const CScript& scriptPubKey = vScriptPubKeys[n];
+        CMutableTransaction txCredit = BuildCreditingTransaction(scriptPubKey);
+        CMutableTransaction txSpend = BuildSpendingTransaction(CScript(), CScriptWitness(), txCredit);
+
+        std::vector<std::vector<unsigned char> > vPushes;
+        if (n == 0) {
+            vPushes.push_back(SignTemplateInput(keys.key0, scriptPubKey, txSpend));
+        } else if (n == 1) {
+            vPushes.push_back(SignTemplateInput(keys.key1C, scriptPubKey, txSpend));
+            vPushes.push_back(ToByteVector(keys.pubkey1C));
+        } else if (n == 2) {
+            vPushes.push_back(std::vector<unsigned char>());
+            vPushes.push_back(SignTemplateInput(keys.key1C, scriptPubKey, txSpend));
+        } else if (n == 3) {
+            // Skips the second key
+            vPushes.push_back(std::vector<unsigned char>());
+            vPushes.push_back(SignTemplateInput(keys.key0, scriptRedeemMultisig, txSpend));
+            vPushes.push_back(SignTemplateInput(keys.key2C, scriptRedeemMultisig, txSpend));
+            vPushes.push_back(std::vector<unsigned char>(scriptRedeemMultisig.begin(), scriptRedeemMultisig.end()));
+        } else {
+            vPushes.push_back(SignTemplateInput(keys.key2C, scriptRedeemP2PKH, txSpend));
+            vPushes.push_back(ToByteVector(keys.pubkey2C));
+            vPushes.push_back(std::vector<unsigned char>(scriptRedeemP2PKH.begin(), scriptRedeemP2PKH.end()));
+        }
+
+        for (int i = 0; i < 400; i++) {
+            unsigned int flags = 0;
+            for (unsigned int flag : vFlags) {
+                if (insecure_rand() % 2)
+                    flags |= flag;
+            }
+            // Flag combinations the interpreter asserts on
+            if (flags & SCRIPT_VERIFY_CLEANSTACK)
+                flags |= SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_WITNESS;
+            if (flags & SCRIPT_VERIFY_WITNESS)
+                flags |= SCRIPT_VERIFY_P2SH;
+
+            std::vector<std::vector<unsigned char> > vMutated(vPushes);
+            int nMutation = i == 0 ? 0 : insecure_rand() % 8;
+            std::vector<unsigned char>& vchElement = vMutated[insecure_rand() % vMutated.size()];
+            switch (nMutation) {
+            case 1: // Corrupt an element
+                if (!vchElement.empty())
+                    vchElement[insecure_rand() % vchElement.size()] ^= 1 << (insecure_rand() % 8);
+                break;
+            case 2: // Drop an element
+                vMutated.erase(vMutated.begin() + insecure_rand() % vMutated.size());
+                break;
+            case 3: // Extra element
+                vMutated.insert(vMutated.begin() + insecure_rand() % (vMutated.size() + 1), std::vector<unsigned char>(insecure_rand() % 3, 1));
+                break;
+            case 4: // Swap two elements
+                std::swap(vchElement, vMutated[insecure_rand() % vMutated.size()]);
+                break;
+            case 5: // Empty an element
+                vchElement.clear();
+                break;
+            case 6: // Another hash type
+                if (!vchElement.empty())
+                    vchElement.back() = insecure_rand() % 0x100;
+                break;
+            }
+            CScript scriptSig;
+            for (const std::vector<unsigned char>& vch : vMutated)
+                scriptSig << vch;
+            if (nMutation == 7 && !scriptSig.empty()) {
+                // Break the encoding of the script itself
+                scriptSig[insecure_rand() % scriptSig.size()] = insecure_rand() % 0x100;
+            }
+            txSpend.vin[0].scriptSig = scriptSig;
+
+            MutableTransactionSignatureChecker checker(&txSpend, 0, txCredit.vout[0].nValue);
+            ScriptError err, errInterpreted;
+            bool fValid = VerifyScript(scriptSig, scriptPubKey, NULL, flags, checker, &err);
+            bool fValidInterpreted = VerifyScriptInterpreted(scriptSig, scriptPubKey, NULL, flags, checker, &errInterpreted);
+            BOOST_CHECK_EQUAL(fValid, fValidInterpreted);
+            BOOST_CHECK_EQUAL(ScriptErrorString(err), ScriptErrorString(errInterpreted));
+            if (nMutation == 0)
+                BOOST_CHECK_MESSAGE(fValid, "template " << n << " flags " << flags << ": " << ScriptErrorString(err));
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,86 @@
+// Copyright (c) 2026 The Bunkercoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "clientversion.h"
+#include "crypto/sha256.h"
+#include "key.h"
+#include "primitives/transaction.h"
+#include "random.h"
+#include "script/sigcache.h"
+#include "streams.h"
+#include "test/test_bitcoin.h"
+#include "util.h"
+
+#include <algorithm>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(sigcache_tests, TestingSetup)
+
+static uint256 SignatureCacheEntry(const uint256& nonce, const uint256& sighash, const CPubKey& pubkey, const std::vector<unsigned char>& vchSig)
+{
+    uint256 entry;
+    CSHA256().Write(nonce.begin(), 32).Write(sighash.begin(), 32).Write(&pubkey[0], pubkey.size()).Write(&vchSig[0], vchSig.size()).Finalize(entry.begin());
+    return entry;
+}
+
+BOOST_AUTO_TEST_CASE(sigcache_dump_load)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CPubKey pubkey = key.GetPubKey();
+    uint256 sighash = GetRandHash();
+    std::vector<unsigned char> vchSig;
+    BOOST_CHECK(key.Sign(sighash, vchSig));
+    // A signature for another hash, which only passes if the cache says so
+    std::vector<unsigned char> vchBogus;
+    BOOST_CHECK(key.Sign(GetRandHash(), vchBogus));
+
+    CTransaction tx;
+    PrecomputedTransactionData txdata(tx);
+    CachingTransactionSignatureChecker checkerStore(&tx, 0, 0, true, txdata);
+    CachingTransactionSignatureChecker checker(&tx, 0, 0, false, txdata);
+
+    BOOST_CHECK(checkerStore.VerifySignature(vchSig, pubkey, sighash));
+    BOOST_CHECK(!checker.VerifySignature(vchBogus, pubkey, sighash));
+    BOOST_CHECK(GetSignatureCacheStats().nEntries >= 1);
+
+    // The dump holds the nonce and the entry of the verified signature
+    DumpSignatureCache();
+    uint64_t nVersion;
+    uint256 nonce;
+    std::vector<uint256> vEntries;
+    {
+        CAutoFile file(fopen((GetDataDir() / "sigcache.dat").string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
+        BOOST_REQUIRE(!file.IsNull());
+        file >> nVersion >> nonce >> vEntries;
+    }
+    BOOST_CHECK_EQUAL(vEntries.size(), GetSignatureCacheStats().nEntries);
+    BOOST_CHECK(std::find(vEntries.begin(), vEntries.end(), SignatureCacheEntry(nonce, sighash, pubkey, vchSig)) != vEntries.end());
+
+    // Loading switches to the persisted nonce and makes its entries hit
+    uint256 nonceNew = GetRandHash();
+    vEntries.clear();
+    vEntries.push_back(SignatureCacheEntry(nonceNew, sighash, pubkey, vchSig));
+    vEntries.push_back(SignatureCacheEntry(nonceNew, sighash, pubkey, vchBogus));
+    {
+        CAutoFile file(fopen((GetDataDir() / "sigcache.dat").string().c_str(), "wb"), SER_DISK, CLIENT_VERSION);
+        file << nVersion << nonceNew << vEntries;
+    }
+    BOOST_CHECK(LoadSignatureCache());
+    CSignatureCacheStats stats = GetSignatureCacheStats();
+    BOOST_CHECK_EQUAL(stats.nLoaded, 2U);
+    BOOST_CHECK(checker.VerifySignature(vchSig, pubkey, sighash));
+    BOOST_CHECK(checker.VerifySignature(vchBogus, pubkey, sighash));
+    BOOST_CHECK_EQUAL(GetSignatureCacheStats().nMisses, stats.nMisses);
+
+    // Files of another version are ignored
+    {
+        CAutoFile file(fopen((GetDataDir() / "sigcache.dat").string().c_str(), "wb"), SER_DISK, CLIENT_VERSION);
+        file << (nVersion + 1) << nonce << vEntries;
+    }
+    BOOST_CHECK(!LoadSignatureCache());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
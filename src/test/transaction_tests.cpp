@@ -6,6 +6,7 @@
 #include "data/tx_valid.json.h"
 #include "test/test_bitcoin.h"
 
+#include "arith_uint256.h"
 #include "clientversion.h"
 #include "checkqueue.h"
 #include "consensus/validation.h"
@@ -342,6 +343,110 @@ BOOST_AUTO_TEST_CASE(test_Get)
     BOOST_CHECK_EQUAL(coins.GetValueIn(t1), (50+21+22)*CENT);
 }
 
+BOOST_AUTO_TEST_CASE(test_cached_properties)
+{
+    CBasicKeyStore keystore;
+    CCoinsView coinsDummy;
+    CCoinsViewCache coins(&coinsDummy);
+    std::vector<CMutableTransaction> dummyTransactions = SetupDummyInputs(keystore, coins);
+
+    // Spend a P2SH output holding a 1-of-2 multisig, with some witness data
+    CScript redeemScript = CScript() << OP_1 << std::vector<unsigned char>(33, 2) << std::vector<unsigned char>(33, 3) << OP_2 << OP_CHECKMULTISIG;
+    CMutableTransaction funding;
+    funding.vin.resize(1);
+    funding.vin[0].prevout.hash = dummyTransactions[0].GetHash();
+    funding.vout.resize(1);
+    funding.vout[0].nValue = 10*CENT;
+    funding.vout[0].scriptPubKey = GetScriptForDestination(CScriptID(redeemScript));
+    coins.ModifyCoins(funding.GetHash())->FromTx(funding, 0);
+
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    mtx.vin[0].prevout = COutPoint(funding.GetHash(), 0);
+    mtx.vin[0].scriptSig << OP_0 << std::vector<unsigned char>(72, 0) << std::vector<unsigned char>(redeemScript.begin(), redeemScript.end());
+    mtx.vin[0].scriptWitness.stack.push_back(std::vector<unsigned char>(100, 1));
+    mtx.vout.resize(2);
+    mtx.vout[0].nValue = 3*CENT;
+    mtx.vout[0].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 0) << OP_EQUALVERIFY << OP_CHECKSIG;
+    mtx.vout[1].nValue = 4*CENT;
+    mtx.vout[1].scriptPubKey = CScript() << OP_1 << OP_CHECKMULTISIG;
+
+    unsigned int nTotalSize = ::GetSerializeSize(mtx, SER_NETWORK, PROTOCOL_VERSION);
+    unsigned int nBaseSize = ::GetSerializeSize(mtx, SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS);
+    BOOST_CHECK(nBaseSize < nTotalSize);
+    BOOST_CHECK(SerializeHash(mtx, SER_GETHASH, 0) != mtx.GetHash());
+
+    // Computed values, then the same values from the cache, and from a copy
+    std::vector<CTransactionRef> vtx;
+    vtx.push_back(MakeTransactionRef(mtx));
+    vtx.push_back(vtx[0]);
+    vtx.push_back(MakeTransactionRef(*vtx[0]));
+    BOOST_FOREACH(const CTransactionRef& ptx, vtx) {
+        const CTransaction& txCheck = *ptx;
+        BOOST_CHECK_EQUAL(txCheck.GetTotalSize(), nTotalSize);
+        BOOST_CHECK_EQUAL(txCheck.GetBaseSize(), nBaseSize);
+        BOOST_CHECK_EQUAL(GetTransactionWeight(txCheck), nBaseSize * (WITNESS_SCALE_FACTOR - 1) + nTotalSize);
+        BOOST_CHECK_EQUAL(GetLegacySigOpCount(txCheck), 21U);
+        BOOST_CHECK_EQUAL(GetP2SHSigOpCount(txCheck, coins), 2U);
+        BOOST_CHECK_EQUAL(txCheck.GetValueOut(), 7*CENT);
+        BOOST_CHECK(txCheck.GetWitnessHash() == SerializeHash(mtx, SER_GETHASH, 0));
+    }
+
+    // Without witness data, the witness hash is the txid and both sizes agree
+    mtx.vin[0].scriptWitness.SetNull();
+    CTransaction txNoWitness(mtx);
+    BOOST_CHECK(txNoWitness.GetWitnessHash() == txNoWitness.GetHash());
+    BOOST_CHECK_EQUAL(txNoWitness.GetBaseSize(), nBaseSize);
+    BOOST_CHECK_EQUAL(txNoWitness.GetTotalSize(), nBaseSize);
+
+    // An out of range value out throws every time, it is never cached
+    mtx.vout[1].nValue = MAX_MONEY;
+    CTransaction txOverflow(mtx);
+    BOOST_CHECK_THROW(txOverflow.GetValueOut(), std::runtime_error);
+    BOOST_CHECK_THROW(txOverflow.GetValueOut(), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(test_duplicate_inputs)
+{
+    // Few inputs are compared pairwise, many go through a hash table; try both
+    BOOST_FOREACH(unsigned int nInputs, boost::assign::list_of(3)(16)(17)(1000)) {
+        CMutableTransaction mtx;
+        mtx.vin.resize(nInputs);
+        for (unsigned int i = 0; i < nInputs; i++) {
+            // Outputs of the same transaction as well as of different ones
+            mtx.vin[i].prevout = COutPoint(ArithToUint256(arith_uint256(i / 3 + 1)), i % 3);
+        }
+        mtx.vout.resize(1);
+        mtx.vout[0].nValue = 1;
+
+        CValidationState state;
+        BOOST_CHECK(CheckTransaction(mtx, state));
+        std::vector<std::pair<unsigned int, unsigned int> > vDuplicates = boost::assign::list_of
+            (std::make_pair(0, 1))(std::make_pair(0, nInputs - 1))(std::make_pair(nInputs / 2, nInputs - 1))(std::make_pair(nInputs - 2, nInputs - 1));
+        for (const auto& dup : vDuplicates) {
+            CMutableTransaction mtxDup(mtx);
+            mtxDup.vin[dup.second].prevout = mtxDup.vin[dup.first].prevout;
+            CValidationState stateDup;
+            BOOST_CHECK(!CheckTransaction(mtxDup, stateDup));
+            BOOST_CHECK_EQUAL(stateDup.GetRejectReason(), "bad-txns-inputs-duplicate");
+            BOOST_CHECK(CheckTransaction(mtxDup, stateDup, false));
+        }
+    }
+
+    // Outputs of one transaction whose indexes are multiples of the table size
+    CMutableTransaction mtx;
+    mtx.vin.resize(20000);
+    for (unsigned int i = 0; i < mtx.vin.size(); i++)
+        mtx.vin[i].prevout = COutPoint(ArithToUint256(arith_uint256(1)), i << 16);
+    mtx.vout.resize(1);
+    mtx.vout[0].nValue = 1;
+    CValidationState state;
+    BOOST_CHECK(CheckTransaction(mtx, state));
+    mtx.vin.back().prevout = mtx.vin.front().prevout;
+    BOOST_CHECK(!CheckTransaction(mtx, state));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "bad-txns-inputs-duplicate");
+}
+
 void CreateCreditAndSpend(const CKeyStore& keystore, const CScript& outscript, CTransactionRef& output, CMutableTransaction& input, bool success = true)
 {
     CMutableTransaction outputm;
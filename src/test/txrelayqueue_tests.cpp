@@ -0,0 +1,104 @@
+// Copyright (c) 2026 The Bunkercoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "txrelayqueue.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(txrelayqueue_tests, BasicTestingSetup)
+
+static CTransactionRef MakeTx(int n)
+{
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    mtx.vin[0].scriptSig = CScript() << n;
+    mtx.vout.resize(1);
+    mtx.vout[0].nValue = n;
+    return MakeTransactionRef(std::move(mtx));
+}
+
+BOOST_AUTO_TEST_CASE(txrelayqueue_seal_and_cursors)
+{
+    CTxRelayQueue queue;
+    std::map<uint256, CTransactionRef> known;
+    std::vector<uint256> vHashes;
+    for (int i = 0; i < 6; i++) {
+        CTransactionRef tx = MakeTx(i);
+        known[tx->GetHash()] = tx;
+        vHashes.push_back(tx->GetHash());
+    }
+
+    // Score function: reverse order, and drop the last pushed txid as unknown
+    int nScoreCalls = 0;
+    CTxRelayQueue::ScoreFunction scoreFunc = [&](const std::vector<uint256>& vPending) {
+        nScoreCalls++;
+        std::vector<CTxRelayQueue::Entry> vEntries;
+        for (auto it = vPending.rbegin(); it != vPending.rend(); ++it) {
+            if (*it == vHashes.back()) continue;
+            vEntries.emplace_back(known[*it], CFeeRate(1000));
+        }
+        return vEntries;
+    };
+
+    uint64_t nCursorA = queue.GetNextSequence();
+    for (const uint256& hash : vHashes)
+        queue.Push(hash);
+    BOOST_CHECK(queue.HasPending());
+    BOOST_CHECK_EQUAL(queue.size(), 0U);
+
+    // Nothing is visible before sealing
+    int nVisited = 0;
+    BOOST_CHECK_EQUAL(queue.ForEachFrom(nCursorA, [&](const CTxRelayQueue::Entry&) { nVisited++; return true; }), nCursorA);
+    BOOST_CHECK_EQUAL(nVisited, 0);
+
+    queue.Seal(scoreFunc);
+    queue.Seal(scoreFunc);
+    BOOST_CHECK_EQUAL(nScoreCalls, 1);
+    BOOST_CHECK(!queue.HasPending());
+    BOOST_CHECK_EQUAL(queue.size(), 5U);
+
+    // A peer joining now only sees later announcements
+    uint64_t nCursorB = queue.GetNextSequence();
+
+    // Peer A takes two entries, in scored order
+    std::vector<uint256> vSeen;
+    nCursorA = queue.ForEachFrom(nCursorA, [&](const CTxRelayQueue::Entry& entry) {
+        vSeen.push_back(entry.hash);
+        return vSeen.size() < 2;
+    });
+    BOOST_CHECK_EQUAL(vSeen.size(), 2U);
+    BOOST_CHECK(vSeen[0] == vHashes[4]);
+    BOOST_CHECK(vSeen[1] == vHashes[3]);
+
+    nVisited = 0;
+    BOOST_CHECK_EQUAL(queue.ForEachFrom(nCursorB, [&](const CTxRelayQueue::Entry&) { nVisited++; return true; }), nCursorB);
+    BOOST_CHECK_EQUAL(nVisited, 0);
+
+    // Pruning up to the slowest cursor keeps what peer A has not seen
+    queue.Prune(std::min(nCursorA, nCursorB));
+    BOOST_CHECK_EQUAL(queue.size(), 3U);
+    vSeen.clear();
+    queue.ForEachFrom(nCursorA, [&](const CTxRelayQueue::Entry& entry) { vSeen.push_back(entry.hash); return true; });
+    BOOST_CHECK_EQUAL(vSeen.size(), 3U);
+    BOOST_CHECK(vSeen[0] == vHashes[2]);
+
+    // Entries a lagging cursor has not passed are kept, however many follow them
+    queue.Push(vHashes[0]);
+    queue.Seal(scoreFunc);
+    BOOST_CHECK_EQUAL(queue.size(), 4U);
+    nCursorB = queue.ForEachFrom(nCursorB, [&](const CTxRelayQueue::Entry&) { return true; });
+    queue.Prune(std::min(nCursorA, nCursorB));
+    BOOST_CHECK_EQUAL(queue.size(), 4U);
+    vSeen.clear();
+    nCursorA = queue.ForEachFrom(nCursorA, [&](const CTxRelayQueue::Entry& entry) { vSeen.push_back(entry.hash); return true; });
+    BOOST_CHECK_EQUAL(vSeen.size(), 4U);
+    BOOST_CHECK(vSeen[3] == vHashes[0]);
+    BOOST_CHECK_EQUAL(nCursorA, queue.GetNextSequence());
+    queue.Prune(std::min(nCursorA, nCursorB));
+    BOOST_CHECK_EQUAL(queue.size(), 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -2,6 +2,7 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "chainparams.h"
 #include "consensus/validation.h"
 #include "key.h"
 #include "validation.h"
@@ -9,6 +10,7 @@
 #include "pubkey.h"
 #include "txmempool.h"
 #include "random.h"
+#include "script/sigcache.h"
 #include "script/standard.h"
 #include "test/test_bitcoin.h"
 #include "utiltime.h"
@@ -84,4 +86,230 @@ BOOST_FIXTURE_TEST_CASE(tx_mempool_block_doublespend, TestChain240Setup)
     BOOST_CHECK_EQUAL(mempool.size(), 0);
 }
 
+static CMutableTransaction
+SignedSpend(const CKey& key, const CScript& scriptPubKey, const COutPoint& prevout, CAmount nValue, int32_t nVersion = 1)
+{
+    CMutableTransaction tx;
+    tx.nVersion = nVersion;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = prevout;
+    tx.vout.resize(1);
+    tx.vout[0].nValue = nValue;
+    tx.vout[0].scriptPubKey = scriptPubKey;
+
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptPubKey, tx, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+    BOOST_CHECK(key.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    tx.vin[0].scriptSig << vchSig;
+    return tx;
+}
+
+BOOST_FIXTURE_TEST_CASE(tx_mempool_batch, TestChain240Setup)
+{
+    CScript scriptPubKey = CScript() <<  ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+
+    // A child listed before its parent, and a double-spend of the parent's input
+    CMutableTransaction parent = SignedSpend(coinbaseKey, scriptPubKey, COutPoint(coinbaseTxns[0].GetHash(), 0), COIN);
+    CMutableTransaction child = SignedSpend(coinbaseKey, scriptPubKey, COutPoint(parent.GetHash(), 0), COIN / 2);
+    CMutableTransaction conflict = SignedSpend(coinbaseKey, scriptPubKey, COutPoint(coinbaseTxns[0].GetHash(), 0), COIN / 2);
+    CMutableTransaction orphan = SignedSpend(coinbaseKey, scriptPubKey, COutPoint(GetRandHash(), 0), COIN / 2);
+
+    std::vector<CTransactionRef> vtx;
+    vtx.push_back(MakeTransactionRef(child));
+    vtx.push_back(MakeTransactionRef(parent));
+    vtx.push_back(MakeTransactionRef(conflict));
+    vtx.push_back(MakeTransactionRef(orphan));
+
+    std::vector<CValidationState> vState;
+    std::vector<bool> vMissingInputs;
+    BOOST_CHECK_EQUAL(AcceptToMemoryPoolBatch(mempool, vtx, false, vState, vMissingInputs, true), 2);
+    BOOST_CHECK_EQUAL(vState.size(), vtx.size());
+    BOOST_CHECK_EQUAL(vMissingInputs.size(), vtx.size());
+    BOOST_CHECK(vState[0].IsValid());
+    BOOST_CHECK(vState[1].IsValid());
+    BOOST_CHECK(vState[2].IsInvalid());
+    BOOST_CHECK_EQUAL(vState[2].GetRejectReason(), "txn-mempool-conflict");
+    BOOST_CHECK(!vMissingInputs[2]);
+    BOOST_CHECK(vMissingInputs[3]);
+    BOOST_CHECK_EQUAL(mempool.size(), 2);
+    BOOST_CHECK(mempool.exists(parent.GetHash()));
+    BOOST_CHECK(mempool.exists(child.GetHash()));
+    mempool.clear();
+}
+
+BOOST_FIXTURE_TEST_CASE(tx_preverify_scripts, TestChain240Setup)
+{
+    CScript scriptPubKey = CScript() <<  ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    std::vector<CTxOut> vSpent;
+    CMutableTransaction spend = SignedSpend(coinbaseKey, scriptPubKey, COutPoint(coinbaseTxns[0].GetHash(), 0), COIN);
+    size_t nEntries = GetSignatureCacheStats().nEntries;
+    BOOST_CHECK(PreverifyTransactionScripts(mempool, spend, vSpent));
+    BOOST_CHECK_EQUAL(vSpent.size(), 1U);
+    BOOST_CHECK(vSpent[0] == coinbaseTxns[0].vout[0]);
+    BOOST_CHECK_EQUAL(GetSignatureCacheStats().nEntries, nEntries + 1);
+
+    // A transaction that is not accepted after all gives its signatures up
+    UncacheTransactionScripts(spend, vSpent);
+    BOOST_CHECK_EQUAL(GetSignatureCacheStats().nEntries, nEntries);
+
+    // Signed by the wrong key
+    CKey otherKey;
+    otherKey.MakeNewKey(true);
+    CMutableTransaction badSig = SignedSpend(otherKey, scriptPubKey, COutPoint(coinbaseTxns[0].GetHash(), 0), COIN);
+    BOOST_CHECK(!PreverifyTransactionScripts(mempool, badSig, vSpent));
+    BOOST_CHECK(vSpent.empty());
+
+    // Scripts of transactions failing the cheap checks are not run at all
+    CAmount nValueIn = coinbaseTxns[0].vout[0].nValue;
+    CMutableTransaction noFee = SignedSpend(coinbaseKey, scriptPubKey, COutPoint(coinbaseTxns[0].GetHash(), 0), nValueIn);
+    CMutableTransaction nonStandard = SignedSpend(coinbaseKey, CScript() << OP_TRUE, COutPoint(coinbaseTxns[0].GetHash(), 0), COIN);
+    CSignatureCacheStats stats = GetSignatureCacheStats();
+    BOOST_CHECK(!PreverifyTransactionScripts(mempool, noFee, vSpent));
+    BOOST_CHECK(!PreverifyTransactionScripts(mempool, nonStandard, vSpent));
+    BOOST_CHECK_EQUAL(GetSignatureCacheStats().nHits + GetSignatureCacheStats().nMisses, stats.nHits + stats.nMisses);
+
+    // Inputs from the mempool are found, unknown inputs are not
+    CMutableTransaction child = SignedSpend(coinbaseKey, scriptPubKey, COutPoint(spend.GetHash(), 0), COIN / 2);
+    BOOST_CHECK(!PreverifyTransactionScripts(mempool, child, vSpent));
+    BOOST_CHECK(ToMemPool(spend));
+    BOOST_CHECK(PreverifyTransactionScripts(mempool, child, vSpent));
+    BOOST_CHECK(!PreverifyTransactionScripts(mempool, spend, vSpent));
+    // Nor are inputs already spent in the mempool, replacements are left to AcceptToMemoryPool
+    CMutableTransaction conflict = SignedSpend(coinbaseKey, scriptPubKey, COutPoint(coinbaseTxns[0].GetHash(), 0), COIN / 2);
+    BOOST_CHECK(!PreverifyTransactionScripts(mempool, conflict, vSpent));
+    mempool.clear();
+}
+
+BOOST_FIXTURE_TEST_CASE(checkinputs_script_cache, TestChain240Setup)
+{
+    CScript scriptPubKey = CScript() <<  ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CTransaction spend(SignedSpend(coinbaseKey, scriptPubKey, COutPoint(coinbaseTxns[0].GetHash(), 0), COIN));
+    CKey otherKey;
+    otherKey.MakeNewKey(true);
+    CTransaction badSig(SignedSpend(otherKey, scriptPubKey, COutPoint(coinbaseTxns[1].GetHash(), 0), COIN));
+    const unsigned int flags = SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_DERSIG;
+
+    LOCK(cs_main);
+    CCoinsViewCache view(pcoinsTip);
+    CValidationState state;
+    PrecomputedTransactionData txdata(spend);
+    PrecomputedTransactionData txdataBad(badSig);
+
+    // Nothing is cached while the scripts are handed to the caller
+    std::vector<CScriptCheck> vChecks;
+    BOOST_CHECK(CheckInputs(spend, state, view, true, flags, true, true, txdata, &vChecks));
+    BOOST_CHECK_EQUAL(vChecks.size(), spend.vin.size());
+    vChecks.clear();
+    BOOST_CHECK(CheckInputs(spend, state, view, true, flags, true, true, txdata, &vChecks));
+    BOOST_CHECK_EQUAL(vChecks.size(), spend.vin.size());
+    vChecks.clear();
+
+    // Once the scripts passed inline, they are skipped under the same flags only
+    BOOST_CHECK(CheckInputs(spend, state, view, true, flags, true, true, txdata));
+    BOOST_CHECK(CheckInputs(spend, state, view, true, flags, false, false, txdata, &vChecks));
+    BOOST_CHECK(vChecks.empty());
+    BOOST_CHECK(CheckInputs(spend, state, view, true, flags | SCRIPT_VERIFY_LOW_S, false, false, txdata, &vChecks));
+    BOOST_CHECK_EQUAL(vChecks.size(), spend.vin.size());
+    vChecks.clear();
+
+    // Failing scripts are never cached
+    CValidationState stateBad;
+    BOOST_CHECK(!CheckInputs(badSig, stateBad, view, true, flags, true, true, txdataBad));
+    BOOST_CHECK(CheckInputs(badSig, state, view, true, flags, true, true, txdataBad, &vChecks));
+    BOOST_CHECK_EQUAL(vChecks.size(), badSig.vin.size());
+    BOOST_CHECK(!vChecks[0]());
+}
+
+// Whether the scripts of tx are cached as passed under the flags of the block pindex
+static bool
+IsScriptExecutionCached(const CTransaction& tx, const CBlockIndex* pindex)
+{
+    LOCK(cs_main);
+    const unsigned int flags = GetBlockScriptFlags(pindex->pprev, pindex->nHeight, Params());
+    CCoinsViewCache view(pcoinsTip);
+    CValidationState state;
+    PrecomputedTransactionData txdata(tx);
+    std::vector<CScriptCheck> vChecks;
+    BOOST_CHECK(CheckInputs(tx, state, view, true, flags, false, false, txdata, &vChecks));
+    return vChecks.empty();
+}
+
+BOOST_FIXTURE_TEST_CASE(speculative_checks, TestChain240Setup)
+{
+    CScript scriptPubKey = CScript() <<  ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CKey otherKey;
+    otherKey.MakeNewKey(true);
+    // Non-standard, so that disconnecting their blocks does not take them
+    // into the mempool and their scripts into the cache
+    CTransaction spend(SignedSpend(coinbaseKey, scriptPubKey, COutPoint(coinbaseTxns[0].GetHash(), 0), COIN, 3));
+    CMutableTransaction spend2 = SignedSpend(coinbaseKey, scriptPubKey, COutPoint(coinbaseTxns[1].GetHash(), 0), COIN, 3);
+    CMutableTransaction badSig = SignedSpend(otherKey, scriptPubKey, COutPoint(coinbaseTxns[2].GetHash(), 0), COIN, 3);
+    bool fSpeculativeVerifyOld = fSpeculativeVerify;
+    fSpeculativeVerify = true;
+
+    // Two blocks on top of the tip that are stored but not connected, as
+    // ActivateBestChainStep sees them before connecting the first one
+    CBlock block1 = CreateAndProcessBlock(std::vector<CMutableTransaction>(), scriptPubKey);
+    CBlock block2 = CreateAndProcessBlock(std::vector<CMutableTransaction>(1, CMutableTransaction(spend)), scriptPubKey);
+    CBlockIndex* pindex1;
+    CBlockIndex* pindex2;
+    {
+        LOCK(cs_main);
+        pindex1 = mapBlockIndex[block1.GetHash()];
+        pindex2 = mapBlockIndex[block2.GetHash()];
+        BOOST_CHECK(chainActive.Tip() == pindex2);
+        CValidationState state;
+        BOOST_CHECK(InvalidateBlock(state, Params(), pindex1));
+        BOOST_CHECK(ResetBlockFailureFlags(pindex1));
+        BOOST_CHECK(chainActive.Tip() == pindex1->pprev);
+    }
+    BOOST_CHECK(!IsScriptExecutionCached(spend, pindex2));
+
+    // Checks of a block that is not connected next are discarded
+    {
+        LOCK(cs_main);
+        StartSpeculativeChecks(pindex2, Params());
+        BOOST_CHECK(!FinishSpeculativeChecks(pindex1));
+        StartSpeculativeChecks(pindex2, Params());
+        BOOST_CHECK(!FinishSpeculativeChecks(NULL));
+    }
+    BOOST_CHECK(!IsScriptExecutionCached(spend, pindex2));
+
+    // Checks of the block connected next fill the cache, so that connecting it skips the scripts
+    {
+        LOCK(cs_main);
+        StartSpeculativeChecks(pindex2, Params());
+        std::shared_ptr<const CBlock> pblock = FinishSpeculativeChecks(pindex2);
+        BOOST_CHECK(pblock && pblock->GetHash() == block2.GetHash());
+    }
+    BOOST_CHECK(IsScriptExecutionCached(spend, pindex2));
+    CValidationState state;
+    BOOST_CHECK(ActivateBestChain(state, Params()));
+    BOOST_CHECK(chainActive.Tip() == pindex2);
+
+    // A failing check keeps every transaction of the block out of the cache,
+    // and the block is rejected by ConnectBlock as before
+    std::vector<CMutableTransaction> vSpends;
+    vSpends.push_back(spend2);
+    vSpends.push_back(badSig);
+    CBlock block3 = CreateAndProcessBlock(vSpends, scriptPubKey);
+    CBlockIndex* pindex3;
+    {
+        LOCK(cs_main);
+        pindex3 = mapBlockIndex[block3.GetHash()];
+        BOOST_CHECK(chainActive.Tip() == pindex2);
+        BOOST_CHECK(ResetBlockFailureFlags(pindex3));
+        StartSpeculativeChecks(pindex3, Params());
+        std::shared_ptr<const CBlock> pblock = FinishSpeculativeChecks(pindex3);
+        BOOST_CHECK(pblock && pblock->GetHash() == block3.GetHash());
+    }
+    BOOST_CHECK(!IsScriptExecutionCached(CTransaction(spend2), pindex3));
+    BOOST_CHECK(ActivateBestChain(state, Params()));
+    BOOST_CHECK(chainActive.Tip() == pindex2);
+    BOOST_CHECK(pindex3->nStatus & BLOCK_FAILED_VALID);
+
+    fSpeculativeVerify = fSpeculativeVerifyOld;
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -6,6 +6,7 @@
 #ifndef BITCOIN_TXMEMPOOL_H
 #define BITCOIN_TXMEMPOOL_H
 
+#include <atomic>
 #include <memory>
 #include <set>
 #include <map>
@@ -16,6 +17,7 @@
 #include "amount.h"
 #include "coins.h"
 #include "indirectmap.h"
+#include "prevector.h"
 #include "primitives/transaction.h"
 #include "sync.h"
 #include "random.h"
@@ -93,7 +95,9 @@ private:
     CAmount inChainInputValue; //!< Sum of all txin values that are already in blockchain
     bool spendsCoinbase;       //!< keep track of transactions that spend a coinbase
     int64_t sigOpCost;         //!< Total sigop cost
+    CAmount nDustFee;          //!< Dust penalty of the outputs, for the minimum relay fee
     int64_t feeDelta;          //!< Used for determining the priority of the transaction for mining in a block
+    double cachedPriority;     //!< Priority at the mempool's priority height, including prioritisation
     LockPoints lockPoints;     //!< Track the height and time at which tx was final
 
     // Information about descendants of this transaction that are in the
@@ -129,7 +133,9 @@ public:
     size_t GetTxWeight() const { return nTxWeight; }
     int64_t GetTime() const { return nTime; }
     unsigned int GetHeight() const { return entryHeight; }
+    double GetCachedPriority() const { return cachedPriority; }
     int64_t GetSigOpCost() const { return sigOpCost; }
+    CAmount GetDustFee() const { return nDustFee; }
     int64_t GetModifiedFee() const { return nFee + feeDelta; }
     size_t DynamicMemoryUsage() const { return nUsageSize; }
     const LockPoints& GetLockPoints() const { return lockPoints; }
@@ -143,6 +149,8 @@ public:
     void UpdateFeeDelta(int64_t feeDelta);
     // Update the LockPoints after a reorg
     void UpdateLockPoints(const LockPoints& lp);
+    // Updates the priority used for the coin age priority index
+    void UpdateCachedPriority(double dPriority) { cachedPriority = dPriority; }
 
     uint64_t GetCountWithDescendants() const { return nCountWithDescendants; }
     uint64_t GetSizeWithDescendants() const { return nSizeWithDescendants; }
@@ -155,7 +163,9 @@ public:
     CAmount GetModFeesWithAncestors() const { return nModFeesWithAncestors; }
     int64_t GetSigOpCostWithAncestors() const { return nSigOpCostWithAncestors; }
 
-    mutable size_t vTxHashesIdx; //!< Index in mempool's vTxHashes
+    mutable size_t vTxHashesIdx; //!< Index in mempool's vTxHashes and vTxLinks
+    mutable uint64_t nSelectionRun; //!< CPackageSelector run that nSelectionIdx belongs to
+    mutable uint32_t nSelectionIdx; //!< Index in that run's arena
 };
 
 // Helpers for modifying CTxMemPool::mapTx, which is a boost multi_index.
@@ -200,6 +210,16 @@ private:
     int64_t feeDelta;
 };
 
+struct update_cached_priority
+{
+    update_cached_priority(double _dPriority) : dPriority(_dPriority) { }
+
+    void operator() (CTxMemPoolEntry &e) { e.UpdateCachedPriority(dPriority); }
+
+private:
+    double dPriority;
+};
+
 struct update_lock_points
 {
     update_lock_points(const LockPoints& _lp) : lp(_lp) { }
@@ -307,11 +327,27 @@ public:
     }
 };
 
+/** \class CompareTxMemPoolEntryByPriority
+ *
+ *  Sort by cached coin age priority in descending order, then by score
+ */
+class CompareTxMemPoolEntryByPriority
+{
+public:
+    bool operator()(const CTxMemPoolEntry& a, const CTxMemPoolEntry& b) const
+    {
+        if (a.GetCachedPriority() == b.GetCachedPriority())
+            return CompareTxMemPoolEntryByScore()(a, b);
+        return a.GetCachedPriority() > b.GetCachedPriority();
+    }
+};
+
 // Multi_index tag names
 struct descendant_score {};
 struct entry_time {};
 struct mining_score {};
 struct ancestor_score {};
+struct priority_score {};
 
 class CBlockPolicyEstimator;
 
@@ -373,7 +409,7 @@ enum class MemPoolRemovalReason {
  *
  * In order for the feerate sort to remain correct, we must update transactions
  * in the mempool when new descendants arrive.  To facilitate this, we track
- * the set of in-mempool direct parents and direct children in mapLinks.  Within
+ * the set of in-mempool direct parents and direct children in vTxLinks.  Within
  * each CTxMemPoolEntry, we track the size and fees of all descendants.
  *
  * Usually when a new transaction is added to the mempool, it has no in-mempool
@@ -406,7 +442,7 @@ enum class MemPoolRemovalReason {
  * state, to account for in-mempool, out-of-block descendants for all the
  * in-block transactions by calling UpdateTransactionsFromBlock().  Note that
  * until this is called, the mempool state is not consistent, and in particular
- * mapLinks may not be correct (and therefore functions like
+ * vTxLinks may not be correct (and therefore functions like
  * CalculateMemPoolAncestors() and CalculateDescendants() that rely
  * on them to walk the mempool are not generally safe to use).
  *
@@ -474,6 +510,12 @@ public:
                 boost::multi_index::tag<ancestor_score>,
                 boost::multi_index::identity<CTxMemPoolEntry>,
                 CompareTxMemPoolEntryByAncestorFee
+            >,
+            // sorted by coin age priority (for the priority part of the block)
+            boost::multi_index::ordered_non_unique<
+                boost::multi_index::tag<priority_score>,
+                boost::multi_index::identity<CTxMemPoolEntry>,
+                CompareTxMemPoolEntryByPriority
             >
         >
     > indexed_transaction_set;
@@ -490,28 +532,48 @@ public:
         }
     };
     typedef std::set<txiter, CompareIteratorByHash> setEntries;
+    /** Direct parents or children of an entry, in no particular order. Most transactions have very few, so they are kept inline. */
+    typedef prevector<2, txiter> linkEntries;
 
-    const setEntries & GetMemPoolParents(txiter entry) const;
-    const setEntries & GetMemPoolChildren(txiter entry) const;
+    const linkEntries & GetMemPoolParents(txiter entry) const;
+    const linkEntries & GetMemPoolChildren(txiter entry) const;
 private:
     typedef std::map<txiter, setEntries, CompareIteratorByHash> cacheMap;
 
     struct TxLinks {
-        setEntries parents;
-        setEntries children;
+        linkEntries parents;
+        linkEntries children;
+
+        TxLinks() {}
+        // Never copied when vTxLinks grows: a copy of a prevector can have a
+        // different capacity, which would throw off cachedInnerUsage.
+        TxLinks(TxLinks&& other) noexcept : parents(std::move(other.parents)), children(std::move(other.children)) {}
+        TxLinks& operator=(TxLinks&& other) noexcept
+        {
+            parents = std::move(other.parents);
+            children = std::move(other.children);
+            return *this;
+        }
     };
 
-    typedef std::map<txiter, TxLinks, CompareIteratorByHash> txlinksMap;
-    txlinksMap mapLinks;
+    std::vector<TxLinks> vTxLinks; //!< Links of the entries in mapTx, parallel to vTxHashes
+
+    /** Add or remove a link, returns the change in dynamic memory usage */
+    static int64_t UpdateLink(linkEntries &links, txiter link, bool add);
 
     void UpdateParent(txiter entry, txiter parent, bool add);
     void UpdateChild(txiter entry, txiter child, bool add);
 
     std::vector<indexed_transaction_set::const_iterator> GetSortedDepthAndScore() const;
 
+    unsigned int nPriorityHeight; //!< Height the priority index is sorted for
+    /** Priority of entry at nPriorityHeight plus dPriorityDelta */
+    double CalculatePriority(const CTxMemPoolEntry& entry, double dPriorityDelta) const;
+
 public:
     indirectmap<COutPoint, const CTransaction*> mapNextTx;
     std::map<uint256, std::pair<double, CAmount> > mapDeltas;
+    std::atomic<size_t> nDeltas; //!< Size of mapDeltas, readable without cs
 
     /** Create a new CTxMemPool.
      */
@@ -556,6 +618,13 @@ public:
     void PrioritiseTransaction(const uint256 hash, const std::string strHash, double dPriorityDelta, const CAmount& nFeeDelta);
     void ApplyDeltas(const uint256 hash, double &dPriorityDelta, CAmount &nFeeDelta) const;
     void ClearPrioritisation(const uint256 hash);
+    /**
+     * Re-sort the priority_score index for blocks at nHeight. Coin age
+     * priority grows with height at a different rate for each transaction,
+     * so this is needed once per block height; it does nothing if the index
+     * is already sorted for nHeight.
+     */
+    void UpdatePriorityHeight(unsigned int nHeight);
 
 public:
     /** Remove a set of transactions from the mempool.
@@ -586,7 +655,7 @@ public:
      *  limitDescendantSize = max size of descendants any ancestor can have
      *  errString = populated with error reason if any limits are hit
      *  fSearchForParents = whether to search a tx's vin for in-mempool parents, or
-     *    look up parents from mapLinks. Must be true for entries not in the mempool
+     *    look up parents from vTxLinks. Must be true for entries not in the mempool
      */
     bool CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntries &setAncestors, uint64_t limitAncestorCount, uint64_t limitAncestorSize, uint64_t limitDescendantCount, uint64_t limitDescendantSize, std::string &errString, bool fSearchForParents = true) const;
 
@@ -636,10 +705,13 @@ public:
     CTransactionRef get(const uint256& hash) const;
     TxMempoolInfo info(const uint256& hash) const;
     std::vector<TxMempoolInfo> infoAll() const;
+    /** Like infoAll(), restricted to vHashes. Unknown and duplicate hashes are skipped. */
+    std::vector<TxMempoolInfo> infoSorted(const std::vector<uint256>& vHashes) const;
 
     /** Estimate fee rate needed to get into the next nBlocks
      *  If no answer can be given at nBlocks, return an estimate
      *  at the lowest number of blocks where one can be given
+     *  The estimates below don't need cs, the estimator has its own lock.
      */
     CFeeRate estimateSmartFee(int nBlocks, int *answerFoundAtBlocks = NULL) const;
 
@@ -0,0 +1,70 @@
+// Copyright (c) 2026 The Bunkercoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "txrelayqueue.h"
+
+CTxRelayQueue::CTxRelayQueue() : nFirstSequence(0)
+{
+}
+
+void CTxRelayQueue::Push(const uint256& hash)
+{
+    LOCK(cs);
+    vPending.push_back(hash);
+}
+
+uint64_t CTxRelayQueue::GetNextSequence() const
+{
+    LOCK(cs);
+    return nFirstSequence + vSealed.size();
+}
+
+bool CTxRelayQueue::HasPending() const
+{
+    LOCK(cs);
+    return !vPending.empty();
+}
+
+void CTxRelayQueue::Seal(const ScoreFunction& scoreFunc)
+{
+    LOCK(cs);
+    if (vPending.empty())
+        return;
+
+    std::vector<Entry> vBucket = scoreFunc(vPending);
+    vPending.clear();
+    for (Entry& entry : vBucket)
+        vSealed.push_back(std::move(entry));
+}
+
+uint64_t CTxRelayQueue::ForEachFrom(uint64_t nCursor, const std::function<bool(const Entry&)>& func) const
+{
+    LOCK(cs);
+    if (nCursor < nFirstSequence)
+        nCursor = nFirstSequence;
+
+    const uint64_t nEnd = nFirstSequence + vSealed.size();
+    while (nCursor < nEnd) {
+        const Entry& entry = vSealed[nCursor - nFirstSequence];
+        nCursor++;
+        if (!func(entry))
+            break;
+    }
+    return nCursor;
+}
+
+void CTxRelayQueue::Prune(uint64_t nMinCursor)
+{
+    LOCK(cs);
+    while (!vSealed.empty() && nFirstSequence < nMinCursor) {
+        vSealed.pop_front();
+        nFirstSequence++;
+    }
+}
+
+size_t CTxRelayQueue::size() const
+{
+    LOCK(cs);
+    return vSealed.size();
+}
@@ -0,0 +1,82 @@
+// Copyright (c) 2026 The Bunkercoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TXRELAYQUEUE_H
+#define BITCOIN_TXRELAYQUEUE_H
+
+#include "amount.h"
+#include "primitives/transaction.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <deque>
+#include <functional>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * Shared queue of transaction announcements, replacing the per-peer
+ * std::set of txids that used to be re-sorted on every trickle.
+ *
+ * Announced txids are appended to a pending batch. The first peer to trickle
+ * after new announcements seals the batch: it is scored against the mempool
+ * once (topologically and by fee rate) and appended to the shared queue as a
+ * new bucket, with every entry receiving a sequence number. Each peer only
+ * keeps a cursor: the sequence number of the next entry it has not looked at.
+ *
+ * Entries are only dropped once every peer's cursor has moved past them.
+ */
+class CTxRelayQueue
+{
+public:
+    struct Entry
+    {
+        uint256 hash;
+        CTransactionRef tx;
+        CFeeRate feeRate;
+
+        Entry(const CTransactionRef& txIn, const CFeeRate& feeRateIn) : hash(txIn->GetHash()), tx(txIn), feeRate(feeRateIn) {}
+    };
+
+    /** Looks up pending txids and returns entries in relay order, skipping unknown ones. */
+    typedef std::function<std::vector<Entry>(const std::vector<uint256>&)> ScoreFunction;
+
+    CTxRelayQueue();
+
+    /** Queue a transaction for announcement to all peers. */
+    void Push(const uint256& hash);
+
+    /** Sequence number that the next sealed entry will get; the cursor of a peer that has seen everything. */
+    uint64_t GetNextSequence() const;
+
+    /** Whether there are announcements that have not been sealed yet. */
+    bool HasPending() const;
+
+    /** Score the pending batch and append it as a new bucket. Lock order: cs before anything scoreFunc takes. */
+    void Seal(const ScoreFunction& scoreFunc);
+
+    /**
+     * Visit sealed entries starting at nCursor. func is called for each entry
+     * in order and returns false to stop after the current entry. Returns the
+     * cursor pointing past the last visited entry. A cursor that points to
+     * already pruned entries is moved to the oldest remaining one.
+     * func runs with cs held: take any per-peer locks it needs before calling.
+     */
+    uint64_t ForEachFrom(uint64_t nCursor, const std::function<bool(const Entry&)>& func) const;
+
+    /** Drop entries every cursor has moved past (seq < nMinCursor). */
+    void Prune(uint64_t nMinCursor);
+
+    /** Number of sealed entries. */
+    size_t size() const;
+
+private:
+    mutable CCriticalSection cs;
+    std::vector<uint256> vPending;
+    std::deque<Entry> vSealed;
+    //! Sequence number of vSealed.front().
+    uint64_t nFirstSequence;
+};
+
+#endif // BITCOIN_TXRELAYQUEUE_H
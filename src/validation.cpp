@@ -11,6 +11,8 @@
 #include "checkpoints.h"
 #include "checkqueue.h"
 #include "consensus/consensus.h"
+#include "crypto/sha256.h"
+#include "cuckoocache.h"
 #include "consensus/merkle.h"
 #include "consensus/validation.h"
 #include "bunkercoin.h"
@@ -41,6 +43,8 @@
 #include "warnings.h"
 
 #include <atomic>
+#include <functional>
+#include <queue>
 #include <sstream>
 
 #include <boost/algorithm/string/replace.hpp>
@@ -67,6 +71,7 @@ CBlockIndex *pindexBestHeader = NULL;
 CWaitableCriticalSection csBestBlock;
 CConditionVariable cvBlockChange;
 int nScriptCheckThreads = 0;
+bool fSpeculativeVerify = false;
 std::atomic_bool fImporting(false);
 bool fReindex = false;
 bool fTxIndex = false;
@@ -475,16 +480,7 @@ bool CheckSequenceLocks(const CTransaction &tx, int flags, LockPoints* lp, bool
 
 unsigned int GetLegacySigOpCount(const CTransaction& tx)
 {
-    unsigned int nSigOps = 0;
-    for (const auto& txin : tx.vin)
-    {
-        nSigOps += txin.scriptSig.GetSigOpCount(false);
-    }
-    for (const auto& txout : tx.vout)
-    {
-        nSigOps += txout.scriptPubKey.GetSigOpCount(false);
-    }
-    return nSigOps;
+    return tx.GetLegacySigOpCount();
 }
 
 unsigned int GetP2SHSigOpCount(const CTransaction& tx, const CCoinsViewCache& inputs)
@@ -493,12 +489,15 @@ unsigned int GetP2SHSigOpCount(const CTransaction& tx, const CCoinsViewCache& in
         return 0;
 
     unsigned int nSigOps = 0;
+    if (tx.GetCachedP2SHSigOpCount(nSigOps))
+        return nSigOps;
     for (unsigned int i = 0; i < tx.vin.size(); i++)
     {
         const CTxOut &prevout = inputs.GetOutputFor(tx.vin[i]);
         if (prevout.scriptPubKey.IsPayToScriptHash())
             nSigOps += prevout.scriptPubKey.GetSigOpCount(tx.vin[i].scriptSig);
     }
+    tx.SetCachedP2SHSigOpCount(nSigOps);
     return nSigOps;
 }
 
@@ -525,6 +524,42 @@ int64_t GetTransactionSigOpCost(const CTransaction& tx, const CCoinsViewCache& i
 
 
 
+/** Up to this many inputs, duplicates are looked for by comparing all pairs */
+static const size_t MAX_PAIRWISE_DUPLICATE_INPUTS = 16;
+
+/** Whether two inputs of tx spend the same outpoint */
+static bool HasDuplicateInputs(const CTransaction& tx)
+{
+    const size_t nInputs = tx.vin.size();
+    if (nInputs <= MAX_PAIRWISE_DUPLICATE_INPUTS) {
+        for (size_t i = 1; i < nInputs; i++)
+            for (size_t j = 0; j < i; j++)
+                if (tx.vin[i].prevout == tx.vin[j].prevout)
+                    return true;
+        return false;
+    }
+
+    // Open addressing table with at least twice as many slots as inputs. The
+    // prevouts of a transaction that is being checked can be chosen freely,
+    // so the whole outpoint is hashed with a secret salt to keep them from
+    // piling up in a few slots.
+    static const SaltedOutpointHasher hasher;
+    size_t nSlots = 64;
+    while (nSlots < nInputs * 2)
+        nSlots <<= 1;
+    std::vector<const COutPoint*> vSlots(nSlots, nullptr);
+    for (const auto& txin : tx.vin) {
+        size_t nSlot = hasher(txin.prevout) & (nSlots - 1);
+        while (vSlots[nSlot]) {
+            if (*vSlots[nSlot] == txin.prevout)
+                return true;
+            nSlot = (nSlot + 1) & (nSlots - 1);
+        }
+        vSlots[nSlot] = &txin.prevout;
+    }
+    return false;
+}
+
 bool CheckTransaction(const CTransaction& tx, CValidationState &state, bool fCheckDuplicateInputs)
 {
     // Basic checks that don't depend on any context
@@ -533,7 +568,7 @@ bool CheckTransaction(const CTransaction& tx, CValidationState &state, bool fChe
     if (tx.vout.empty())
         return state.DoS(10, false, REJECT_INVALID, "bad-txns-vout-empty");
     // Size limits (this doesn't take the witness into account, as that hasn't been checked for malleability)
-    if (::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS) > MAX_BLOCK_BASE_SIZE)
+    if (tx.GetBaseSize() > MAX_BLOCK_BASE_SIZE)
         return state.DoS(100, false, REJECT_INVALID, "bad-txns-oversize");
 
     // Check for negative or overflow output values
@@ -549,15 +584,9 @@ bool CheckTransaction(const CTransaction& tx, CValidationState &state, bool fChe
             return state.DoS(100, false, REJECT_INVALID, "bad-txns-txouttotal-toolarge");
     }
 
-    // Check for duplicate inputs - note that this check is slow so we skip it in CheckBlock
-    if (fCheckDuplicateInputs) {
-        std::set<COutPoint> vInOutPoints;
-        for (const auto& txin : tx.vin)
-        {
-            if (!vInOutPoints.insert(txin.prevout).second)
-                return state.DoS(100, false, REJECT_INVALID, "bad-txns-inputs-duplicate");
-        }
-    }
+    // Check for duplicate inputs
+    if (fCheckDuplicateInputs && HasDuplicateInputs(tx))
+        return state.DoS(100, false, REJECT_INVALID, "bad-txns-inputs-duplicate");
 
     if (tx.IsCoinBase())
     {
@@ -606,6 +635,54 @@ static bool IsCurrentForFeeEstimation()
     return true;
 }
 
+/** Policy checks on a transaction by itself, shared by AcceptToMemoryPool and PreverifyTransactionScripts */
+static bool CheckTxPolicy(const CTransaction& tx, bool witnessEnabled, CValidationState& state)
+{
+    // Reject transactions with witness before segregated witness activates (override with -prematurewitness)
+    if (!GetBoolArg("-prematurewitness",false) && tx.HasWitness() && !witnessEnabled) {
+        return state.DoS(0, false, REJECT_NONSTANDARD, "no-witness-yet", true);
+    }
+
+    // Rather not work on nonstandard transactions (unless -testnet/-regtest)
+    std::string reason;
+    if (fRequireStandard && !IsStandardTx(tx, reason, witnessEnabled))
+        return state.DoS(0, false, REJECT_NONSTANDARD, reason);
+
+    return true;
+}
+
+/**
+ * Policy checks on a transaction's inputs, sigops and fee once its inputs are
+ * in view, shared by AcceptToMemoryPool and PreverifyTransactionScripts.
+ * nSize is the virtual size and nModifiedFees includes prioritisation deltas.
+ */
+static bool CheckTxInputsPolicy(const CTxMemPool& pool, const CTransaction& tx, const CCoinsViewCache& view, int64_t nSigOpsCost,
+                                unsigned int nSize, CAmount nFees, CAmount nModifiedFees, CValidationState& state)
+{
+    // Check for non-standard pay-to-script-hash in inputs
+    if (fRequireStandard && !AreInputsStandard(tx, view))
+        return state.Invalid(false, REJECT_NONSTANDARD, "bad-txns-nonstandard-inputs");
+
+    // Check for non-standard witness in P2WSH
+    if (tx.HasWitness() && fRequireStandard && !IsWitnessStandard(tx, view))
+        return state.DoS(0, false, REJECT_NONSTANDARD, "bad-witness-nonstandard", true);
+
+    // Check that the transaction doesn't have an excessive number of
+    // sigops, making it impossible to mine. Since the coinbase transaction
+    // itself can contain sigops MAX_STANDARD_TX_SIGOPS is less than
+    // MAX_BLOCK_SIGOPS; we still consider this an invalid rather than
+    // merely non-standard transaction.
+    if (nSigOpsCost > MAX_STANDARD_TX_SIGOPS_COST)
+        return state.DoS(0, false, REJECT_NONSTANDARD, "bad-txns-too-many-sigops", false,
+            strprintf("%d", nSigOpsCost));
+
+    CAmount mempoolRejectFee = pool.GetMinFee(GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000).GetFee(nSize);
+    if (mempoolRejectFee > 0 && nModifiedFees < mempoolRejectFee)
+        return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "mempool min fee not met", false, strprintf("%d < %d", nFees, mempoolRejectFee));
+
+    return true;
+}
+
 bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const CTransactionRef& ptx, bool fLimitFree,
                               bool* pfMissingInputs, int64_t nAcceptTime, std::list<CTransactionRef>* plTxnReplaced,
                               bool fOverrideMempoolLimit, const CAmount& nAbsurdFee, std::vector<uint256>& vHashTxnToUncache)
@@ -623,16 +700,9 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const C
     if (tx.IsCoinBase())
         return state.DoS(100, false, REJECT_INVALID, "coinbase");
 
-    // Reject transactions with witness before segregated witness activates (override with -prematurewitness)
     bool witnessEnabled = IsWitnessEnabled(chainActive.Tip(), Params().GetConsensus(chainActive.Height()));
-    if (!GetBoolArg("-prematurewitness",false) && tx.HasWitness() && !witnessEnabled) {
-        return state.DoS(0, false, REJECT_NONSTANDARD, "no-witness-yet", true);
-    }
-
-    // Rather not work on nonstandard transactions (unless -testnet/-regtest)
-    std::string reason;
-    if (fRequireStandard && !IsStandardTx(tx, reason, witnessEnabled))
-        return state.DoS(0, false, REJECT_NONSTANDARD, reason);
+    if (!CheckTxPolicy(tx, witnessEnabled, state))
+        return false;
 
     // Only accept nLockTime-using transactions that can be mined in the next
     // block; we don't want our mempool filled up with transactions that can't
@@ -742,22 +812,14 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const C
             return state.DoS(0, false, REJECT_NONSTANDARD, "non-BIP68-final");
         }
 
-        // Check for non-standard pay-to-script-hash in inputs
-        if (fRequireStandard && !AreInputsStandard(tx, view))
-            return state.Invalid(false, REJECT_NONSTANDARD, "bad-txns-nonstandard-inputs");
-
-        // Check for non-standard witness in P2WSH
-        if (tx.HasWitness() && fRequireStandard && !IsWitnessStandard(tx, view))
-            return state.DoS(0, false, REJECT_NONSTANDARD, "bad-witness-nonstandard", true);
-
         int64_t nSigOpsCost = GetTransactionSigOpCost(tx, view, STANDARD_SCRIPT_VERIFY_FLAGS);
 
         CAmount nValueOut = tx.GetValueOut();
         CAmount nFees = nValueIn-nValueOut;
         // nModifiedFees includes any fee deltas from PrioritiseTransaction
         CAmount nModifiedFees = nFees;
-        double nPriorityDummy = 0;
-        pool.ApplyDeltas(hash, nPriorityDummy, nModifiedFees);
+        double dPriorityDelta = 0;
+        pool.ApplyDeltas(hash, dPriorityDelta, nModifiedFees);
 
         CAmount inChainInputValue;
         double dPriority = view.GetPriority(tx, chainActive.Height(), inChainInputValue);
@@ -777,19 +839,10 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const C
                               inChainInputValue, fSpendsCoinbase, nSigOpsCost, lp);
         unsigned int nSize = entry.GetTxSize();
 
-        // Check that the transaction doesn't have an excessive number of
-        // sigops, making it impossible to mine. Since the coinbase transaction
-        // itself can contain sigops MAX_STANDARD_TX_SIGOPS is less than
-        // MAX_BLOCK_SIGOPS; we still consider this an invalid rather than
-        // merely non-standard transaction.
-        if (nSigOpsCost > MAX_STANDARD_TX_SIGOPS_COST)
-            return state.DoS(0, false, REJECT_NONSTANDARD, "bad-txns-too-many-sigops", false,
-                strprintf("%d", nSigOpsCost));
-
-        CAmount mempoolRejectFee = pool.GetMinFee(GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000).GetFee(nSize);
-        if (mempoolRejectFee > 0 && nModifiedFees < mempoolRejectFee) {
-            return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "mempool min fee not met", false, strprintf("%d < %d", nFees, mempoolRejectFee));
-        } else if (GetBoolArg("-relaypriority", DEFAULT_RELAYPRIORITY) && nModifiedFees < ::minRelayTxFeeRate.GetFee(nSize) && !AllowFree(entry.GetPriority(chainActive.Height() + 1))) {
+        if (!CheckTxInputsPolicy(pool, tx, view, nSigOpsCost, nSize, nFees, nModifiedFees, state))
+            return false;
+
+        if (GetBoolArg("-relaypriority", DEFAULT_RELAYPRIORITY) && nModifiedFees < ::minRelayTxFeeRate.GetFee(nSize) && !AllowFree(entry.GetPriority(chainActive.Height() + 1))) {
             // Require that free transactions have sufficient priority to be mined in the next block.
             return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "insufficient priority");
         }
@@ -797,7 +850,7 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const C
         // Continuously rate-limit free (really, very-low-fee) transactions
         // This mitigates 'penny-flooding' -- sending thousands of free transactions just to
         // be annoying or make others' transactions take longer to confirm.
-        if (fLimitFree && nModifiedFees < GetDogecoinMinRelayFee(tx, nSize, !fLimitFree))
+        if (fLimitFree && nModifiedFees < GetDogecoinMinRelayFee(entry, dPriorityDelta, nModifiedFees - nFees, !fLimitFree))
         {
             static CCriticalSection csFreeLimiter;
             static double dFreeCount;
@@ -985,32 +1038,44 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const C
         // Check against previous transactions
         // This is done last to help prevent CPU exhaustion denial-of-service attacks.
         PrecomputedTransactionData txdata(tx);
-        if (!CheckInputs(tx, state, view, true, scriptVerifyFlags, true, txdata)) {
+        if (!CheckInputs(tx, state, view, true, scriptVerifyFlags, true, false, txdata)) {
             // SCRIPT_VERIFY_CLEANSTACK requires SCRIPT_VERIFY_WITNESS, so we
             // need to turn both off, and compare against just turning off CLEANSTACK
             // to see if the failure is specifically due to witness validation.
             CValidationState stateDummy; // Want reported failures to be from first CheckInputs
-            if (!tx.HasWitness() && CheckInputs(tx, stateDummy, view, true, scriptVerifyFlags & ~(SCRIPT_VERIFY_WITNESS | SCRIPT_VERIFY_CLEANSTACK), true, txdata) &&
-                !CheckInputs(tx, stateDummy, view, true, scriptVerifyFlags & ~SCRIPT_VERIFY_CLEANSTACK, true, txdata)) {
+            if (!tx.HasWitness() && CheckInputs(tx, stateDummy, view, true, scriptVerifyFlags & ~(SCRIPT_VERIFY_WITNESS | SCRIPT_VERIFY_CLEANSTACK), true, false, txdata) &&
+                !CheckInputs(tx, stateDummy, view, true, scriptVerifyFlags & ~SCRIPT_VERIFY_CLEANSTACK, true, false, txdata)) {
                 // Only the witness is missing, so the transaction itself may be fine.
                 state.SetCorruptionPossible();
             }
             return false; // state filled in by CheckInputs
         }
 
-        // Check again against just the consensus-critical mandatory script
-        // verification flags, in case of bugs in the standard flags that cause
-        // transactions to pass as valid when they're actually invalid. For
-        // instance the STRICTENC flag was incorrectly allowing certain
+        // Check again against the consensus-critical script verification
+        // flags of the next block, in case of bugs in the standard flags that
+        // cause transactions to pass as valid when they're actually invalid.
+        // For instance the STRICTENC flag was incorrectly allowing certain
         // CHECKSIG NOT scripts to pass, even though they were invalid.
         //
         // There is a similar check in CreateNewBlock() to prevent creating
         // invalid blocks, however allowing such transactions into the mempool
         // can be exploited as a DoS attack.
-        if (!CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true, txdata))
+        //
+        // Passing it caches the transaction as fully valid under these flags,
+        // so that its scripts are not run again when it comes in a block.
+        unsigned int nBlockScriptVerifyFlags = GetBlockScriptFlags(chainActive.Tip(), chainActive.Height() + 1, Params());
+        if (!CheckInputs(tx, state, view, true, nBlockScriptVerifyFlags, true, true, txdata))
         {
-            return error("%s: BUG! PLEASE REPORT THIS! ConnectInputs failed against MANDATORY but not STANDARD flags %s, %s",
-                __func__, hash.ToString(), FormatStateMessage(state));
+            // With -promiscuousmempoolflags the standard flags may lack some of the block flags
+            if (!(~scriptVerifyFlags & nBlockScriptVerifyFlags)) {
+                return error("%s: BUG! PLEASE REPORT THIS! ConnectInputs failed against next block but not STANDARD flags %s, %s",
+                    __func__, hash.ToString(), FormatStateMessage(state));
+            }
+            if (!CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true, false, txdata)) {
+                return error("%s: ConnectInputs failed against MANDATORY but not STANDARD flags due to promiscuous mempool %s, %s",
+                    __func__, hash.ToString(), FormatStateMessage(state));
+            }
+            LogPrintf("Warning: -promiscuousmempoolflags set to not include currently enforced soft forks, this may break mining or otherwise cause instability!\n");
         }
 
         // Remove conflicting transactions from the mempool
@@ -1450,7 +1515,38 @@ bool CheckTxInputs(const CChainParams& params, const CTransaction& tx, CValidati
 }
 }// namespace Consensus
 
-bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &inputs, bool fScriptChecks, unsigned int flags, bool cacheStore, PrecomputedTransactionData& txdata, std::vector<CScriptCheck> *pvChecks)
+namespace {
+/**
+ * Transactions whose scripts all passed under some flags, keyed by
+ * SHA256(nonce || wtxid || flags). Protected by cs_main.
+ */
+CuckooCache::cache<uint256, SignatureCacheHasher> scriptExecutionCache;
+uint256 scriptExecutionCacheNonce(GetRandHash());
+}
+
+void InitScriptExecutionCache()
+{
+    // Half as much memory as the signature cache, whose entries are per input rather than per transaction.
+    // nMaxCacheSize is unsigned. If -maxsigcachesize is set to zero,
+    // setup_bytes creates the minimum possible cache (2 elements).
+    size_t nMaxCacheSize = std::min(std::max((int64_t)0, GetArg("-maxsigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE) / 2), MAX_MAX_SIG_CACHE_SIZE) * ((size_t) 1 << 20);
+    size_t nElems = scriptExecutionCache.setup_bytes(nMaxCacheSize);
+    LogPrintf("Using %zu MiB out of %zu requested for script execution cache, able to store %zu elements\n",
+            (nElems*sizeof(uint256)) >>20, nMaxCacheSize>>20, nElems);
+}
+
+/**
+ * Key of tx in the script execution cache. The wtxid commits to the spent
+ * outputs through the prevouts, and to everything the scripts can look at.
+ */
+static uint256 GetScriptExecutionCacheEntry(const CTransaction& tx, unsigned int flags)
+{
+    uint256 hashCacheEntry;
+    CSHA256().Write(scriptExecutionCacheNonce.begin(), 32).Write(tx.GetWitnessHash().begin(), 32).Write((unsigned char*)&flags, sizeof(flags)).Finalize(hashCacheEntry.begin());
+    return hashCacheEntry;
+}
+
+bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &inputs, bool fScriptChecks, unsigned int flags, bool cacheSigStore, bool cacheFullScriptStore, PrecomputedTransactionData& txdata, std::vector<CScriptCheck> *pvChecks)
 {
     if (!tx.IsCoinBase())
     {
@@ -1470,13 +1566,19 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
         // Of course, if an assumed valid block is invalid due to false scriptSigs
         // this optimization would allow an invalid chain to be accepted.
         if (fScriptChecks) {
+            // Skip the scripts if the transaction already passed them under the same flags
+            uint256 hashCacheEntry = GetScriptExecutionCacheEntry(tx, flags);
+            AssertLockHeld(cs_main);
+            if (scriptExecutionCache.contains(hashCacheEntry, !cacheFullScriptStore))
+                return true;
+
             for (unsigned int i = 0; i < tx.vin.size(); i++) {
                 const COutPoint &prevout = tx.vin[i].prevout;
                 const CCoins* coins = inputs.AccessCoins(prevout.hash);
                 assert(coins);
 
                 // Verify signature
-                CScriptCheck check(*coins, tx, i, flags, cacheStore, &txdata);
+                CScriptCheck check(*coins, tx, i, flags, cacheSigStore, &txdata);
                 if (pvChecks) {
                     pvChecks->push_back(CScriptCheck());
                     check.swap(pvChecks->back());
@@ -1489,7 +1591,7 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
                         // avoid splitting the network between upgraded and
                         // non-upgraded nodes.
                         CScriptCheck check2(*coins, tx, i,
-                                flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheStore, &txdata);
+                                flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheSigStore, &txdata);
                         if (check2())
                             return state.Invalid(false, REJECT_NONSTANDARD, strprintf("non-mandatory-script-verify-flag (%s)", ScriptErrorString(check.GetScriptError())));
                     }
@@ -1503,6 +1605,10 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
                     return state.DoS(100,false, REJECT_INVALID, strprintf("mandatory-script-verify-flag-failed (%s)", ScriptErrorString(check.GetScriptError())));
                 }
             }
+
+            // Checks handed to the caller have not run yet, so only scripts run here are cached
+            if (cacheFullScriptStore && !pvChecks)
+                scriptExecutionCache.insert(hashCacheEntry);
         }
     }
 
@@ -1718,6 +1824,20 @@ void ThreadScriptCheck() {
     scriptcheckqueue.Thread();
 }
 
+static CCheckQueue<CBlockDataCheck> blockdatacheckqueue(128);
+
+void ThreadBlockDataCheck() {
+    RenameThread("bunkercoin-blockch");
+    blockdatacheckqueue.Thread();
+}
+
+static CCheckQueue<CScriptCheck> speculativecheckqueue(128);
+
+void ThreadSpeculativeScriptCheck() {
+    RenameThread("bunkercoin-specch");
+    speculativecheckqueue.Thread();
+}
+
 // Protected by cs_main
 VersionBitsCache versionbitscache;
 
@@ -1763,6 +1883,73 @@ public:
 // Protected by cs_main
 static ThresholdConditionCache warningcache[VERSIONBITS_NUM_BITS];
 
+unsigned int GetBlockScriptFlags(const CBlockIndex* pindexPrev, int nHeight, const CChainParams& chainparams)
+{
+    AssertLockHeld(cs_main);
+    const Consensus::Params& consensus = chainparams.GetConsensus(nHeight);
+
+    // BIP16 didn't become active until Apr 1 2012
+    // Dogecoin: BIP16 has been enabled since inception
+    bool fStrictPayToScriptHash = true;
+
+    unsigned int flags = fStrictPayToScriptHash ? SCRIPT_VERIFY_P2SH : SCRIPT_VERIFY_NONE;
+
+    // Start enforcing the DERSIG (BIP66) rule
+    if (nHeight >= chainparams.GetConsensus(0).BIP66Height) {
+        flags |= SCRIPT_VERIFY_DERSIG;
+    }
+
+    // Start enforcing CHECKLOCKTIMEVERIFY, (BIP65) for block.nVersion=4 blocks
+    if (nHeight >= chainparams.GetConsensus(0).BIP65Height) {
+        flags |= SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY;
+    }
+
+    // Start enforcing BIP112 (CHECKSEQUENCEVERIFY) using versionbits logic.
+    if (VersionBitsState(pindexPrev, consensus, Consensus::DEPLOYMENT_CSV, versionbitscache) == THRESHOLD_ACTIVE) {
+        flags |= SCRIPT_VERIFY_CHECKSEQUENCEVERIFY;
+    }
+
+    // Start enforcing WITNESS rules using versionbits logic.
+    if (IsWitnessEnabled(pindexPrev, consensus)) {
+        flags |= SCRIPT_VERIFY_WITNESS;
+        flags |= SCRIPT_VERIFY_NULLDUMMY;
+    }
+
+    return flags;
+}
+
+/** Whether the scripts of pindex have to be checked, which they need not for ancestors of the assumed valid block */
+static bool ShouldCheckScripts(const CBlockIndex* pindex, const Consensus::Params& consensus)
+{
+    AssertLockHeld(cs_main);
+    if (hashAssumeValid.IsNull())
+        return true;
+
+    // We've been configured with the hash of a block which has been externally verified to have a valid history.
+    // A suitable default value is included with the software and updated from time to time.  Because validity
+    //  relative to a piece of software is an objective fact these defaults can be easily reviewed.
+    // This setting doesn't force the selection of any particular chain but makes validating some faster by
+    //  effectively caching the result of part of the verification.
+    BlockMap::const_iterator  it = mapBlockIndex.find(hashAssumeValid);
+    if (it != mapBlockIndex.end()) {
+        if (it->second->GetAncestor(pindex->nHeight) == pindex &&
+            pindexBestHeader->GetAncestor(pindex->nHeight) == pindex &&
+            pindexBestHeader->nChainWork >= UintToArith256(consensus.nMinimumChainWork)) {
+            // This block is a member of the assumed verified chain and an ancestor of the best header.
+            // The equivalent time check discourages hashpower from extorting the network via DOS attack
+            //  into accepting an invalid block through telling users they must manually set assumevalid.
+            //  Requiring a software change or burying the invalid block, regardless of the setting, makes
+            //  it hard to hide the implication of the demand.  This also avoids having release candidates
+            //  that are hardly doing any signature verification at all in testing without having to
+            //  artificially set the default assumed verified block further back.
+            // The test against nMinimumChainWork prevents the skipping when denied access to any chain at
+            //  least as good as the expected chain.
+            return (GetBlockProofEquivalentTime(*pindexBestHeader, *pindex, *pindexBestHeader, consensus) <= 60 * 60 * 24 * 7 * 2);
+        }
+    }
+    return true;
+}
+
 static int64_t nTimeCheck = 0;
 static int64_t nTimeForks = 0;
 static int64_t nTimeVerify = 0;
@@ -1815,31 +2002,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         return true;
     }
 
-    bool fScriptChecks = true;
-    if (!hashAssumeValid.IsNull()) {
-        // We've been configured with the hash of a block which has been externally verified to have a valid history.
-        // A suitable default value is included with the software and updated from time to time.  Because validity
-        //  relative to a piece of software is an objective fact these defaults can be easily reviewed.
-        // This setting doesn't force the selection of any particular chain but makes validating some faster by
-        //  effectively caching the result of part of the verification.
-        BlockMap::const_iterator  it = mapBlockIndex.find(hashAssumeValid);
-        if (it != mapBlockIndex.end()) {
-            if (it->second->GetAncestor(pindex->nHeight) == pindex &&
-                pindexBestHeader->GetAncestor(pindex->nHeight) == pindex &&
-                pindexBestHeader->nChainWork >= UintToArith256(consensus.nMinimumChainWork)) {
-                // This block is a member of the assumed verified chain and an ancestor of the best header.
-                // The equivalent time check discourages hashpower from extorting the network via DOS attack
-                //  into accepting an invalid block through telling users they must manually set assumevalid.
-                //  Requiring a software change or burying the invalid block, regardless of the setting, makes
-                //  it hard to hide the implication of the demand.  This also avoids having release candidates
-                //  that are hardly doing any signature verification at all in testing without having to
-                //  artificially set the default assumed verified block further back.
-                // The test against nMinimumChainWork prevents the skipping when denied access to any chain at
-                //  least as good as the expected chain.
-                fScriptChecks = (GetBlockProofEquivalentTime(*pindexBestHeader, *pindex, *pindexBestHeader, consensus) <= 60 * 60 * 24 * 7 * 2);
-            }
-        }
-    }
+    bool fScriptChecks = ShouldCheckScripts(pindex, consensus);
 
     int64_t nTime1 = GetTimeMicros(); nTimeCheck += nTime1 - nTimeStart;
     LogPrint("bench", "    - Sanity checks: %.2fms [%.2fs]\n", 0.001 * (nTime1 - nTimeStart), nTimeCheck * 0.000001);
@@ -1878,35 +2041,14 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         }
     }
 
-    // BIP16 didn't become active until Apr 1 2012
-    // Dogecoin: BIP16 has been enabled since inception
-    bool fStrictPayToScriptHash = true;
-
-    unsigned int flags = fStrictPayToScriptHash ? SCRIPT_VERIFY_P2SH : SCRIPT_VERIFY_NONE;
+    unsigned int flags = GetBlockScriptFlags(pindex->pprev, pindex->nHeight, chainparams);
 
-    // Start enforcing the DERSIG (BIP66) rule
-    if (pindex->nHeight >= chainparams.GetConsensus(0).BIP66Height) {
-        flags |= SCRIPT_VERIFY_DERSIG;
-    }
-
-    // Start enforcing CHECKLOCKTIMEVERIFY, (BIP65) for block.nVersion=4 blocks
-    if (pindex->nHeight >= chainparams.GetConsensus(0).BIP65Height) {
-        flags |= SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY;
-    }
-
-    // Start enforcing BIP68 (sequence locks) and BIP112 (CHECKSEQUENCEVERIFY) using versionbits logic.
+    // Start enforcing BIP68 (sequence locks) along with BIP112 (CHECKSEQUENCEVERIFY)
     int nLockTimeFlags = 0;
-    if (VersionBitsState(pindex->pprev, consensus, Consensus::DEPLOYMENT_CSV, versionbitscache) == THRESHOLD_ACTIVE) {
-        flags |= SCRIPT_VERIFY_CHECKSEQUENCEVERIFY;
+    if (flags & SCRIPT_VERIFY_CHECKSEQUENCEVERIFY) {
         nLockTimeFlags |= LOCKTIME_VERIFY_SEQUENCE;
     }
 
-    // Start enforcing WITNESS rules using versionbits logic.
-    if (IsWitnessEnabled(pindex->pprev, consensus)) {
-        flags |= SCRIPT_VERIFY_WITNESS;
-        flags |= SCRIPT_VERIFY_NULLDUMMY;
-    }
-
     int64_t nTime2 = GetTimeMicros(); nTimeForks += nTime2 - nTime1;
     LogPrint("bench", "    - Fork checks: %.2fms [%.2fs]\n", 0.001 * (nTime2 - nTime1), nTimeForks * 0.000001);
 
@@ -1966,7 +2108,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
             std::vector<CScriptCheck> vChecks;
             bool fCacheResults = fJustCheck; /* Don't cache results if we're actually connecting blocks (still consult the cache, though) */
-            if (!CheckInputs(tx, state, view, fScriptChecks, flags, fCacheResults, txdata[i], nScriptCheckThreads ? &vChecks : NULL))
+            if (!CheckInputs(tx, state, view, fScriptChecks, flags, fCacheResults, fCacheResults, txdata[i], nScriptCheckThreads ? &vChecks : NULL))
                 return error("ConnectBlock(): CheckInputs on %s failed with %s",
                     tx.GetHash().ToString(), FormatStateMessage(state));
             control.Add(vChecks);
@@ -1979,7 +2121,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         UpdateCoins(tx, view, i == 0 ? undoDummy : blockundo.vtxundo.back(), pindex->nHeight);
 
         vPos.push_back(std::make_pair(tx.GetHash(), pos));
-        pos.nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
+        pos.nTxOffset += tx.GetTotalSize();
     }
     int64_t nTime3 = GetTimeMicros(); nTimeConnect += nTime3 - nTime2;
     LogPrint("bench", "      - Connect %u transactions: %.2fms (%.3fms/tx, %.3fms/txin) [%.2fs]\n", (unsigned)block.vtx.size(), 0.001 * (nTime3 - nTime2), 0.001 * (nTime3 - nTime2) / block.vtx.size(), nInputs <= 1 ? 0 : 0.001 * (nTime3 - nTime2) / (nInputs-1), nTimeConnect * 0.000001);
@@ -2284,6 +2426,108 @@ static int64_t nTimeConnectTotal = 0;
 static int64_t nTimeFlush = 0;
 static int64_t nTimeChainState = 0;
 static int64_t nTimePostConnect = 0;
+static int64_t nTimeSpeculativeWait = 0;
+
+namespace {
+
+/**
+ * Block whose scripts are checked on speculativecheckqueue while the block
+ * before it is connected. Only inputs spending outputs that were in
+ * pcoinsTip before that block are checked. If all checks pass, transactions
+ * of which every input was checked are added to the script execution cache;
+ * the signatures of the other transactions go into the signature cache. This
+ * way ConnectBlock can skip that work. Nothing else depends on the result.
+ */
+struct SpeculativeBlock
+{
+    uint256 hashBlock;
+    std::shared_ptr<const CBlock> pblock;
+    //! Referenced by the queued checks
+    std::vector<PrecomputedTransactionData> txdata;
+    //! Script execution cache entries of the transactions whose inputs are all checked
+    std::vector<uint256> vCacheEntries;
+    size_t nChecks;
+};
+
+//! Block of the checks on speculativecheckqueue, protected by cs_main
+std::unique_ptr<SpeculativeBlock> pspeculativeBlock;
+
+} // anon namespace
+
+void StartSpeculativeChecks(const CBlockIndex* pindex, const CChainParams& chainparams)
+{
+    AssertLockHeld(cs_main);
+    assert(!pspeculativeBlock);
+    const Consensus::Params& consensus = chainparams.GetConsensus(pindex->nHeight);
+    if (!fSpeculativeVerify || !(pindex->nStatus & BLOCK_HAVE_DATA) || !ShouldCheckScripts(pindex, consensus))
+        return;
+
+    std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+    // A failed read is reported when the block is connected
+    if (!ReadBlockFromDisk(*pblock, pindex, consensus))
+        return;
+
+    std::unique_ptr<SpeculativeBlock> pspeculative(new SpeculativeBlock());
+    pspeculative->hashBlock = pindex->GetBlockHash();
+    pspeculative->pblock = pblock;
+    pspeculative->txdata.reserve(pblock->vtx.size()); // Required so that pointers to individual PrecomputedTransactionData don't get invalidated
+    unsigned int flags = GetBlockScriptFlags(pindex->pprev, pindex->nHeight, chainparams);
+    std::vector<CScriptCheck> vChecks;
+    for (const auto& ptx : pblock->vtx) {
+        const CTransaction& tx = *ptx;
+        if (tx.IsCoinBase())
+            continue;
+        uint256 hashCacheEntry = GetScriptExecutionCacheEntry(tx, flags);
+        if (scriptExecutionCache.contains(hashCacheEntry, false))
+            continue;
+        // Outputs created by the block being connected or by this one are not known yet
+        std::vector<const CCoins*> vCoins(tx.vin.size());
+        bool fAllInputs = true;
+        for (unsigned int i = 0; i < tx.vin.size(); i++) {
+            const CCoins* coins = pcoinsTip->AccessCoins(tx.vin[i].prevout.hash);
+            if (coins && coins->IsAvailable(tx.vin[i].prevout.n))
+                vCoins[i] = coins;
+            else
+                fAllInputs = false;
+        }
+        // A transaction checked as a whole is skipped by ConnectBlock, so only the signatures of the others are worth caching
+        pspeculative->txdata.emplace_back(tx);
+        for (unsigned int i = 0; i < tx.vin.size(); i++) {
+            if (!vCoins[i])
+                continue;
+            CScriptCheck check(*vCoins[i], tx, i, flags, !fAllInputs, &pspeculative->txdata.back());
+            vChecks.push_back(CScriptCheck());
+            check.swap(vChecks.back());
+        }
+        if (fAllInputs)
+            pspeculative->vCacheEntries.push_back(hashCacheEntry);
+    }
+    pspeculative->nChecks = vChecks.size();
+    speculativecheckqueue.Add(vChecks);
+    pspeculativeBlock = std::move(pspeculative);
+}
+
+std::shared_ptr<const CBlock> FinishSpeculativeChecks(const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+    if (!pspeculativeBlock)
+        return std::shared_ptr<const CBlock>();
+
+    int64_t nTimeStart = GetTimeMicros();
+    bool fAllOk = speculativecheckqueue.Wait();
+    std::unique_ptr<SpeculativeBlock> pspeculative = std::move(pspeculativeBlock);
+    if (!pindex || pspeculative->hashBlock != pindex->GetBlockHash())
+        return std::shared_ptr<const CBlock>();
+
+    // A failure makes the queue skip the remaining checks, so only a full pass says anything about transactions
+    if (fAllOk) {
+        for (const uint256& hashCacheEntry : pspeculative->vCacheEntries)
+            scriptExecutionCache.insert(hashCacheEntry);
+    }
+    int64_t nTimeEnd = GetTimeMicros(); nTimeSpeculativeWait += nTimeEnd - nTimeStart;
+    LogPrint("bench", "  - Speculative checks: %u txins, %u whole txs, waited %.2fms [%.2fs]\n", (unsigned)pspeculative->nChecks, fAllOk ? (unsigned)pspeculative->vCacheEntries.size() : 0, 0.001 * (nTimeEnd - nTimeStart), nTimeSpeculativeWait * 0.000001);
+    return pspeculative->pblock;
+}
 
 /**
  * Used to track blocks whose transactions were applied to the UTXO state as a
@@ -2458,7 +2702,17 @@ static bool ActivateBestChainStep(CValidationState& state, const CChainParams& c
 
         // Connect new blocks.
         BOOST_REVERSE_FOREACH(CBlockIndex *pindexConnect, vpindexToConnect) {
-            if (!ConnectTip(state, chainparams, pindexConnect, pindexConnect == pindexMostWork ? pblock : std::shared_ptr<const CBlock>(), connectTrace)) {
+            // Take the results of checking this block ahead, then start on the next one while this one is connected
+            std::shared_ptr<const CBlock> pblockConnect = FinishSpeculativeChecks(pindexConnect);
+            if (pindexConnect == pindexMostWork) {
+                if (pblock)
+                    pblockConnect = pblock;
+            } else {
+                StartSpeculativeChecks(pindexMostWork->GetAncestor(pindexConnect->nHeight + 1), chainparams);
+            }
+            if (!ConnectTip(state, chainparams, pindexConnect, pblockConnect, connectTrace)) {
+                // The next block will not be connected after this one, drop the checks queued for it
+                FinishSpeculativeChecks(NULL);
                 if (state.IsInvalid()) {
                     // The block violates a consensus rule.
                     if (!state.CorruptionPossible())
@@ -2968,11 +3222,26 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
         if (block.vtx[i]->IsCoinBase())
             return state.DoS(100, false, REJECT_INVALID, "bad-cb-multiple", false, "more than one coinbase");
 
-    // Check transactions
-    for (const auto& tx : block.vtx)
-        if (!CheckTransaction(*tx, state, true))
-            return state.Invalid(false, state.GetRejectCode(), state.GetRejectReason(),
-                                 strprintf("Transaction check failed (tx hash %s) %s", tx->GetHash().ToString(), state.GetDebugMessage()));
+    // Check transactions, on the transaction check threads if there are any.
+    // They also count the legacy sigops of each transaction, which are then
+    // summed up below from the cache.
+    bool fTransactionsOk = false;
+    if (nScriptCheckThreads && block.vtx.size() > 1) {
+        CCheckQueueControl<CBlockDataCheck> control(&blockdatacheckqueue);
+        std::vector<CBlockDataCheck> vChecks;
+        vChecks.reserve(block.vtx.size());
+        for (const auto& tx : block.vtx)
+            vChecks.push_back(CBlockDataCheck(*tx));
+        control.Add(vChecks);
+        fTransactionsOk = control.Wait();
+    }
+    // Otherwise, or to find the first failing transaction and its reject reason
+    if (!fTransactionsOk) {
+        for (const auto& tx : block.vtx)
+            if (!CheckTransaction(*tx, state, true))
+                return state.Invalid(false, state.GetRejectCode(), state.GetRejectReason(),
+                                     strprintf("Transaction check failed (tx hash %s) %s", tx->GetHash().ToString(), state.GetDebugMessage()));
+    }
 
     unsigned int nSigOps = 0;
     for (const auto& tx : block.vtx)
@@ -3194,7 +3463,7 @@ bool ContextualCheckBlock(const CBlock& block, CValidationState& state, const CB
     return true;
 }
 
-static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex)
+static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, bool fCheckPOW = true)
 {
     AssertLockHeld(cs_main);
     // Check for duplicate
@@ -3213,7 +3482,7 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
             return true;
         }
 
-        if (!CheckBlockHeader(block, state))
+        if (!CheckBlockHeader(block, state, fCheckPOW))
             return error("%s: Consensus::CheckBlockHeader: %s, %s", __func__, hash.ToString(), FormatStateMessage(state));
 
         // Get prev block index
@@ -3261,13 +3530,13 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
 }
 
 // Exposed wrapper for AcceptBlockHeader
-bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidationState& state, const CChainParams& chainparams, const CBlockIndex** ppindex)
+bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidationState& state, const CChainParams& chainparams, const CBlockIndex** ppindex, bool fCheckPOW)
 {
     {
         LOCK(cs_main);
         for (const CBlockHeader& header : headers) {
             CBlockIndex *pindex = NULL; // Use a temp pindex instead of ppindex to avoid a const_cast
-            if (!AcceptBlockHeader(header, state, chainparams, &pindex)) {
+            if (!AcceptBlockHeader(header, state, chainparams, &pindex, fCheckPOW)) {
                 return false;
             }
             if (ppindex) {
@@ -3279,6 +3548,36 @@ bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidatio
     return true;
 }
 
+bool CBlockDataCheck::operator()() {
+    CValidationState state;
+    if (pheader)
+        return CheckBlockHeader(*pheader, state);
+    if (!CheckTransaction(*ptx, state, true))
+        return false;
+    ptx->GetLegacySigOpCount();
+    return true;
+}
+
+bool CheckBlockHeaders(const std::vector<CBlockHeader>& headers, CValidationState& state)
+{
+    if (nScriptCheckThreads) {
+        CCheckQueueControl<CBlockDataCheck> control(&blockdatacheckqueue);
+        std::vector<CBlockDataCheck> vChecks;
+        vChecks.reserve(headers.size());
+        for (const CBlockHeader& header : headers)
+            vChecks.push_back(CBlockDataCheck(header));
+        control.Add(vChecks);
+        if (control.Wait())
+            return true;
+        // Fall through to find the failing header and its reject reason
+    }
+    for (const CBlockHeader& header : headers) {
+        if (!CheckBlockHeader(header, state))
+            return error("%s: Consensus::CheckBlockHeader: %s, %s", __func__, header.GetHash().ToString(), FormatStateMessage(state));
+    }
+    return true;
+}
+
 /** Store block on disk. If dbp is non-NULL, the file is known to already reside on disk */
 static bool AcceptBlock(const std::shared_ptr<const CBlock>& pblock, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, bool fRequested, const CDiskBlockPos* dbp, bool* fNewBlock)
 {
@@ -3942,6 +4241,7 @@ bool RewindBlockIndex(const CChainParams& params)
 void UnloadBlockIndex()
 {
     LOCK(cs_main);
+    FinishSpeculativeChecks(NULL);
     setBlockIndexCandidates.clear();
     chainActive.SetTip(NULL);
     pindexBestInvalid = NULL;
@@ -4339,6 +4639,210 @@ int VersionBitsTipStateSinceHeight(const Consensus::Params& params, Consensus::D
 }
 
 static const uint64_t MEMPOOL_DUMP_VERSION = 1;
+/** Number of transactions read from mempool.dat before their scripts are checked together */
+static const unsigned int MEMPOOL_LOAD_BATCH_SIZE = 1000;
+
+/** Verify the scripts of a single transaction ahead of AcceptToMemoryPool, see validation.h */
+bool PreverifyTransactionScripts(CTxMemPool& pool, const CTransaction& tx, std::vector<CTxOut>& vSpent)
+{
+    vSpent.clear();
+
+    // The cheap checks of AcceptToMemoryPool come first, so that nobody gets
+    // signatures verified for free. Free and replacement transactions are
+    // left to AcceptToMemoryPool.
+    CValidationState state;
+    if (!CheckTransaction(tx, state) || tx.IsCoinBase())
+        return false;
+    {
+        LOCK2(cs_main, pool.cs);
+        bool witnessEnabled = IsWitnessEnabled(chainActive.Tip(), Params().GetConsensus(chainActive.Height()));
+        if (!CheckTxPolicy(tx, witnessEnabled, state))
+            return false;
+        if (pool.exists(tx.GetHash()))
+            return false;
+
+        CCoinsViewMemPool viewMemPool(pcoinsTip, pool);
+        CCoinsViewCache view(&viewMemPool);
+        for (const CTxIn& txin : tx.vin) {
+            if (pool.mapNextTx.count(txin.prevout))
+                return false;
+            const CCoins* coins = view.AccessCoins(txin.prevout.hash);
+            if (!coins || !coins->IsAvailable(txin.prevout.n))
+                return false;
+        }
+        int64_t nSigOpsCost = GetTransactionSigOpCost(tx, view, STANDARD_SCRIPT_VERIFY_FLAGS);
+        CAmount nValueIn = view.GetValueIn(tx);
+        CAmount nValueOut = tx.GetValueOut();
+        if (nValueIn < nValueOut)
+            return false;
+        CAmount nFees = nValueIn - nValueOut;
+        CAmount nModifiedFees = nFees;
+        double dPriorityDelta = 0;
+        pool.ApplyDeltas(tx.GetHash(), dPriorityDelta, nModifiedFees);
+        unsigned int nSize = GetVirtualTransactionSize(tx, nSigOpsCost);
+        if (!CheckTxInputsPolicy(pool, tx, view, nSigOpsCost, nSize, nFees, nModifiedFees, state))
+            return false;
+        if (nModifiedFees < GetDogecoinMinRelayFee(tx, nSize, false))
+            return false;
+
+        vSpent.reserve(tx.vin.size());
+        for (const CTxIn& txin : tx.vin)
+            vSpent.push_back(view.AccessCoins(txin.prevout.hash)->vout[txin.prevout.n]);
+    }
+
+    // Verify without the lock, on the script check threads if there are any.
+    // AcceptToMemoryPool fetches the inputs again and runs the scripts itself;
+    // the cached signatures only help it if the inputs are still the same.
+    PrecomputedTransactionData txdata(tx);
+    std::vector<CScriptCheck> vChecks;
+    vChecks.reserve(tx.vin.size());
+    for (unsigned int i = 0; i < tx.vin.size(); i++) {
+        CScriptCheck check(vSpent[i], tx, i, STANDARD_SCRIPT_VERIFY_FLAGS, true, &txdata);
+        vChecks.push_back(CScriptCheck());
+        check.swap(vChecks.back());
+    }
+    bool fValid = true;
+    if (nScriptCheckThreads) {
+        CCheckQueueControl<CScriptCheck> control(&scriptcheckqueue);
+        control.Add(vChecks);
+        fValid = control.Wait();
+    } else {
+        for (CScriptCheck& check : vChecks) {
+            if (!check()) {
+                fValid = false;
+                break;
+            }
+        }
+    }
+    if (!fValid) {
+        UncacheTransactionScripts(tx, vSpent);
+        vSpent.clear();
+    }
+    return fValid;
+}
+
+void UncacheTransactionScripts(const CTransaction& tx, const std::vector<CTxOut>& vSpent)
+{
+    PrecomputedTransactionData txdata(tx);
+    for (unsigned int i = 0; i < vSpent.size(); i++) {
+        UncachingTransactionSignatureChecker checker(&tx, i, vSpent[i].nValue, txdata);
+        VerifyScript(tx.vin[i].scriptSig, vSpent[i].scriptPubKey, &tx.vin[i].scriptWitness, STANDARD_SCRIPT_VERIFY_FLAGS, checker);
+    }
+}
+
+/**
+ * Verify the scripts of transactions about to be accepted to the mempool
+ * on the script check threads. Inputs may be confirmed, in the mempool or
+ * created by other transactions of vtx. Valid signatures end up in the
+ * signature cache, so accepting the transactions afterwards, one at a time
+ * under cs_main, does not verify them again. Failures are left for
+ * AcceptToMemoryPool to report.
+ */
+static void PrecheckScripts(CTxMemPool& pool, const std::vector<CTransactionRef>& vtx)
+{
+    if (nScriptCheckThreads == 0)
+        return;
+
+    std::map<uint256, CCoins> mapBatchCoins;
+    for (const CTransactionRef& tx : vtx)
+        mapBatchCoins.insert(std::make_pair(tx->GetHash(), CCoins(*tx, MEMPOOL_HEIGHT)));
+
+    std::vector<PrecomputedTransactionData> vTxData;
+    vTxData.reserve(vtx.size());
+    std::vector<CScriptCheck> vChecks;
+    {
+        LOCK2(cs_main, pool.cs);
+        CCoinsViewMemPool viewMemPool(pcoinsTip, pool);
+        CCoinsViewCache view(&viewMemPool);
+        for (const CTransactionRef& tx : vtx) {
+            if (tx->IsCoinBase())
+                continue;
+            std::vector<const CCoins*> vCoins;
+            for (const CTxIn& txin : tx->vin) {
+                const CCoins* coins = view.AccessCoins(txin.prevout.hash);
+                if (!coins) {
+                    std::map<uint256, CCoins>::const_iterator it = mapBatchCoins.find(txin.prevout.hash);
+                    if (it != mapBatchCoins.end())
+                        coins = &it->second;
+                }
+                if (!coins || !coins->IsAvailable(txin.prevout.n))
+                    break;
+                vCoins.push_back(coins);
+            }
+            if (vCoins.size() != tx->vin.size())
+                continue;
+            vTxData.emplace_back(*tx);
+            for (unsigned int i = 0; i < tx->vin.size(); i++) {
+                CScriptCheck check(*vCoins[i], *tx, i, STANDARD_SCRIPT_VERIFY_FLAGS, true, &vTxData.back());
+                vChecks.push_back(CScriptCheck());
+                check.swap(vChecks.back());
+            }
+        }
+    }
+
+    CCheckQueueControl<CScriptCheck> control(&scriptcheckqueue);
+    control.Add(vChecks);
+    control.Wait();
+}
+
+/** Order the indexes of vtx so that transactions come after their parents in vtx, otherwise keeping their order */
+static std::vector<size_t> SortTopologically(const std::vector<CTransactionRef>& vtx)
+{
+    std::map<uint256, size_t> mapIndex;
+    for (size_t i = 0; i < vtx.size(); i++)
+        mapIndex.insert(std::make_pair(vtx[i]->GetHash(), i));
+
+    std::vector<size_t> vParentCount(vtx.size(), 0);
+    std::vector<std::vector<size_t> > vChildren(vtx.size());
+    for (size_t i = 0; i < vtx.size(); i++) {
+        std::set<size_t> setParents;
+        for (const CTxIn& txin : vtx[i]->vin) {
+            std::map<uint256, size_t>::const_iterator it = mapIndex.find(txin.prevout.hash);
+            if (it != mapIndex.end() && it->second != i && setParents.insert(it->second).second)
+                vChildren[it->second].push_back(i);
+        }
+        vParentCount[i] = setParents.size();
+    }
+
+    std::vector<size_t> vOrder;
+    vOrder.reserve(vtx.size());
+    std::priority_queue<size_t, std::vector<size_t>, std::greater<size_t> > queueReady;
+    for (size_t i = 0; i < vtx.size(); i++) {
+        if (vParentCount[i] == 0)
+            queueReady.push(i);
+    }
+    while (!queueReady.empty()) {
+        size_t i = queueReady.top();
+        queueReady.pop();
+        vOrder.push_back(i);
+        for (size_t nChild : vChildren[i]) {
+            if (--vParentCount[nChild] == 0)
+                queueReady.push(nChild);
+        }
+    }
+    return vOrder;
+}
+
+unsigned int AcceptToMemoryPoolBatch(CTxMemPool& pool, const std::vector<CTransactionRef>& vtx, bool fLimitFree,
+                                     std::vector<CValidationState>& vState, std::vector<bool>& vMissingInputs,
+                                     bool fOverrideMempoolLimit, const CAmount nAbsurdFee)
+{
+    vState.assign(vtx.size(), CValidationState());
+    vMissingInputs.assign(vtx.size(), false);
+
+    std::vector<size_t> vOrder = SortTopologically(vtx);
+    PrecheckScripts(pool, vtx);
+
+    unsigned int nAccepted = 0;
+    LOCK(cs_main);
+    for (size_t i : vOrder) {
+        bool fMissingInputs = false;
+        if (AcceptToMemoryPool(pool, vState[i], vtx[i], fLimitFree, &fMissingInputs, NULL, fOverrideMempoolLimit, nAbsurdFee))
+            nAccepted++;
+        vMissingInputs[i] = fMissingInputs;
+    }
+    return nAccepted;
+}
 
 bool LoadMempool(void)
 {
@@ -4354,6 +4858,7 @@ bool LoadMempool(void)
     int64_t skipped = 0;
     int64_t failed = 0;
     int64_t nNow = GetTime();
+    int64_t nStart = GetTimeMicros();
 
     try {
         uint64_t version;
@@ -4364,30 +4869,44 @@ bool LoadMempool(void)
         uint64_t num;
         file >> num;
         double prioritydummy = 0;
-        while (num--) {
-            CTransactionRef tx;
-            int64_t nTime;
-            int64_t nFeeDelta;
-            file >> tx;
-            file >> nTime;
-            file >> nFeeDelta;
-
-            CAmount amountdelta = nFeeDelta;
-            if (amountdelta) {
-                mempool.PrioritiseTransaction(tx->GetHash(), tx->GetHash().ToString(), prioritydummy, amountdelta);
+        std::vector<CTransactionRef> vtx;
+        std::vector<int64_t> vTime;
+        while (num) {
+            // Read a batch, then check its scripts in parallel before accepting it in file order
+            while (num && vtx.size() < MEMPOOL_LOAD_BATCH_SIZE) {
+                num--;
+                CTransactionRef tx;
+                int64_t nTime;
+                int64_t nFeeDelta;
+                file >> tx;
+                file >> nTime;
+                file >> nFeeDelta;
+
+                CAmount amountdelta = nFeeDelta;
+                if (amountdelta) {
+                    mempool.PrioritiseTransaction(tx->GetHash(), tx->GetHash().ToString(), prioritydummy, amountdelta);
+                }
+                if (nTime + nExpiryTimeout > nNow) {
+                    vtx.push_back(tx);
+                    vTime.push_back(nTime);
+                } else {
+                    ++skipped;
+                }
             }
-            CValidationState state;
-            if (nTime + nExpiryTimeout > nNow) {
+
+            PrecheckScripts(mempool, vtx);
+            for (size_t i = 0; i < vtx.size(); i++) {
+                CValidationState state;
                 LOCK(cs_main);
-                AcceptToMemoryPoolWithTime(mempool, state, tx, true, NULL, nTime);
+                AcceptToMemoryPoolWithTime(mempool, state, vtx[i], true, NULL, vTime[i]);
                 if (state.IsValid()) {
                     ++count;
                 } else {
                     ++failed;
                 }
-            } else {
-                ++skipped;
             }
+            vtx.clear();
+            vTime.clear();
             if (ShutdownRequested())
                 return false;
         }
@@ -4402,7 +4921,7 @@ bool LoadMempool(void)
         return false;
     }
 
-    LogPrintf("Imported mempool transactions from disk: %i successes, %i failed, %i expired\n", count, failed, skipped);
+    LogPrintf("Imported mempool transactions from disk: %i successes, %i failed, %i expired (%.2fs)\n", count, failed, skipped, 0.000001 * (GetTimeMicros() - nStart));
     return true;
 }
 
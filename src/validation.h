@@ -79,6 +79,8 @@ static const unsigned int DEFAULT_DESCENDANT_LIMIT = 25;
 static const unsigned int DEFAULT_DESCENDANT_SIZE_LIMIT = 101;
 /** Default for -mempoolexpiry, expiration time for mempool transactions in hours */
 static const unsigned int DEFAULT_MEMPOOL_EXPIRY = 24;
+/** Default for -mempoolsnapshotinterval, minutes between snapshots of a changed mempool to disk */
+static const unsigned int DEFAULT_MEMPOOL_SNAPSHOT_INTERVAL = 15;
 /** The maximum size of a blk?????.dat file (since 0.8) */
 static const unsigned int MAX_BLOCKFILE_SIZE = 0x8000000; // 128 MiB
 /** The pre-allocation chunk size for blk?????.dat files (since 0.8) */
@@ -90,10 +92,21 @@ static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
-/** Number of blocks that can be requested at any given time from a single peer. */
+/** Default for -speculativeverify */
+static const bool DEFAULT_SPECULATIVE_VERIFY = true;
+/** Number of blocks that can be requested at any given time from a single peer, until its throughput is known. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
+/** Bounds of the number of blocks in transit from a single peer once it is sized by the peer's measured throughput. */
+static const int MIN_BLOCKS_IN_TRANSIT_PER_PEER = 4;
+static const int MAX_ADAPTIVE_BLOCKS_IN_TRANSIT_PER_PEER = 64;
+/** Time in microseconds worth of blocks requested from a peer on top of its round trip time. */
+static const int64_t BLOCK_DOWNLOAD_QUEUE_TARGET = 2 * 1000000;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
 static const unsigned int BLOCK_STALLING_TIMEOUT = 2;
+/** Upper bound of the stalling timeout, which grows with the peer's measured block latency. */
+static const unsigned int BLOCK_STALLING_TIMEOUT_MAX = 4 * BLOCK_STALLING_TIMEOUT;
+/** Number of recent block latencies of a peer whose minimum sizes its stalling timeout. */
+static const unsigned int BLOCK_STALLING_LATENCY_SAMPLES = 8;
 /** Number of headers sent in one getheaders result. We rely on the assumption that if a peer sends
  *  less than this number, we reached its tip. Changing this value is a protocol upgrade. */
 static const unsigned int MAX_HEADERS_RESULTS = 2000;
@@ -107,6 +120,10 @@ static const int MAX_BLOCKTXN_DEPTH = 10;
  *  degree of disordering of blocks on disk (which make reindexing and in the future perhaps pruning
  *  harder). We'll probably want to make this a per-peer adaptive value at some point. */
 static const unsigned int BLOCK_DOWNLOAD_WINDOW = 1024;
+/** The download window grows beyond BLOCK_DOWNLOAD_WINDOW, up to MAX_BLOCK_DOWNLOAD_WINDOW blocks, while
+ *  recently downloaded blocks are small enough for it to span fewer than BLOCK_DOWNLOAD_WINDOW_BYTES. */
+static const unsigned int MAX_BLOCK_DOWNLOAD_WINDOW = 8192;
+static const uint64_t BLOCK_DOWNLOAD_WINDOW_BYTES = 256 * 1024 * 1024;
 /** Time to wait (in seconds) between writing blocks/block index to disk. */
 static const unsigned int DATABASE_WRITE_INTERVAL = 60 * 60;
 /** Time to wait (in seconds) between flushing chainstate to disk. */
@@ -176,6 +193,8 @@ extern CConditionVariable cvBlockChange;
 extern std::atomic_bool fImporting;
 extern bool fReindex;
 extern int nScriptCheckThreads;
+/** Whether the scripts of the next block are checked while the current one is connected */
+extern bool fSpeculativeVerify;
 extern bool fTxIndex;
 extern bool fIsBareMultisigStd;
 extern bool fRequireStandard;
@@ -255,7 +274,15 @@ bool ProcessNewBlock(const CChainParams& chainparams, const std::shared_ptr<cons
  * @param[in]  chainparams The params for the chain we want to connect to
  * @param[out] ppindex If set, the pointer will be set to point to the last new block index object for the given headers
  */
-bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& block, CValidationState& state, const CChainParams& chainparams, const CBlockIndex** ppindex=NULL);
+bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& block, CValidationState& state, const CChainParams& chainparams, const CBlockIndex** ppindex=NULL, bool fCheckPOW=true);
+
+/**
+ * Run the context-free checks (mostly proof of work) of a batch of headers,
+ * spread over the header checking threads if there are any. Does not need
+ * cs_main; headers checked here can be passed to ProcessNewBlockHeaders
+ * with fCheckPOW=false.
+ */
+bool CheckBlockHeaders(const std::vector<CBlockHeader>& headers, CValidationState& state);
 
 /** Check whether enough disk space is available for an incoming block */
 bool CheckDiskSpace(uint64_t nAdditionalBytes = 0);
@@ -275,6 +302,10 @@ bool LoadBlockIndex(const CChainParams& chainparams);
 void UnloadBlockIndex();
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the thread checking block headers and the transactions of a block */
+void ThreadBlockDataCheck();
+/** Run an instance of the thread checking scripts of the next block to connect ahead of time */
+void ThreadSpeculativeScriptCheck();
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
 bool IsInitialBlockDownload();
 /** Format a string that describes several potential problems detected by the core.
@@ -343,6 +374,33 @@ bool AcceptToMemoryPoolWithTime(CTxMemPool& pool, CValidationState &state, const
                         bool* pfMissingInputs, int64_t nAcceptTime, std::list<CTransactionRef>* plTxnReplaced = NULL,
                         bool fOverrideMempoolLimit=false, const CAmount nAbsurdFee=0);
 
+/**
+ * Verify the scripts of a transaction without holding cs_main, so that a
+ * following AcceptToMemoryPool finds its signatures in the signature cache
+ * and does not hold up block validation and other peers with them. Only
+ * transactions that pass the cheap standardness and fee checks of
+ * AcceptToMemoryPool are verified, on the script check threads. Returns
+ * true if the scripts are valid, with the spent outputs in vSpent; the
+ * caller must then pass them to UncacheTransactionScripts if the
+ * transaction is not accepted after all. This is only a hint, as
+ * AcceptToMemoryPool checks everything again.
+ */
+bool PreverifyTransactionScripts(CTxMemPool& pool, const CTransaction& tx, std::vector<CTxOut>& vSpent);
+
+/** Let the signature cache drop the signatures of a transaction PreverifyTransactionScripts cached */
+void UncacheTransactionScripts(const CTransaction& tx, const std::vector<CTxOut>& vSpent);
+
+/**
+ * (try to) add a batch of transactions to the memory pool. The scripts of
+ * all of them are checked in parallel first, then they are accepted with
+ * parents in the batch before their children. vState and vMissingInputs
+ * are set per transaction, in the order of vtx. Returns the number of
+ * transactions accepted.
+ */
+unsigned int AcceptToMemoryPoolBatch(CTxMemPool& pool, const std::vector<CTransactionRef>& vtx, bool fLimitFree,
+                                     std::vector<CValidationState>& vState, std::vector<bool>& vMissingInputs,
+                                     bool fOverrideMempoolLimit=false, const CAmount nAbsurdFee=0);
+
 /** Convert CValidationState to a human-readable message for logging */
 std::string FormatStateMessage(const CValidationState &state);
 
@@ -377,13 +435,37 @@ unsigned int GetP2SHSigOpCount(const CTransaction& tx, const CCoinsViewCache& ma
  */
 int64_t GetTransactionSigOpCost(const CTransaction& tx, const CCoinsViewCache& inputs, int flags);
 
+/** Initializes the script execution cache used by CheckInputs */
+void InitScriptExecutionCache();
+
 /**
  * Check whether all inputs of this transaction are valid (no double spends, scripts & sigs, amounts)
  * This does not modify the UTXO set. If pvChecks is not NULL, script checks are pushed onto it
  * instead of being performed inline.
+ * Valid signatures are cached if cacheSigStore, and the transaction as a whole is cached as valid
+ * under flags if cacheFullScriptStore and its scripts ran inline. Requires cs_main.
  */
 bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &view, bool fScriptChecks,
-                 unsigned int flags, bool cacheStore, PrecomputedTransactionData& txdata, std::vector<CScriptCheck> *pvChecks = NULL);
+                 unsigned int flags, bool cacheSigStore, bool cacheFullScriptStore, PrecomputedTransactionData& txdata, std::vector<CScriptCheck> *pvChecks = NULL);
+
+/** Script verification flags of a block at nHeight on top of pindexPrev. Requires cs_main. */
+unsigned int GetBlockScriptFlags(const CBlockIndex* pindexPrev, int nHeight, const CChainParams& chainparams);
+
+/**
+ * Queue the script checks of pindex, the block after the one about to be
+ * connected, on the speculative check threads if -speculativeverify is set.
+ * At most one block is checked ahead at a time. Requires cs_main.
+ */
+void StartSpeculativeChecks(const CBlockIndex* pindex, const CChainParams& chainparams);
+
+/**
+ * Wait for the queued speculative checks, helping with those not started yet.
+ * If they were for pindex and all passed, its fully checked transactions are
+ * added to the script execution cache. Returns the block they were for if that
+ * is pindex, so it need not be read again. pindex may be NULL to just get rid
+ * of the checks. Requires cs_main.
+ */
+std::shared_ptr<const CBlock> FinishSpeculativeChecks(const CBlockIndex* pindex);
 
 /** Apply the effects of this transaction on the UTXO set represented by view */
 void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, int nHeight);
@@ -464,6 +546,9 @@ public:
     CScriptCheck(const CCoins& txFromIn, const CTransaction& txToIn, unsigned int nInIn, unsigned int nFlagsIn, bool cacheIn, PrecomputedTransactionData* txdataIn) :
         scriptPubKey(txFromIn.vout[txToIn.vin[nInIn].prevout.n].scriptPubKey), amount(txFromIn.vout[txToIn.vin[nInIn].prevout.n].nValue),
         ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(txdataIn) { }
+    CScriptCheck(const CTxOut& outIn, const CTransaction& txToIn, unsigned int nInIn, unsigned int nFlagsIn, bool cacheIn, PrecomputedTransactionData* txdataIn) :
+        scriptPubKey(outIn.scriptPubKey), amount(outIn.nValue),
+        ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(txdataIn) { }
 
     bool operator()();
 
@@ -481,6 +566,30 @@ public:
     ScriptError GetScriptError() const { return error; }
 };
 
+/**
+ * Closure representing the context-free check of one block header or of
+ * one transaction in a block, so that both run on the same check threads
+ * Note that this stores a reference to the header or transaction
+ */
+class CBlockDataCheck
+{
+private:
+    const CBlockHeader *pheader;
+    const CTransaction *ptx;
+
+public:
+    CBlockDataCheck(): pheader(0), ptx(0) {}
+    CBlockDataCheck(const CBlockHeader& headerIn) : pheader(&headerIn), ptx(0) {}
+    CBlockDataCheck(const CTransaction& txIn) : pheader(0), ptx(&txIn) {}
+
+    bool operator()();
+
+    void swap(CBlockDataCheck &check) {
+        std::swap(pheader, check.pheader);
+        std::swap(ptx, check.ptx);
+    }
+};
+
 
 /** Functions for disk access for blocks */
 bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
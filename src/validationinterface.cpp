@@ -41,6 +41,9 @@ void RegisterValidationInterface(CValidationInterface* pwalletIn) {
     g_signals.NewPoWValidBlock.connect(boost::bind(&CValidationInterface::NewPoWValidBlock,
                                                    pwalletIn, boost::placeholders::_1,
                                                    boost::placeholders::_2));
+    g_signals.NewBlockTemplate.connect(boost::bind(&CValidationInterface::NewBlockTemplate,
+                                                   pwalletIn, boost::placeholders::_1,
+                                                   boost::placeholders::_2));
 }
 
 void UnregisterValidationInterface(CValidationInterface* pwalletIn) {
@@ -71,6 +74,9 @@ void UnregisterValidationInterface(CValidationInterface* pwalletIn) {
     g_signals.NewPoWValidBlock.disconnect(boost::bind(&CValidationInterface::NewPoWValidBlock,
                                           pwalletIn, boost::placeholders::_1,
                                           boost::placeholders::_2));
+    g_signals.NewBlockTemplate.disconnect(boost::bind(&CValidationInterface::NewBlockTemplate,
+                                          pwalletIn, boost::placeholders::_1,
+                                          boost::placeholders::_2));
 }
 
 void UnregisterAllValidationInterfaces() {
@@ -84,4 +90,5 @@ void UnregisterAllValidationInterfaces() {
     g_signals.SyncTransaction.disconnect_all_slots();
     g_signals.UpdatedBlockTip.disconnect_all_slots();
     g_signals.NewPoWValidBlock.disconnect_all_slots();
+    g_signals.NewBlockTemplate.disconnect_all_slots();
 }
@@ -42,6 +42,7 @@ protected:
     virtual void GetScriptForMining(boost::shared_ptr<CReserveScript>&) {};
     virtual void ResetRequestCount(const uint256 &hash) {};
     virtual void NewPoWValidBlock(const CBlockIndex *pindex, const std::shared_ptr<const CBlock>& block) {};
+    virtual void NewBlockTemplate(const CBlockIndex *pindexPrev, bool fFull) {};
     friend void ::RegisterValidationInterface(CValidationInterface*);
     friend void ::UnregisterValidationInterface(CValidationInterface*);
     friend void ::UnregisterAllValidationInterfaces();
@@ -79,6 +80,13 @@ struct CMainSignals {
      * Notifies listeners that a block which builds directly on our current tip
      * has been received and connected to the headers tree, though not validated yet */
     boost::signals2::signal<void (const CBlockIndex *, const std::shared_ptr<const CBlock>&)> NewPoWValidBlock;
+    /**
+     * Notifies listeners that a new block template on top of pindexPrev is
+     * available to the mining RPCs. Sent with fFull false for the coinbase-only
+     * template made right after the tip changed, and again with fFull true once
+     * the template with transactions has been assembled.
+     */
+    boost::signals2::signal<void (const CBlockIndex *pindexPrev, bool fFull)> NewBlockTemplate;
 };
 
 CMainSignals& GetMainSignals();
@@ -9,6 +9,7 @@
 
 class CBlockIndex;
 class CZMQAbstractNotifier;
+struct CDiskBlockPos;
 
 typedef CZMQAbstractNotifier* (*CZMQNotifierFactory)();
 
@@ -32,8 +33,10 @@ public:
     virtual bool Initialize(void *pcontext) = 0;
     virtual void Shutdown() = 0;
 
-    virtual bool NotifyBlock(const CBlockIndex *pindex);
+    /** blockPos is where the block is stored, taken under cs_main by the caller */
+    virtual bool NotifyBlock(const CBlockIndex *pindex, const CDiskBlockPos &blockPos);
     virtual bool NotifyTransaction(const CTransaction &transaction);
+    virtual bool NotifyBlockTemplate(const CBlockIndex *pindexPrev, bool fFull);
 
 protected:
     void *psocket;
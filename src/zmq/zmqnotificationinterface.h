@@ -5,6 +5,7 @@
 #ifndef BITCOIN_ZMQ_ZMQNOTIFICATIONINTERFACE_H
 #define BITCOIN_ZMQ_ZMQNOTIFICATIONINTERFACE_H
 
+#include "sync.h"
 #include "validationinterface.h"
 #include <string>
 #include <map>
@@ -26,11 +27,20 @@ protected:
     // CValidationInterface
     void SyncTransaction(const CTransaction& tx, const CBlockIndex *pindex, int posInBlock);
     void UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload);
+    void NewBlockTemplate(const CBlockIndex *pindexPrev, bool fFull);
 
 private:
     CZMQNotificationInterface();
 
     void *pcontext;
+
+    /**
+     * Guards notifiers and their sockets. Block templates are notified from
+     * the template engine thread, everything else from the threads that
+     * change the chain or the mempool. Taken after cs_main, and never held
+     * together with it while sending.
+     */
+    CCriticalSection cs_notifiers;
     std::list<CZMQAbstractNotifier*> notifiers;
 };
 